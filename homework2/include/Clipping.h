@@ -0,0 +1,140 @@
+//
+// Primitive assembly in clip space: frustum culling, backface culling and
+// near-plane clipping, done before the perspective divide.
+//
+// The projection matrices of these assignments put the view-space z (not -z)
+// into w, so points in front of the eye have w < 0. Every test therefore
+// works on (X, Y, D) = s * (x, y, w) with s = -sign(P(3, 2)), which makes D
+// the distance in front of the eye for either convention; a point is inside
+// the side planes when -D <= X, Y <= D. The near plane is D = near. The
+// matrices do not map the near/far planes to z = -w / z = w, so depth is
+// neither clipped nor culled against the far plane.
+//
+// Only the near plane is clipped: it is what keeps the perspective divide
+// well defined. Triangles crossing the other planes are left to the guard band
+// of the rasterizer (edge_setup rejects vertices beyond guard_band pixels),
+// so clipping never adds vertices for the common case of a triangle that
+// sticks out of the screen.
+//
+// Facing is decided by the sign of det[X Y D] of the three vertices, which has
+// the sign of the screen-space area of the projected triangle (counter-
+// clockwise, i.e. front facing, is positive) and stays meaningful for
+// triangles that cross the near plane.
+//
+
+#ifndef RASTERIZER_CLIPPING_H
+#define RASTERIZER_CLIPPING_H
+
+#include <cstdint>
+#include <eigen3/Eigen/Eigen>
+
+namespace rst
+{
+    enum class Cull
+    {
+        None,
+        Back,   // 剔除顺时针（背面）的三角形
+        Front
+    };
+
+    // 每一步去掉了多少个三角形
+    struct clip_stats
+    {
+        uint64_t submitted = 0;        // 进入图元装配的三角形
+        uint64_t culled_object = 0;    // 整个物体的包围盒在视锥外
+        uint64_t culled_frustum = 0;   // 三个顶点都在同一个平面外
+        uint64_t culled_backface = 0;  // 背面（或正面）剔除
+        uint64_t clipped_near = 0;     // 和近平面相交、被裁剪的三角形
+        uint64_t emitted = 0;          // 送去光栅化的三角形（裁剪后一个可能变成两个）
+
+        clip_stats &operator+=(const clip_stats &o)
+        {
+            submitted += o.submitted;
+            culled_object += o.culled_object;
+            culled_frustum += o.culled_frustum;
+            culled_backface += o.culled_backface;
+            clipped_near += o.clipped_near;
+            emitted += o.emitted;
+            return *this;
+        }
+    };
+
+    enum : unsigned
+    {
+        outside_left = 1,
+        outside_right = 2,
+        outside_bottom = 4,
+        outside_top = 8,
+        outside_near = 16
+    };
+
+    // 视图空间中相机看向 -z：P 的最后一行把 z 放进 w 时取 -1，把 -z 放进 w 时取 1
+    inline float eye_sign(const Eigen::Matrix4f &projection)
+    {
+        return projection(3, 2) > 0 ? -1.0f : 1.0f;
+    }
+
+    // 齐次坐标 c 在哪些平面之外
+    inline unsigned outcode(const Eigen::Vector4f &c, float s, float near)
+    {
+        float X = s * c.x(), Y = s * c.y(), D = s * c.w();
+        unsigned code = 0;
+        if (X < -D) code |= outside_left;
+        if (X > D) code |= outside_right;
+        if (Y < -D) code |= outside_bottom;
+        if (Y > D) code |= outside_top;
+        if (D < near) code |= outside_near;
+        return code;
+    }
+
+    // 屏幕上逆时针为正
+    inline float facing(const Eigen::Vector4f &a, const Eigen::Vector4f &b, const Eigen::Vector4f &c, float s)
+    {
+        Eigen::Matrix3f m;
+        m << a.x(), a.y(), a.w(),
+             b.x(), b.y(), b.w(),
+             c.x(), c.y(), c.w();
+        return s * m.determinant();
+    }
+
+    inline bool culled(Cull cull, float facing)
+    {
+        return (cull == Cull::Back && facing < 0) || (cull == Cull::Front && facing > 0);
+    }
+
+    // 包围盒 [lo, hi] 经过 mvp 之后的 8 个角：返回所有角共同在外的平面，inside 为 true 表示全在视锥内
+    inline unsigned box_outcode(const Eigen::Matrix4f &mvp, const Eigen::Vector3f &lo, const Eigen::Vector3f &hi,
+                                float s, float near, bool &inside)
+    {
+        unsigned all = ~0u, any = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            Eigen::Vector4f corner(i & 1 ? hi.x() : lo.x(), i & 2 ? hi.y() : lo.y(), i & 4 ? hi.z() : lo.z(), 1.0f);
+            unsigned code = outcode(mvp * corner, s, near);
+            all &= code;
+            any |= code;
+        }
+        inside = any == 0;
+        return all;
+    }
+
+    // 用近平面 D = near 裁剪三角形 in[0..2]（Sutherland-Hodgman），结果是按原来顺序排列的凸多边形，
+    // 最多 4 个顶点，返回顶点数。clip(v) 取出顶点的齐次坐标，lerp(a, b, t) 在两个顶点之间线性插值
+    template <typename V, typename Clip, typename Lerp>
+    int clip_near_plane(const V *in, V *out, float s, float near, Clip &&clip, Lerp &&lerp)
+    {
+        int n = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            const V &a = in[i], &b = in[(i + 1) % 3];
+            float da = s * clip(a).w() - near, db = s * clip(b).w() - near;
+            if (da >= 0)
+                out[n++] = a;
+            if ((da >= 0) != (db >= 0))
+                out[n++] = lerp(a, b, da / (da - db));
+        }
+        return n;
+    }
+}
+
+#endif //RASTERIZER_CLIPPING_H
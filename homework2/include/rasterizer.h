@@ -4,8 +4,10 @@
 
 #pragma once
 
+#include "Clipping.h"
 #include "Triangle.h"
 #include <algorithm>
+#include <array>
 #include <eigen3/Eigen/Eigen>
 using namespace Eigen;
 
@@ -62,6 +64,11 @@ class rasterizer
     void set_view(const Eigen::Matrix4f& v);
     void set_projection(const Eigen::Matrix4f& p);
 
+    // 背面剔除，默认不剔除（线框模式下背面的边也画出来）
+    void set_cull(Cull c) { cull = c; }
+    // 近平面到相机的距离（get_projection_matrix 的 |zNear|），更近的部分被裁掉
+    void set_clip_near(float d) { clip_near = d; }
+
     void set_pixel(const Eigen::Vector3f& point, const Eigen::Vector3f& color);
 
     void clear(Buffers buff);
@@ -69,10 +76,14 @@ class rasterizer
     void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, Primitive type);
 
     std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
+    // 最近一次 draw 中图元装配剔除和裁剪的三角形数
+    const clip_stats& stats() const { return last_stats; }
 
   private:
     void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
     void rasterize_wireframe(const Triangle& t);
+    // 近平面裁剪后的多边形（屏幕坐标）的边
+    void rasterize_wireframe(const Eigen::Vector3f* v, int n);
 
   private:
     // 这里是三个变换矩阵（3个4*4的矩阵）
@@ -81,6 +92,8 @@ class rasterizer
     Eigen::Matrix4f projection;
 
     std::map<int, std::vector<Eigen::Vector3f>> pos_buf;
+    // 每个位置缓冲区的包围盒（最小、最大），整个物体的视锥剔除用
+    std::map<int, std::array<Eigen::Vector3f, 2>> pos_bounds;
     // 这里存放了很多三角形的三个顶点
     std::map<int, std::vector<Eigen::Vector3i>> ind_buf;
     // 这里存放了很多 0、1、2
@@ -93,6 +106,10 @@ class rasterizer
 
     int width, height;
 
+    Cull cull = Cull::None;
+    float clip_near = 0.1f;
+    clip_stats last_stats;
+
     int next_id = 0;
     int get_next_id() { return next_id++; }
 };
@@ -13,6 +13,13 @@ rst::pos_buf_id rst::rasterizer::load_positions(const std::vector<Eigen::Vector3
     auto id = get_next_id();
     pos_buf.emplace(id, positions);
 
+    std::array<Eigen::Vector3f, 2> bounds = {Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero()};
+    if (!positions.empty())
+        bounds = {positions[0], positions[0]};
+    for (const auto &p : positions)
+        bounds = {bounds[0].cwiseMin(p), bounds[1].cwiseMax(p)};
+    pos_bounds.emplace(id, bounds);
+
     return {id};
 }
 
@@ -158,6 +165,30 @@ void rst::rasterizer::draw(rst::pos_buf_id pos_buffer, rst::ind_buf_id ind_buffe
     // MVP变换矩阵
     Eigen::Matrix4f mvp = projection * view * model;
 
+    float s = eye_sign(projection);
+    last_stats = clip_stats();
+    last_stats.submitted = ind.size();
+
+    // 整个物体的包围盒在某一个平面之外时什么都不用画；完全在视锥内时不用再逐个三角形地测试
+    auto &bounds = pos_bounds[pos_buffer.pos_id];
+    bool inside = false;
+    if (!buf.empty() && box_outcode(mvp, bounds[0], bounds[1], s, clip_near, inside))
+    {
+        last_stats.culled_object = ind.size();
+        return;
+    }
+
+    // 透视除法和视口变换
+    auto to_screen = [&](Eigen::Vector4f vert)
+    {
+        // 这里是在干什么？？？？
+        vert /= vert.w();
+        vert.x() = 0.5 * width * (vert.x() + 1.0);
+        vert.y() = 0.5 * height * (vert.y() + 1.0);
+        vert.z() = vert.z() * f1 + f2;
+        return Eigen::Vector3f(vert.head<3>());
+    };
+
     for (auto &i : ind)
     {
         Triangle t; // 创建三角形
@@ -169,24 +200,44 @@ void rst::rasterizer::draw(rst::pos_buf_id pos_buffer, rst::ind_buf_id ind_buffe
                                mvp * to_vec4(buf[i[1]], 1.0f),
                                mvp * to_vec4(buf[i[2]], 1.0f)};
 
-        // 这里是在干什么？？？？
-        for (auto &vec : v)
+        // 三个顶点都在同一个平面之外时看不见；背面剔除
+        unsigned any = 0;
+        if (!inside)
+        {
+            unsigned c0 = outcode(v[0], s, clip_near), c1 = outcode(v[1], s, clip_near), c2 = outcode(v[2], s, clip_near);
+            if (c0 & c1 & c2)
+            {
+                ++last_stats.culled_frustum;
+                continue;
+            }
+            any = c0 | c1 | c2;
+        }
+        if (cull != Cull::None && culled(cull, facing(v[0], v[1], v[2], s)))
         {
-            vec /= vec.w();
+            ++last_stats.culled_backface;
+            continue;
         }
 
-        for (auto &vert : v)
+        // 和近平面相交时裁掉相机前 clip_near 以内的部分，画裁剪后多边形的边
+        if (any & outside_near)
         {
-            vert.x() = 0.5 * width * (vert.x() + 1.0);
-            vert.y() = 0.5 * height * (vert.y() + 1.0);
-            vert.z() = vert.z() * f1 + f2;
+            ++last_stats.clipped_near;
+            Eigen::Vector4f polygon[4];
+            int n = clip_near_plane(v, polygon, s, clip_near,
+                                    [](const Eigen::Vector4f &c) -> const Eigen::Vector4f & { return c; },
+                                    [](const Eigen::Vector4f &a, const Eigen::Vector4f &b, float t) -> Eigen::Vector4f
+                                    { return a + t * (b - a); });
+            Eigen::Vector3f screen[4];
+            for (int k = 0; k < n; ++k)
+                screen[k] = to_screen(polygon[k]);
+            rasterize_wireframe(screen, n);
+            ++last_stats.emitted;
+            continue;
         }
 
-        for (int i = 0; i < 3; ++i)
+        for (int k = 0; k < 3; ++k)
         {
-            t.setVertex(i, v[i].head<3>());
-            t.setVertex(i, v[i].head<3>());
-            t.setVertex(i, v[i].head<3>());
+            t.setVertex(k, to_screen(v[k]));
         }
 
         // 这里的颜色是随便写的，还没有用到
@@ -196,6 +247,7 @@ void rst::rasterizer::draw(rst::pos_buf_id pos_buffer, rst::ind_buf_id ind_buffe
 
         // 画三角形框架
         rasterize_wireframe(t);
+        ++last_stats.emitted;
     }
 }
 
@@ -206,6 +258,12 @@ void rst::rasterizer::rasterize_wireframe(const Triangle &t)
     draw_line(t.b(), t.a());
 }
 
+void rst::rasterizer::rasterize_wireframe(const Eigen::Vector3f *v, int n)
+{
+    for (int k = 0; k < n; ++k)
+        draw_line(v[k], v[(k + 1) % n]);
+}
+
 void rst::rasterizer::set_model(const Eigen::Matrix4f &m)
 {
     model = m;
@@ -250,8 +308,9 @@ int rst::rasterizer::get_index(int x, int y)
 void rst::rasterizer::set_pixel(const Eigen::Vector3f &point, const Eigen::Vector3f &color)
 {
     //old index: auto ind = point.y() + point.x() * width;
+    // y = 0 对应的是 frame_buf 之后的一行
     if (point.x() < 0 || point.x() >= width ||
-        point.y() < 0 || point.y() >= height)
+        point.y() <= 0 || point.y() >= height)
         return;
         
     auto ind = (height - point.y()) * width + point.x();
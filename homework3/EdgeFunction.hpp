@@ -0,0 +1,243 @@
+//
+// Edge-function triangle rasterization in 16.8 fixed point.
+//
+// Triangle setup (once per triangle) snaps the screen-space vertices to 1/256
+// pixel and turns each edge into an integer edge function
+//     E_i(X, Y) = a_i * X + b_i * Y + c_i
+// which is positive on the inside of the triangle (clockwise triangles are
+// flipped). Pixel centres that fall exactly on an edge belong to the triangle
+// only if the edge is a top or left edge, so two triangles sharing an edge
+// never both cover, and never both miss, a pixel on it: the mesh is
+// watertight. All edge values are exact 64-bit integers, so walking the
+// bounding box incrementally gives the same numbers as evaluating E_i at a
+// single pixel, and the barycentric coordinates are E_i / area.
+//
+// scan_triangle() walks the box row by row in buffer order and tests 4 pixels
+// per step: one 4 x 64-bit register per edge with AVX2, two with SSE2, plain
+// integers otherwise (or when RST_SIMD_SCALAR is defined). A pixel is covered
+// when no edge value is negative, i.e. when the sign bit of e0 | e1 | e2 is 0.
+//
+
+#ifndef RASTERIZER_EDGEFUNCTION_H
+#define RASTERIZER_EDGEFUNCTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if !defined(RST_SIMD_SCALAR) && defined(__AVX2__)
+#define RST_SIMD_AVX2 1
+#include <immintrin.h>
+#elif !defined(RST_SIMD_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64))
+#define RST_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace rst
+{
+    // 16.8 定点：屏幕坐标乘以 256 后取整
+    constexpr int subpixel_bits = 8;
+    constexpr int64_t subpixel_one = int64_t(1) << subpixel_bits;
+    // 顶点坐标超出这个范围（像素）的三角形不光栅化。没有裁剪时，靠近相机平面的三角形会被投影到
+    // 极远处；在这个范围内时定点坐标的边函数不会溢出 int64
+    constexpr float guard_band = float(1 << 20);
+
+    struct edge_setup
+    {
+        // 第 i 条边是顶点 i 对面的边（从顶点 i + 1 到 i + 2），在像素中心的定点坐标上求值。
+        // bias 为 0（上边、左边）或 -1（其它边），覆盖条件是 E_i + bias_i >= 0
+        int64_t a[3], b[3], c[3], bias[3];
+        float inv_area;
+        // 可能被覆盖的像素范围（两端都包含），没有裁到屏幕范围内
+        int x0, y0, x1, y1;
+
+        // v[i].x()、v[i].y() 是屏幕坐标。退化（面积为 0）或超出 guard_band 时返回 false
+        template <typename V>
+        bool setup(const V *v)
+        {
+            int64_t X[3], Y[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                // 也排除了 NaN
+                if (!(std::fabs(v[i].x()) < guard_band && std::fabs(v[i].y()) < guard_band))
+                    return false;
+                X[i] = std::llround(v[i].x() * subpixel_one);
+                Y[i] = std::llround(v[i].y() * subpixel_one);
+            }
+            for (int i = 0; i < 3; ++i)
+            {
+                int j = (i + 1) % 3, k = (i + 2) % 3;
+                a[i] = Y[j] - Y[k];
+                b[i] = X[k] - X[j];
+                c[i] = (Y[k] - Y[j]) * X[j] - (X[k] - X[j]) * Y[j];
+            }
+            int64_t area = a[0] * X[0] + b[0] * Y[0] + c[0];
+            if (area == 0)
+                return false;
+            // 统一成逆时针：顺时针的三角形把所有边函数取反
+            if (area < 0)
+            {
+                area = -area;
+                for (int i = 0; i < 3; ++i)
+                    a[i] = -a[i], b[i] = -b[i], c[i] = -c[i];
+            }
+            for (int i = 0; i < 3; ++i)
+            {
+                // 边的方向是 (b, -a)，内部在它的左边（y 轴向上）：
+                // 左边是向下走的边，上边是向左走的水平边
+                bool top_left = a[i] > 0 || (a[i] == 0 && b[i] < 0);
+                bias[i] = top_left ? 0 : -1;
+            }
+            inv_area = 1.0f / float(area);
+
+            // 像素中心 (x + 0.5) * 256 落在 [min, max] 中的像素；>> 是向下取整
+            int64_t min_x = std::min({X[0], X[1], X[2]}), max_x = std::max({X[0], X[1], X[2]});
+            int64_t min_y = std::min({Y[0], Y[1], Y[2]}), max_y = std::max({Y[0], Y[1], Y[2]});
+            const int64_t half = subpixel_one / 2;
+            x0 = int((min_x - half + subpixel_one - 1) >> subpixel_bits);
+            x1 = int((max_x - half) >> subpixel_bits);
+            y0 = int((min_y - half + subpixel_one - 1) >> subpixel_bits);
+            y1 = int((max_y - half) >> subpixel_bits);
+            return true;
+        }
+
+        // 像素 (x, y) 中心处的边函数（不含 bias）
+        int64_t edge(int i, int x, int y) const
+        {
+            return a[i] * (x * subpixel_one + subpixel_one / 2) + b[i] * (y * subpixel_one + subpixel_one / 2) + c[i];
+        }
+
+        void barycentric(int x, int y, float &alpha, float &beta, float &gamma) const
+        {
+            alpha = float(edge(0, x, y)) * inv_area;
+            beta = float(edge(1, x, y)) * inv_area;
+            gamma = float(edge(2, x, y)) * inv_area;
+        }
+    };
+
+    // 一行中连续 4 个像素的（加上 bias 的）边函数值
+    struct edge_lanes
+    {
+#if defined(RST_SIMD_AVX2)
+        __m256i e[3], step[3];
+
+        edge_lanes(const int64_t *start, const int64_t *dx)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                e[i] = _mm256_set_epi64x(start[i] + 3 * dx[i], start[i] + 2 * dx[i], start[i] + dx[i], start[i]);
+                step[i] = _mm256_set1_epi64x(4 * dx[i]);
+            }
+        }
+        unsigned mask() const
+        {
+            __m256i any = _mm256_or_si256(_mm256_or_si256(e[0], e[1]), e[2]);
+            return ~unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(any))) & 15u;
+        }
+        void next()
+        {
+            for (int i = 0; i < 3; ++i)
+                e[i] = _mm256_add_epi64(e[i], step[i]);
+        }
+#elif defined(RST_SIMD_SSE2)
+        __m128i lo[3], hi[3], step[3];
+
+        edge_lanes(const int64_t *start, const int64_t *dx)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                lo[i] = _mm_set_epi64x(start[i] + dx[i], start[i]);
+                hi[i] = _mm_set_epi64x(start[i] + 3 * dx[i], start[i] + 2 * dx[i]);
+                step[i] = _mm_set1_epi64x(4 * dx[i]);
+            }
+        }
+        unsigned mask() const
+        {
+            __m128i any_lo = _mm_or_si128(_mm_or_si128(lo[0], lo[1]), lo[2]);
+            __m128i any_hi = _mm_or_si128(_mm_or_si128(hi[0], hi[1]), hi[2]);
+            unsigned sign = unsigned(_mm_movemask_pd(_mm_castsi128_pd(any_lo))) |
+                            unsigned(_mm_movemask_pd(_mm_castsi128_pd(any_hi))) << 2;
+            return ~sign & 15u;
+        }
+        void next()
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                lo[i] = _mm_add_epi64(lo[i], step[i]);
+                hi[i] = _mm_add_epi64(hi[i], step[i]);
+            }
+        }
+#else
+        int64_t e[3][4], step[3];
+
+        edge_lanes(const int64_t *start, const int64_t *dx)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int k = 0; k < 4; ++k)
+                    e[i][k] = start[i] + k * dx[i];
+                step[i] = 4 * dx[i];
+            }
+        }
+        unsigned mask() const
+        {
+            unsigned m = 0;
+            for (int k = 0; k < 4; ++k)
+                m |= unsigned((e[0][k] | e[1][k] | e[2][k]) >= 0) << k;
+            return m;
+        }
+        void next()
+        {
+            for (int i = 0; i < 3; ++i)
+                for (int k = 0; k < 4; ++k)
+                    e[i][k] += step[i];
+        }
+#endif
+    };
+
+    // 按 buffer 的顺序（y 外层、x 内层）遍历 [x0, x1] x [y0, y1] 中被三角形覆盖的像素，
+    // 对每个像素调用 f(x, y, alpha, beta, gamma)
+    template <typename F>
+    void scan_triangle(const edge_setup &s, int x0, int y0, int x1, int y1, F &&f)
+    {
+        x0 = std::max(x0, s.x0);
+        x1 = std::min(x1, s.x1);
+        y0 = std::max(y0, s.y0);
+        y1 = std::min(y1, s.y1);
+        if (x0 > x1 || y0 > y1)
+            return;
+
+        int64_t row[3], dx[3], dy[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            row[i] = s.edge(i, x0, y0) + s.bias[i];
+            dx[i] = s.a[i] * subpixel_one;
+            dy[i] = s.b[i] * subpixel_one;
+        }
+        for (int y = y0; y <= y1; ++y)
+        {
+            edge_lanes lanes(row, dx);
+            for (int x = x0; x <= x1; x += 4, lanes.next())
+            {
+                unsigned mask = lanes.mask();
+                if (x1 - x < 3)
+                    mask &= (1u << (x1 - x + 1)) - 1;
+                while (mask)
+                {
+                    int k = __builtin_ctz(mask);
+                    mask &= mask - 1;
+                    // 从这一行的起点递推出边函数，再去掉 bias 就是重心坐标的分子
+                    int64_t n = int64_t(x - x0 + k);
+                    f(x + k, y,
+                      float(row[0] + n * dx[0] - s.bias[0]) * s.inv_area,
+                      float(row[1] + n * dx[1] - s.bias[1]) * s.inv_area,
+                      float(row[2] + n * dx[2] - s.bias[2]) * s.inv_area);
+                }
+            }
+            for (int i = 0; i < 3; ++i)
+                row[i] += dy[i];
+        }
+    }
+}
+
+#endif //RASTERIZER_EDGEFUNCTION_H
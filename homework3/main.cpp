@@ -143,6 +143,11 @@ int main(int argc, const char** argv)
 
         r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
 
+        const rst::clip_stats& stats = r.stats();
+        std::cout << "Primitive assembly: " << stats.submitted << " triangles in, "
+                  << stats.culled_frustum << " culled (frustum), " << stats.culled_backface << " culled (backface), "
+                  << stats.clipped_near << " clipped (near), " << stats.emitted << " out\n";
+
         cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
         image.convertTo(image, CV_8UC3, 1.0f);
 
@@ -39,30 +39,6 @@ auto to_vec4(const Eigen::Vector3f& v3, float w = 1.0f)
     return Vector4f(v3.x(), v3.y(), v3.z(), w);
 }
 
-static bool insideTriangle(int x, int y, const Vector3f* _v)
-{   
-    // TODO : Implement this function to check if the point (x, y) is inside the triangle represented by _v[0], _v[1], _v[2]
-    // 判断像素点是否在三角形里面，叉乘结果不变号
-    float r1 = (y - _v[0].y()) * (_v[1].x() - _v[0].x()) - (x - _v[0].x()) * (_v[1].y() - _v[0].y());
-    float r2 = (y - _v[1].y()) * (_v[2].x() - _v[1].x()) - (x - _v[1].x()) * (_v[2].y() - _v[1].y());
-    float r3 = (y - _v[2].y()) * (_v[0].x() - _v[2].x()) - (x - _v[2].x()) * (_v[0].y() - _v[2].y());
-
-    if(r1 >= 0 && r2 >= 0 && r3 >= 0 || r1 <= 0 && r2 <= 0 && r3 <= 0){
-        return true;
-    }
-
-    return false;
-
-}
-
-static std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector3f* v)
-{
-    float c1 = (x*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*y + v[1].x()*v[2].y() - v[2].x()*v[1].y()) / (v[0].x()*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*v[0].y() + v[1].x()*v[2].y() - v[2].x()*v[1].y());
-    float c2 = (x*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*y + v[2].x()*v[0].y() - v[0].x()*v[2].y()) / (v[1].x()*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*v[1].y() + v[2].x()*v[0].y() - v[0].x()*v[2].y());
-    float c3 = (x*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*y + v[0].x()*v[1].y() - v[1].x()*v[0].y()) / (v[2].x()*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*v[2].y() + v[0].x()*v[1].y() - v[1].x()*v[0].y());
-    return {c1,c2,c3};
-}
-
 void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type)
 {
     auto& buf = pos_buf[pos_buffer.pos_id];
@@ -73,100 +49,147 @@ void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf
     float f2 = (50 + 0.1) / 2.0;
 
 
+    // 图元装配中的顶点：齐次坐标和颜色，裁剪时一起线性插值
+    struct clip_vertex
+    {
+        Eigen::Vector4f clip;
+        Eigen::Vector3f color;
+    };
+    float s = eye_sign(projection);
+    last_stats = clip_stats();
+
     int index = 0;
     // 这里的 i 对应到每个三角形
     for (auto& i : ind)
     {
         Eigen::Matrix4f mvp = projection * view * model[index++];
 
-        Triangle t;
-        // 得到三角形3个顶点在屏幕上的齐次坐标 4*3
-        Eigen::Vector4f v[] = {
-                mvp * to_vec4(buf[i[0]], 1.0f),
-                mvp * to_vec4(buf[i[1]], 1.0f),
-                mvp * to_vec4(buf[i[2]], 1.0f)
+        // 得到三角形3个顶点的齐次坐标 4*3
+        clip_vertex corners[] = {
+                {mvp * to_vec4(buf[i[0]], 1.0f), col[i[0]]},
+                {mvp * to_vec4(buf[i[1]], 1.0f), col[i[1]]},
+                {mvp * to_vec4(buf[i[2]], 1.0f), col[i[2]]}
         };
+        ++last_stats.submitted;
 
-        //Homogeneous division
-        // 齐次坐标归1
-        for (auto& vec : v) {
-            vec /= vec.w();
+        // 三个顶点都在同一个平面之外时看不见；背面剔除
+        unsigned c0 = outcode(corners[0].clip, s, clip_near), c1 = outcode(corners[1].clip, s, clip_near), c2 = outcode(corners[2].clip, s, clip_near);
+        if (c0 & c1 & c2)
+        {
+            ++last_stats.culled_frustum;
+            continue;
         }
-
-        //Viewport transformation
-        // 视口变换
-        for (auto & vert : v)
+        if (cull != Cull::None && culled(cull, facing(corners[0].clip, corners[1].clip, corners[2].clip, s)))
         {
-            // 这里为什么要+1？
-            vert.x() = 0.5 * width * (vert.x() + 1.0);
-            vert.y() = 0.5 * height * (vert.y() + 1.0);
-            // 这里对z的操作是什么意思？
-            vert.z() = vert.z() * f1 + f2;
+            ++last_stats.culled_backface;
+            continue;
         }
 
-        // 将三个顶点的屏幕坐标存入t中
-        for (int i = 0; i < 3; ++i)
+        // 和近平面相交时裁掉相机前 clip_near 以内的部分，得到 4 个顶点时拆成两个三角形
+        clip_vertex polygon[4] = {corners[0], corners[1], corners[2]};
+        int n = 3;
+        if ((c0 | c1 | c2) & outside_near)
         {
-            t.setVertex(i, v[i].head<3>());
-            t.setVertex(i, v[i].head<3>());
-            t.setVertex(i, v[i].head<3>());
+            ++last_stats.clipped_near;
+            n = clip_near_plane(corners, polygon, s, clip_near,
+                                [](const clip_vertex& cv) -> const Eigen::Vector4f& { return cv.clip; },
+                                [](const clip_vertex& a, const clip_vertex& b, float t)
+            {
+                return clip_vertex{a.clip + t * (b.clip - a.clip), a.color + t * (b.color - a.color)};
+            });
         }
 
-        // 三个点的颜色
-        auto col_x = col[i[0]];
-        auto col_y = col[i[1]];
-        auto col_z = col[i[2]];
+        for (int k = 1; k + 1 < n; ++k)
+        {
+            Triangle t;
+            Eigen::Vector4f v[] = {polygon[0].clip, polygon[k].clip, polygon[k + 1].clip};
 
-        // 一个三角形内的颜色是一致的
-        t.setColor(0, col_x[0], col_x[1], col_x[2]);
-        t.setColor(1, col_y[0], col_y[1], col_y[2]);
-        t.setColor(2, col_z[0], col_z[1], col_z[2]);
+            //Homogeneous division
+            // 齐次坐标归1
+            for (auto& vec : v) {
+                vec /= vec.w();
+            }
 
-        rasterize_triangle(t);
-    }
-}
+            //Viewport transformation
+            // 视口变换
+            for (auto & vert : v)
+            {
+                // 这里为什么要+1？
+                vert.x() = 0.5 * width * (vert.x() + 1.0);
+                vert.y() = 0.5 * height * (vert.y() + 1.0);
+                // 这里对z的操作是什么意思？
+                vert.z() = vert.z() * f1 + f2;
+            }
 
-//Screen space rasterization
-void rst::rasterizer::rasterize_triangle(const Triangle& t) {
-    // v中存放三角形3个顶点的齐次坐标
-    auto v = t.toVector4();
+            // 将三个顶点的屏幕坐标存入t中
+            for (int i = 0; i < 3; ++i)
+            {
+                t.setVertex(i, v[i].head<3>());
+            }
+
+            // 三个点的颜色
+            auto col_x = polygon[0].color;
+            auto col_y = polygon[k].color;
+            auto col_z = polygon[k + 1].color;
 
-    int minX = INT32_MAX;
-    int maxX = INT32_MIN;
-    int minY = INT32_MAX;
-    int maxY = INT32_MIN;
+            // 一个三角形内的颜色是一致的
+            t.setColor(0, col_x[0], col_x[1], col_x[2]);
+            t.setColor(1, col_y[0], col_y[1], col_y[2]);
+            t.setColor(2, col_z[0], col_z[1], col_z[2]);
 
-    float alpha = 0.0;
-    float beta = 0.0;
-    float gamma = 0.0;
+            rasterize_triangle(t);
+            ++last_stats.emitted;
+        }
+    }
+}
 
-    // 找到所对应的包围盒
-    for(unsigned i = 0; i < 3; ++i)
+float rst::rasterizer::far_depth(int bx, int by)
+{
+    int block = by * hiz_width + bx;
+    if (hiz_dirty[block])
     {
-        if(maxX < v[i].x())
-            maxX = v[i].x();   // 注意这里是向下取整
-        if(minX > v[i].x())
-            minX = v[i].x();
-        if(maxY < v[i].y())
-            maxY = v[i].y();
-        if(minY > v[i].y())
-            minY = v[i].y();
+        float far = -std::numeric_limits<float>::infinity();
+        int x1 = std::min(bx * hiz_size + hiz_size, width);
+        int y1 = std::min(by * hiz_size + hiz_size, height);
+        for (int y = by * hiz_size; y < y1; ++y)
+        {
+            const float* row = &depth_buf[get_index(0, y)];
+            for (int x = bx * hiz_size; x < x1; ++x)
+                far = std::max(far, row[x]);
+        }
+        hiz_far[block] = far;
+        hiz_dirty[block] = 0;
     }
-    
-    // TODO : Find out the bounding box of current triangle.
-    // iterate through the pixel and find if the current pixel is inside the triangle
+    return hiz_far[block];
+}
 
-    for(int x = minX; x <= maxX; ++x )
+//Screen space rasterization
+void rst::rasterizer::rasterize_triangle(const Triangle& t) {
+    // 三角形设置：建立定点的边函数和包围盒（退化的三角形不覆盖任何像素）
+    edge_setup s;
+    if (!s.setup(t.v))
+        return;
+
+    // 插值得到的深度不会比最近的顶点更近；留一点余量覆盖插值的舍入误差
+    float nearest = std::min({t.v[0].z(), t.v[1].z(), t.v[2].z()});
+    nearest -= (std::fabs(nearest) + 1.0f) * 1e-5f;
+
+    int x0 = std::max(s.x0, 0), x1 = std::min(s.x1, width - 1);
+    int y0 = std::max(s.y0, 0), y1 = std::min(s.y1, height - 1);
+    // 逐块扫描包围盒（裁到屏幕范围内）：块内已经写下的深度全都比三角形最近的点还近时，整块跳过。
+    // 块内逐行扫描，覆盖测试和重心坐标都由边函数递推得到；
+    // 像素中心正好落在两个三角形的公共边上时，只算作其中一个三角形的
+    for (int by = y0 / hiz_size; by <= y1 / hiz_size && x0 <= x1; ++by)
     {
-        for(int y = minY; y <= maxY; ++y)
+        for (int bx = x0 / hiz_size; bx <= x1 / hiz_size; ++bx)
         {
-            // 取像素的中心点
-            if(insideTriangle(float(x + 0.5), float(y + 0.5), t.v))
+            if (nearest >= far_depth(bx, by))
+                continue;
+            int block = by * hiz_width + bx;
+            scan_triangle(s, std::max(x0, bx * hiz_size), std::max(y0, by * hiz_size),
+                          std::min(x1, bx * hiz_size + hiz_size - 1), std::min(y1, by * hiz_size + hiz_size - 1),
+                          [&](int x, int y, float alpha, float beta, float gamma)
             {
-                // 计算出alpha, beta, gamma
-                auto tp = computeBarycentric2D(float(x + 0.5), float(y + 0.5), t.v);
-                std::tie(alpha, beta, gamma) = tp;
-
                 // // 插值计算出深度
                 // float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
 
@@ -174,27 +197,18 @@ void rst::rasterizer::rasterize_triangle(const Triangle& t) {
                 // float z_interpolated = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
                 // z_interpolated *= w_reciprocal;
 
-                float z_interpolated = alpha * v[0].z() + beta * v[1].z() + gamma * v[2].z();
+                float z_interpolated = alpha * t.v[0].z() + beta * t.v[1].z() + gamma * t.v[2].z();
 
                 if(depth_buf[get_index(x, y)] > z_interpolated)
                 {
-                    // 这里是否需要更新深度缓存？？？
                     depth_buf[get_index(x, y)] = z_interpolated;
+                    hiz_dirty[block] = 1;
                     Eigen::Vector3f point(float(x), float(y), z_interpolated);
                     set_pixel(point, t.getColor());
                 }
-
-            }
+            });
         }
     }
-
-    // If so, use the following code to get the interpolated z value.
-    //auto[alpha, beta, gamma] = computeBarycentric2D(x, y, t.v);
-    //float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-    //float z_interpolated = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-    //z_interpolated *= w_reciprocal;
-
-    // TODO : set the current pixel (use the set_pixel function) to the color of the triangle (use getColor function) if it should be painted.
 }
 
 void rst::rasterizer::set_model(const std::vector<Eigen::Matrix4f>& m)
@@ -224,6 +238,8 @@ void rst::rasterizer::clear(rst::Buffers buff)
     if ((buff & rst::Buffers::Depth) == rst::Buffers::Depth)
     {
         std::fill(depth_buf.begin(), depth_buf.end(), std::numeric_limits<float>::infinity());
+        std::fill(hiz_far.begin(), hiz_far.end(), std::numeric_limits<float>::infinity());
+        std::fill(hiz_dirty.begin(), hiz_dirty.end(), 0);
     }
 
 }
@@ -233,6 +249,9 @@ rst::rasterizer::rasterizer(int w, int h) : width(w), height(h)
     // 清空缓存中的数据
     frame_buf.resize(w * h);
     depth_buf.resize(w * h);
+    hiz_width = (w + hiz_size - 1) / hiz_size;
+    hiz_far.resize(hiz_width * ((h + hiz_size - 1) / hiz_size));
+    hiz_dirty.resize(hiz_far.size(), 1);
 }
 
 int rst::rasterizer::get_index(int x, int y)
@@ -7,6 +7,8 @@
 #include <eigen3/Eigen/Eigen>
 #include <algorithm>
 #include "global.hpp"
+#include "Clipping.hpp"
+#include "EdgeFunction.hpp"
 #include "Triangle.hpp"
 using namespace Eigen;
 
@@ -66,6 +68,11 @@ namespace rst
         void set_view(const Eigen::Matrix4f& v);
         void set_projection(const Eigen::Matrix4f& p);
 
+        // 背面剔除，默认不剔除
+        void set_cull(Cull c) { cull = c; }
+        // 近平面到相机的距离（get_projection_matrix 的 zNear），更近的部分被裁掉
+        void set_clip_near(float d) { clip_near = d; }
+
         void set_pixel(const Eigen::Vector3f& point, const Eigen::Vector3f& color);
 
         void clear(Buffers buff);
@@ -73,6 +80,8 @@ namespace rst
         void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type);
 
         std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
+        // 最近一次 draw 中图元装配剔除和裁剪的三角形数
+        const clip_stats& stats() const { return last_stats; }
 
     private:
         void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
@@ -98,8 +107,20 @@ namespace rst
         std::vector<float> depth_buf;
         int get_index(int x, int y);
 
+        // 粗粒度深度：每 hiz_size x hiz_size 像素一块，记录块内最远（最大）的深度。
+        // 写入像素时只把块标记为 dirty，下次查询时再重新求最大值；没更新时的值偏大，剔除仍然正确
+        static constexpr int hiz_size = 8;
+        int hiz_width = 0;
+        std::vector<float> hiz_far;
+        std::vector<uint8_t> hiz_dirty;
+        float far_depth(int bx, int by);
+
         int width, height;
 
+        Cull cull = Cull::None;
+        float clip_near = 0.1f;
+        clip_stats last_stats;
+
         int next_id = 0;
         int get_next_id() { return next_id++; }
     };
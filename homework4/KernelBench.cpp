@@ -0,0 +1,147 @@
+//
+// Microbenchmarks of the per-fragment kernels of the rasterizer: the coverage
+// test, the barycentric coordinates, walking a triangle's bounding box (the
+// per-pixel tests against the fixed-point edge functions) and texture lookups
+// (the base-level getColor and the clamped, mip-mapped getColorLod).
+// The inputs are random but generated from a fixed seed, so every run (and
+// every build being compared) times exactly the same work; see MicroBench.hpp
+// for the timing methodology. The texture is the spot model's, so run it from
+// build/ like the rasterizer itself.
+//
+//     ./KernelBench [--reps N] [--warmup N] [--filter NAME]
+//
+#include <random>
+#include <vector>
+#include "MicroBench.hpp"
+#include "Texture.hpp"
+#include "rasterizer.hpp"
+
+namespace
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+    struct Fragment
+    {
+        Vector4f v[3];
+        float x, y;
+    };
+}
+
+int main(int argc, char **argv)
+{
+    auto options = microbench::parseOptions(argc, argv);
+    const size_t n = 1 << 14;
+
+    // 700x700 屏幕上边长几十个像素的三角形，采样点取在包围盒内（大约一半在三角形内）
+    std::vector<Fragment> fragments;
+    for (size_t i = 0; i < n; ++i)
+    {
+        Fragment f;
+        float cx = unit(rng) * 700, cy = unit(rng) * 700;
+        float minX = cx, maxX = cx, minY = cy, maxY = cy;
+        for (auto &v : f.v)
+        {
+            v = Vector4f(cx + (unit(rng) - 0.5f) * 40, cy + (unit(rng) - 0.5f) * 40, unit(rng), 1);
+            minX = std::min(minX, v.x()), maxX = std::max(maxX, v.x());
+            minY = std::min(minY, v.y()), maxY = std::max(maxY, v.y());
+        }
+        f.x = minX + unit(rng) * (maxX - minX);
+        f.y = minY + unit(rng) * (maxY - minY);
+        fragments.push_back(f);
+    }
+
+    // getColor 的 v 在 (0, 1]：v = 0 时会读到图像下方一行之外
+    std::vector<std::pair<float, float>> texcoords;
+    for (size_t i = 0; i < n; ++i)
+        texcoords.emplace_back(unit(rng), 1 - unit(rng));
+
+    microbench::printHeader(options);
+
+    microbench::run(options, "insideTriangle", n, [&]
+    {
+        int inside = 0;
+        for (const auto &f : fragments)
+            inside += insideTriangle(f.x, f.y, f.v);
+        microbench::doNotOptimize(inside);
+    });
+
+    microbench::run(options, "computeBarycentric2D", n, [&]
+    {
+        float sum = 0;
+        for (const auto &f : fragments)
+        {
+            auto [alpha, beta, gamma] = computeBarycentric2D(f.x, f.y, f.v);
+            sum += alpha + beta + gamma;
+        }
+        microbench::doNotOptimize(sum);
+    });
+
+    // 用前 256 个三角形遍历整个包围盒，按包围盒中的像素数折算到每个像素
+    std::vector<rst::edge_setup> setups(256);
+    size_t boxPixels = 0;
+    for (size_t i = 0; i < setups.size(); ++i)
+    {
+        setups[i].setup(fragments[i].v);
+        boxPixels += size_t(setups[i].x1 - setups[i].x0 + 1) * (setups[i].y1 - setups[i].y0 + 1);
+    }
+
+    microbench::run(options, "bbox walk: insideTriangle + bary", boxPixels, [&]
+    {
+        float sum = 0;
+        for (size_t i = 0; i < setups.size(); ++i)
+            for (int y = setups[i].y0; y <= setups[i].y1; ++y)
+                for (int x = setups[i].x0; x <= setups[i].x1; ++x)
+                    if (insideTriangle(x + 0.5f, y + 0.5f, fragments[i].v))
+                    {
+                        auto [alpha, beta, gamma] = computeBarycentric2D(x + 0.5f, y + 0.5f, fragments[i].v);
+                        sum += alpha + beta + gamma;
+                    }
+        microbench::doNotOptimize(sum);
+    });
+
+    microbench::run(options, "bbox walk: edge functions", boxPixels, [&]
+    {
+        float sum = 0;
+        for (const auto &s : setups)
+            rst::scan_triangle(s, s.x0, s.y0, s.x1, s.y1, [&](int, int, float alpha, float beta, float gamma)
+            {
+                sum += alpha + beta + gamma;
+            });
+        microbench::doNotOptimize(sum);
+    });
+
+    microbench::run(options, "edge_setup::setup", setups.size(), [&]
+    {
+        int ok = 0;
+        rst::edge_setup s;
+        for (size_t i = 0; i < setups.size(); ++i)
+            ok += s.setup(fragments[i].v);
+        microbench::doNotOptimize(ok);
+    });
+
+    Texture texture("../models/spot/spot_texture.png");
+    if (texture.width == 0)
+    {
+        printf("Cannot load ../models/spot/spot_texture.png, skipping Texture::getColor\n");
+        return 0;
+    }
+    microbench::run(options, "Texture::getColor", n, [&]
+    {
+        float sum = 0;
+        for (const auto &[u, v] : texcoords)
+            sum += texture.getColor(u, v).x();
+        microbench::doNotOptimize(sum);
+    });
+
+    // 按 2x2 块着色时的取样：夹到纹理范围内，再从 mip 链中取一级（这里都取第 0 级，和 getColor 比较）
+    microbench::run(options, "Texture::getColorLod", n, [&]
+    {
+        float sum = 0;
+        for (const auto &[u, v] : texcoords)
+            sum += texture.getColorLod(u, v, 0).x();
+        microbench::doNotOptimize(sum);
+    });
+
+    return 0;
+}
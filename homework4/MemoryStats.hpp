@@ -0,0 +1,73 @@
+//
+// Heap accounting per subsystem.
+//
+// MemoryStats.cpp replaces the global operator new/delete: every block gets a
+// small header recording its size and the category that was current on the
+// allocating thread, so frees are attributed correctly even when they happen
+// on another thread. Code marks what it allocates with a mem::Scope:
+//
+//     mem::Scope scope(mem::Geometry);
+//     Triangle *t = new Triangle();   // counts as geometry
+//
+// Memory that does not come from operator new (OpenCV image buffers, which
+// cv::fastMalloc allocates) is registered with mem::External and reported in
+// its own column. mem::report() prints live and peak bytes per category and
+// the peak resident set size of the process.
+//
+
+#ifndef RASTERIZER_MEMORYSTATS_H
+#define RASTERIZER_MEMORYSTATS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mem
+{
+    enum Category
+    {
+        Other,       // 没有标记的分配
+        Geometry,    // 三角形（模型的和每帧变换后的）
+        BVH,         // 光栅化没有 BVH，保留这一项和光线追踪的统计保持一致
+        Textures,
+        Framebuffer, // 颜色、深度和可见性缓冲区
+        Loader,      // 解析 OBJ 时的临时数据
+        CategoryCount
+    };
+
+    // 当前线程新分配的内存记到哪个类别
+    inline thread_local Category current = Other;
+
+    class Scope
+    {
+    public:
+        explicit Scope(Category c) : previous(current) { current = c; }
+        ~Scope() { current = previous; }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        Category previous;
+    };
+
+    // 不经过 operator new 的内存（OpenCV 的图像缓冲区），存在期间计入 category
+    class External
+    {
+    public:
+        External() = default;
+        External(Category c, size_t bytes) { reset(c, bytes); }
+        ~External() { reset(Other, 0); }
+        External(const External &) = delete;
+        External &operator=(const External &) = delete;
+
+        void reset(Category c, size_t bytes);
+
+    private:
+        Category category = Other;
+        size_t size = 0;
+    };
+
+    // 打印各类别当前和峰值占用的内存
+    void report();
+}
+
+#endif //RASTERIZER_MEMORYSTATS_H
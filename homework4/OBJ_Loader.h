@@ -18,6 +18,19 @@
 #include <string>
 #include <fstream>
 #include <math.h>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <thread>
+#include "MemoryStats.hpp"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 // Print progress to console while loading (large models)
 #define OBJL_CONSOLE_OUTPUT
@@ -217,6 +230,34 @@ namespace objl
         Material MeshMaterial;
     };
 
+    // Structure: IndexedMesh
+    //
+    // Description: Indexed form of the whole file filled by
+    //	Loader::LoadFileFast: the attribute arrays are shared and every
+    //	triangle corner stores one index per attribute (NoIndex if absent)
+    struct IndexedMesh
+    {
+        static constexpr unsigned int NoIndex = 0xffffffffu;
+
+        std::vector<Vector3> Positions;
+        std::vector<Vector2> TCoords;
+        std::vector<Vector3> Normals;
+
+        std::vector<unsigned int> PositionIndices;
+        std::vector<unsigned int> TCoordIndices;
+        std::vector<unsigned int> NormalIndices;
+
+        void clear()
+        {
+            Positions.clear();
+            TCoords.clear();
+            Normals.clear();
+            PositionIndices.clear();
+            TCoordIndices.clear();
+            NormalIndices.clear();
+        }
+    };
+
     // Namespace: Math
     //
     // Description: The namespace that holds all of the math
@@ -408,6 +449,280 @@ namespace objl
         }
     }
 
+    // Namespace: Fast
+    //
+    // Description: Helpers of Loader::LoadFileFast. The file is mapped
+    //	into memory, cut into chunks at line boundaries and every chunk
+    //	is tokenised in place on its own thread; nothing is allocated
+    //	per line and numbers are read with std::from_chars.
+    namespace fast
+    {
+        // Read-only view of a whole file (mmap, or a plain read on Windows)
+        class FileView
+        {
+        public:
+            explicit FileView(const std::string &path)
+            {
+#ifdef _WIN32
+                std::ifstream file(path, std::ios::binary);
+                if (!file.is_open())
+                    return;
+                buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                begin = buffer.data();
+                size = buffer.size();
+                ok = true;
+#else
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0)
+                    return;
+                struct stat st;
+                if (fstat(fd, &st) == 0)
+                {
+                    size = st.st_size;
+                    if (size == 0)
+                        ok = true;
+                    else
+                    {
+                        void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                        if (p != MAP_FAILED)
+                        {
+                            madvise(p, size, MADV_SEQUENTIAL);
+                            mapping = p;
+                            begin = static_cast<const char *>(p);
+                            ok = true;
+                        }
+                    }
+                }
+                ::close(fd);
+#endif
+            }
+            ~FileView()
+            {
+#ifndef _WIN32
+                if (mapping)
+                    munmap(mapping, size);
+#endif
+            }
+            FileView(const FileView &) = delete;
+            FileView &operator=(const FileView &) = delete;
+
+            bool ok = false;
+            const char *begin = nullptr;
+            size_t size = 0;
+
+        private:
+#ifdef _WIN32
+            std::vector<char> buffer;
+#else
+            void *mapping = nullptr;
+#endif
+        };
+
+        // One face corner as written in the file: 1-based or negative
+        // (relative) indices, 0 when the attribute is missing
+        struct Corner
+        {
+            int p, t, n;
+            // number of '/' separated fields, same meaning as svert.size()
+            int fields;
+        };
+
+        // Lines that are not plain data, replayed in file order when merging
+        struct Event
+        {
+            enum Type { Face, Group, UseMtl, MtlLib };
+            Type type;
+            // Face: range in Chunk::corners and the attribute counts of the
+            // chunk when the face was read (to resolve negative indices)
+            unsigned int cornerBegin, cornerCount;
+            unsigned int localV, localVt, localVn;
+            // Group/UseMtl/MtlLib: the tail of the line; named is false for
+            // lines that only start with 'g' (objl calls them "unnamed")
+            std::string_view text;
+            bool named;
+        };
+
+        struct Chunk
+        {
+            std::vector<Vector3> positions;
+            std::vector<Vector2> tcoords;
+            std::vector<Vector3> normals;
+            std::vector<Corner> corners;
+            std::vector<Event> events;
+        };
+
+        inline bool isBlank(char c) { return c == ' ' || c == '\t'; }
+        inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+        inline const char *skipSpace(const char *p, const char *end)
+        {
+            while (p < end && isSpace(*p))
+                p++;
+            return p;
+        }
+
+        inline float parseFloat(const char *&p, const char *end)
+        {
+            p = skipSpace(p, end);
+            if (p < end && *p == '+')
+                p++;
+            float value = 0.0f;
+            auto result = std::from_chars(p, end, value);
+            p = result.ptr;
+            return value;
+        }
+
+        inline int parseInt(const char *&p, const char *end)
+        {
+            if (p < end && *p == '+')
+                p++;
+            int value = 0;
+            auto result = std::from_chars(p, end, value);
+            p = result.ptr;
+            return value;
+        }
+
+        // Same as algorithm::tail: skip the first token, trim spaces and tabs
+        inline std::string_view tail(const char *tokenEnd, const char *lineEnd)
+        {
+            const char *b = tokenEnd;
+            while (b < lineEnd && isBlank(*b))
+                b++;
+            const char *e = lineEnd;
+            while (e > b && isBlank(e[-1]))
+                e--;
+            return std::string_view(b, e - b);
+        }
+
+        inline void parseFace(const char *p, const char *end, Chunk &chunk)
+        {
+            Event e{};
+            e.type = Event::Face;
+            e.cornerBegin = (unsigned int)chunk.corners.size();
+            e.localV = (unsigned int)chunk.positions.size();
+            e.localVt = (unsigned int)chunk.tcoords.size();
+            e.localVn = (unsigned int)chunk.normals.size();
+
+            while (true)
+            {
+                p = skipSpace(p, end);
+                if (p >= end)
+                    break;
+                Corner c{0, 0, 0, 1};
+                c.p = parseInt(p, end);
+                if (p < end && *p == '/')
+                {
+                    p++;
+                    c.fields = 2;
+                    if (p < end && *p != '/' && !isSpace(*p))
+                        c.t = parseInt(p, end);
+                    if (p < end && *p == '/')
+                    {
+                        p++;
+                        c.fields = 3;
+                        c.n = parseInt(p, end);
+                    }
+                }
+                chunk.corners.push_back(c);
+                // skip anything we could not read up to the next corner
+                while (p < end && !isSpace(*p))
+                    p++;
+            }
+            e.cornerCount = (unsigned int)chunk.corners.size() - e.cornerBegin;
+            chunk.events.push_back(e);
+        }
+
+        inline void parseChunk(const char *p, const char *end, Chunk &chunk)
+        {
+            while (p < end)
+            {
+                const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', end - p));
+                if (!lineEnd)
+                    lineEnd = end;
+                const char *line = p;
+                p = lineEnd + 1;
+
+                const char *tok = line;
+                while (tok < lineEnd && isBlank(*tok))
+                    tok++;
+                const char *tokEnd = tok;
+                while (tokEnd < lineEnd && !isBlank(*tokEnd))
+                    tokEnd++;
+                std::string_view first(tok, tokEnd - tok);
+
+                if (first == "v")
+                {
+                    Vector3 v;
+                    v.X = parseFloat(tokEnd, lineEnd);
+                    v.Y = parseFloat(tokEnd, lineEnd);
+                    v.Z = parseFloat(tokEnd, lineEnd);
+                    chunk.positions.push_back(v);
+                }
+                else if (first == "vt")
+                {
+                    Vector2 v;
+                    v.X = parseFloat(tokEnd, lineEnd);
+                    v.Y = parseFloat(tokEnd, lineEnd);
+                    chunk.tcoords.push_back(v);
+                }
+                else if (first == "vn")
+                {
+                    Vector3 v;
+                    v.X = parseFloat(tokEnd, lineEnd);
+                    v.Y = parseFloat(tokEnd, lineEnd);
+                    v.Z = parseFloat(tokEnd, lineEnd);
+                    chunk.normals.push_back(v);
+                }
+                else if (first == "f")
+                    parseFace(tokEnd, lineEnd, chunk);
+                else if (first == "o" || first == "g" || (line < lineEnd && line[0] == 'g'))
+                {
+                    Event e{};
+                    e.type = Event::Group;
+                    e.named = first == "o" || first == "g";
+                    e.text = tail(tokEnd, lineEnd);
+                    chunk.events.push_back(e);
+                }
+                else if (first == "usemtl" || first == "mtllib")
+                {
+                    Event e{};
+                    e.type = first == "usemtl" ? Event::UseMtl : Event::MtlLib;
+                    e.text = tail(tokEnd, lineEnd);
+                    chunk.events.push_back(e);
+                }
+            }
+        }
+
+        // Cut [begin, begin + size) into at most n pieces ending on '\n'
+        inline std::vector<std::pair<const char *, const char *>> splitLines(const char *begin, size_t size, size_t n)
+        {
+            std::vector<std::pair<const char *, const char *>> ranges;
+            const char *end = begin + size;
+            const char *p = begin;
+            for (size_t i = 1; i <= n && p < end; i++)
+            {
+                const char *cut = i == n ? end : begin + size * i / n;
+                if (cut < p)
+                    cut = p;
+                const char *nl = cut < end ? static_cast<const char *>(std::memchr(cut, '\n', end - cut)) : nullptr;
+                const char *stop = nl ? nl + 1 : end;
+                ranges.emplace_back(p, stop);
+                p = stop;
+            }
+            return ranges;
+        }
+
+        // Resolve an OBJ index the way algorithm::getElement does
+        inline bool resolve(int raw, unsigned int base, unsigned int local, size_t count, unsigned int &out)
+        {
+            long long idx = raw < 0 ? (long long)base + local + raw : (long long)raw - 1;
+            if (idx < 0 || idx >= (long long)count)
+                return false;
+            out = (unsigned int)idx;
+            return true;
+        }
+    }
+
     // Class: Loader
     //
     // Description: The OBJ Model Loader
@@ -714,6 +1029,229 @@ namespace objl
             }
         }
 
+        // Fast path of LoadFile
+        //
+        // Parses the mapped file on several threads and then replays the
+        //	face / group / material lines in file order, so LoadedMeshes,
+        //	LoadedVertices, LoadedIndices and LoadedMaterials come out the
+        //	same as with LoadFile. LoadedIndexed additionally gets the
+        //	indexed form of the whole file.
+        //
+        // threads = 0 uses every hardware thread
+        bool LoadFileFast(std::string Path, unsigned int threads = 0)
+        {
+            // If the file is not an .obj file return false
+            if (Path.size() < 4 || Path.substr(Path.size() - 4, 4) != ".obj")
+                return false;
+
+            fast::FileView file(Path);
+            if (!file.ok)
+                return false;
+
+            LoadedMeshes.clear();
+            LoadedVertices.clear();
+            LoadedIndices.clear();
+            LoadedIndexed.clear();
+
+            // Small files are not worth a thread each
+            const size_t minChunk = 64 * 1024;
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            size_t pieces = std::max<size_t>(1, std::min<size_t>(threads, file.size / minChunk));
+
+            auto ranges = fast::splitLines(file.begin, file.size, pieces);
+            std::vector<fast::Chunk> chunks(ranges.size());
+            std::vector<std::thread> workers;
+            // The workers' allocations count towards the caller's memory category
+            for (size_t i = 1; i < ranges.size(); i++)
+                workers.emplace_back([&, i, category = mem::current] {
+                    mem::Scope scope(category);
+                    fast::parseChunk(ranges[i].first, ranges[i].second, chunks[i]);
+                });
+            if (!ranges.empty())
+                fast::parseChunk(ranges[0].first, ranges[0].second, chunks[0]);
+            for (auto &w : workers)
+                w.join();
+
+            // Concatenate the attribute arrays
+            IndexedMesh &indexed = LoadedIndexed;
+            std::vector<unsigned int> baseV(chunks.size()), baseVt(chunks.size()), baseVn(chunks.size());
+            size_t nv = 0, nvt = 0, nvn = 0;
+            for (size_t i = 0; i < chunks.size(); i++)
+            {
+                baseV[i] = (unsigned int)nv;
+                baseVt[i] = (unsigned int)nvt;
+                baseVn[i] = (unsigned int)nvn;
+                nv += chunks[i].positions.size();
+                nvt += chunks[i].tcoords.size();
+                nvn += chunks[i].normals.size();
+            }
+            indexed.Positions.reserve(nv);
+            indexed.TCoords.reserve(nvt);
+            indexed.Normals.reserve(nvn);
+            for (auto &c : chunks)
+            {
+                indexed.Positions.insert(indexed.Positions.end(), c.positions.begin(), c.positions.end());
+                indexed.TCoords.insert(indexed.TCoords.end(), c.tcoords.begin(), c.tcoords.end());
+                indexed.Normals.insert(indexed.Normals.end(), c.normals.begin(), c.normals.end());
+            }
+
+            // Replay the structure lines, same state machine as LoadFile
+            std::vector<Vertex> Vertices;
+            std::vector<unsigned int> Indices;
+            std::vector<std::string> MeshMatNames;
+            bool listening = false;
+            std::string meshname;
+
+            // A face with an index out of range fails the whole load; do not
+            // leave the meshes read so far behind
+            auto badIndex = [&]()
+            {
+                LoadedMeshes.clear();
+                LoadedVertices.clear();
+                LoadedIndices.clear();
+                LoadedIndexed.clear();
+                return false;
+            };
+
+            std::vector<Vertex> vVerts;
+            std::vector<unsigned int> vP, vT, vN;
+            std::vector<unsigned int> iIndices;
+
+            for (size_t ci = 0; ci < chunks.size(); ci++)
+            {
+                const fast::Chunk &chunk = chunks[ci];
+                for (const fast::Event &e : chunk.events)
+                {
+                    if (e.type == fast::Event::Face)
+                    {
+                        vVerts.clear();
+                        vP.clear();
+                        vT.clear();
+                        vN.clear();
+                        bool noNormal = false;
+                        for (unsigned int k = 0; k < e.cornerCount; k++)
+                        {
+                            const fast::Corner &c = chunk.corners[e.cornerBegin + k];
+                            Vertex v;
+                            unsigned int p, t = IndexedMesh::NoIndex, n = IndexedMesh::NoIndex;
+                            if (!fast::resolve(c.p, baseV[ci], e.localV, nv, p))
+                                return badIndex();
+                            v.Position = indexed.Positions[p];
+                            if (c.fields == 2 || (c.fields == 3 && c.t != 0))
+                            {
+                                if (!fast::resolve(c.t, baseVt[ci], e.localVt, nvt, t))
+                                    return badIndex();
+                                v.TextureCoordinate = indexed.TCoords[t];
+                            }
+                            if (c.fields == 3)
+                            {
+                                if (!fast::resolve(c.n, baseVn[ci], e.localVn, nvn, n))
+                                    return badIndex();
+                                v.Normal = indexed.Normals[n];
+                            }
+                            else
+                                noNormal = true;
+                            vVerts.push_back(v);
+                            vP.push_back(p);
+                            vT.push_back(t);
+                            vN.push_back(n);
+                        }
+
+                        if (noNormal && vVerts.size() >= 3)
+                        {
+                            Vector3 A = vVerts[0].Position - vVerts[1].Position;
+                            Vector3 B = vVerts[2].Position - vVerts[1].Position;
+                            Vector3 normal = math::CrossV3(A, B);
+                            for (auto &v : vVerts)
+                                v.Normal = normal;
+                        }
+
+                        Vertices.insert(Vertices.end(), vVerts.begin(), vVerts.end());
+                        LoadedVertices.insert(LoadedVertices.end(), vVerts.begin(), vVerts.end());
+
+                        iIndices.clear();
+                        VertexTriangluation(iIndices, vVerts);
+                        for (unsigned int i : iIndices)
+                        {
+                            Indices.push_back((unsigned int)(Vertices.size() - vVerts.size()) + i);
+                            LoadedIndices.push_back((unsigned int)(LoadedVertices.size() - vVerts.size()) + i);
+                            indexed.PositionIndices.push_back(vP[i]);
+                            indexed.TCoordIndices.push_back(vT[i]);
+                            indexed.NormalIndices.push_back(vN[i]);
+                        }
+                    }
+                    else if (e.type == fast::Event::Group)
+                    {
+                        std::string tailName(e.text);
+                        if (!listening)
+                        {
+                            listening = true;
+                            meshname = e.named ? tailName : "unnamed";
+                        }
+                        else if (!Indices.empty() && !Vertices.empty())
+                        {
+                            Mesh tempMesh(Vertices, Indices);
+                            tempMesh.MeshName = meshname;
+                            LoadedMeshes.push_back(tempMesh);
+
+                            Vertices.clear();
+                            Indices.clear();
+                            meshname = tailName;
+                        }
+                        else
+                            meshname = e.named ? tailName : "unnamed";
+                    }
+                    else if (e.type == fast::Event::UseMtl)
+                    {
+                        MeshMatNames.emplace_back(e.text);
+
+                        // Create new Mesh, if Material changes within a group
+                        if (!Indices.empty() && !Vertices.empty())
+                        {
+                            Mesh tempMesh(Vertices, Indices);
+                            tempMesh.MeshName = meshname + "_2";
+                            LoadedMeshes.push_back(tempMesh);
+
+                            Vertices.clear();
+                            Indices.clear();
+                        }
+                    }
+                    else if (e.type == fast::Event::MtlLib)
+                    {
+                        // The material file lives next to the .obj
+                        size_t slash = Path.find_last_of('/');
+                        std::string pathtomat = slash == std::string::npos ? "" : Path.substr(0, slash + 1);
+                        pathtomat += std::string(e.text);
+                        LoadMaterials(pathtomat);
+                    }
+                }
+            }
+
+            // Deal with last mesh
+            if (!Indices.empty() && !Vertices.empty())
+            {
+                Mesh tempMesh(Vertices, Indices);
+                tempMesh.MeshName = meshname;
+                LoadedMeshes.push_back(tempMesh);
+            }
+
+            // Set Materials for each Mesh
+            for (size_t i = 0; i < MeshMatNames.size() && i < LoadedMeshes.size(); i++)
+            {
+                for (size_t j = 0; j < LoadedMaterials.size(); j++)
+                {
+                    if (LoadedMaterials[j].name == MeshMatNames[i])
+                    {
+                        LoadedMeshes[i].MeshMaterial = LoadedMaterials[j];
+                        break;
+                    }
+                }
+            }
+
+            return !(LoadedMeshes.empty() && LoadedVertices.empty() && LoadedIndices.empty());
+        }
+
         // Loaded Mesh Objects
         std::vector<Mesh> LoadedMeshes;
         // Loaded Vertex Objects
@@ -722,6 +1260,8 @@ namespace objl
         std::vector<unsigned int> LoadedIndices;
         // Loaded Material Objects
         std::vector<Material> LoadedMaterials;
+        // Indexed form of the file (LoadFileFast only)
+        IndexedMesh LoadedIndexed;
 
     private:
         // Generate vertices from a list of positions,
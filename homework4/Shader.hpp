@@ -4,6 +4,7 @@
 
 #ifndef RASTERIZER_SHADER_H
 #define RASTERIZER_SHADER_H
+#include <array>
 #include <eigen3/Eigen/Eigen>
 #include "Texture.hpp"
 
@@ -32,4 +33,50 @@ struct vertex_shader_payload
     Eigen::Vector3f position;
 };
 
+// 片元着色器用到的插值属性。编译期确定的着色器用 varyings 声明自己读取哪些属性，
+// rasterizer 只插值这些属性，其余的在 payload 中为 0
+enum varying : unsigned
+{
+    varying_color = 1,
+    varying_normal = 2,
+    varying_tex_coords = 4,
+    varying_view_pos = 8,
+    varying_all = 15
+};
+
+// 把普通的着色函数包装成编译期的着色器：函数指针是模板参数，调用可以内联
+template <unsigned Varyings, Eigen::Vector3f (*Shade)(const fragment_shader_payload &)>
+struct static_fragment_shader
+{
+    static constexpr unsigned varyings = Varyings;
+
+    Eigen::Vector3f operator()(const fragment_shader_payload &payload) const { return Shade(payload); }
+};
+
+// 按 2x2 像素块（quad）着色时的输入。lane 依次是 (x, y)、(x + 1, y)、(x, y + 1)、(x + 1, y + 1)
+// （y 向上），四个 lane 都是同一个三角形插值出的属性。mask 中的 lane 是这个三角形的可见像素，
+// 其余的是 helper lane：属性由三角形所在的平面外推得到，只用来求导数，结果不会写进帧缓冲
+struct quad_fragment_payload
+{
+    fragment_shader_payload lane[4];
+    unsigned mask;
+};
+
+// 块内的屏幕空间导数（和 GPU 的 ddx_fine/ddy_fine 一样取 lane 所在的行/列）：
+// ddx 是右边的像素减左边的，ddy 是上边的减下边的
+template <typename T>
+T ddx(const T (&v)[4], int lane) { return lane & 2 ? T(v[3] - v[2]) : T(v[1] - v[0]); }
+template <typename T>
+T ddy(const T (&v)[4], int lane) { return lane & 1 ? T(v[3] - v[1]) : T(v[2] - v[0]); }
+
+// 按块着色的编译期着色器：Shade 一次算出四个 lane 的颜色（helper lane 的结果被丢弃）。
+// rasterizer::draw 根据 operator() 的参数类型选择逐像素或按块着色
+template <unsigned Varyings, std::array<Eigen::Vector3f, 4> (*Shade)(const quad_fragment_payload &)>
+struct static_quad_shader
+{
+    static constexpr unsigned varyings = Varyings;
+
+    std::array<Eigen::Vector3f, 4> operator()(const quad_fragment_payload &quad) const { return Shade(quad); }
+};
+
 #endif //RASTERIZER_SHADER_H
@@ -5,11 +5,46 @@
 #ifndef RASTERIZER_TEXTURE_H
 #define RASTERIZER_TEXTURE_H
 #include "global.hpp"
+#include "MemoryStats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
 #include <eigen3/Eigen/Eigen>
 #include <opencv2/opencv.hpp>
 class Texture{
 private:
     cv::Mat image_data;
+    // mip 链：mips[0] 就是 image_data，之后每一级的长宽减半，每个纹素是上一级 2x2 纹素的平均
+    std::vector<cv::Mat> mips;
+    // 图像数据由 OpenCV 分配，不经过 operator new；和 cv::Mat 一样在所有拷贝之间共享
+    std::shared_ptr<mem::External> accounted;
+    std::shared_ptr<mem::External> accountedMips;
+
+    void buildMips()
+    {
+        size_t bytes = 0;
+        mips.push_back(image_data);
+        while (mips.back().cols > 1 || mips.back().rows > 1)
+        {
+            cv::Mat &src = mips.back();
+            cv::Mat dst(std::max(src.rows / 2, 1), std::max(src.cols / 2, 1), CV_8UC3);
+            for (int y = 0; y < dst.rows; ++y)
+                for (int x = 0; x < dst.cols; ++x)
+                {
+                    // 奇数长宽时最后一行（列）和前一行（列）一起平均到边上的纹素中
+                    int y0 = std::min(2 * y, src.rows - 1), y1 = std::min(2 * y + 1, src.rows - 1);
+                    int x0 = std::min(2 * x, src.cols - 1), x1 = std::min(2 * x + 1, src.cols - 1);
+                    cv::Vec3b &out = dst.at<cv::Vec3b>(y, x);
+                    for (int c = 0; c < 3; ++c)
+                        out[c] = (src.at<cv::Vec3b>(y0, x0)[c] + src.at<cv::Vec3b>(y0, x1)[c] +
+                                  src.at<cv::Vec3b>(y1, x0)[c] + src.at<cv::Vec3b>(y1, x1)[c] + 2) / 4;
+                }
+            bytes += dst.total() * dst.elemSize();
+            mips.push_back(dst);
+        }
+        accountedMips = std::make_shared<mem::External>(mem::Textures, bytes);
+    }
 
 public:
     Texture(const std::string& name)
@@ -18,6 +53,9 @@ public:
         cv::cvtColor(image_data, image_data, cv::COLOR_RGB2BGR);
         width = image_data.cols;
         height = image_data.rows;
+        accounted = std::make_shared<mem::External>(mem::Textures, image_data.total() * image_data.elemSize());
+        if (width > 0 && height > 0)
+            buildMips();
     }
 
     int width, height;
@@ -37,5 +75,25 @@ public:
         return Eigen::Vector3f(color[0], color[1], color[2]);
     }
 
+    // 纹理坐标在屏幕上的导数（每个像素变化多少）对应的 mip 级别：log2（一个像素覆盖的纹素数）
+    float mipLevel(const Eigen::Vector2f &duvdx, const Eigen::Vector2f &duvdy) const
+    {
+        Eigen::Vector2f size(width, height);
+        float texels2 = std::max(duvdx.cwiseProduct(size).squaredNorm(), duvdy.cwiseProduct(size).squaredNorm());
+        return texels2 > 1 ? 0.5f * std::log2(texels2) : 0;
+    }
+
+    // 在最接近 level 的一级中取最近的纹素。和 getColor 不同，坐标超出 [0, 1] 时夹到边上
+    // （2x2 块中不在三角形内的像素插值出的纹理坐标可能在纹理之外）
+    Eigen::Vector3f getColorLod(float u, float v, float level)
+    {
+        int i = std::min(int(std::max(level, 0.0f) + 0.5f), int(mips.size()) - 1);
+        cv::Mat &mip = mips[i];
+        int x = std::clamp(int(u * mip.cols), 0, mip.cols - 1);
+        int y = std::clamp(int((1 - v) * mip.rows), 0, mip.rows - 1);
+        auto color = mip.at<cv::Vec3b>(y, x);
+        return Eigen::Vector3f(color[0], color[1], color[2]);
+    }
+
 };
 #endif //RASTERIZER_TEXTURE_H
@@ -0,0 +1,77 @@
+//
+// Lightweight phase tracing in the Chrome trace-event format.
+//
+// TRACE_ZONE("name") records the lifetime of the enclosing scope as one
+// complete ("X") event. Events go into a ring buffer owned by the calling
+// thread, so recording takes no lock; the buffer grows up to a fixed capacity,
+// after which its oldest events are overwritten. When a thread exits its
+// buffer is handed to the next thread that starts recording, so programs that
+// start threads per frame reuse a bounded set of buffers. trace::stop() writes
+// every thread's events as JSON that chrome://tracing or https://ui.perfetto.dev
+// can open, one track per thread. Until trace::start() is called a zone costs
+// one branch.
+//
+
+#ifndef RASTERIZER_TRACE_H
+#define RASTERIZER_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace trace
+{
+    // 由 start() 打开、stop() 关闭；工作线程只做 relaxed 读取
+    inline std::atomic<bool> active{false};
+
+    // 开始记录，stop() 时写出到 filename；调用 start 的线程命名为 Main
+    void start(const std::string &filename);
+    // 写出所有线程记录的事件并停止记录
+    bool stop();
+    // 当前线程在跟踪中显示的名字
+    void setThreadName(const std::string &name);
+
+    uint64_t now();
+    void record(const char *name, uint64_t begin, uint64_t end, const char *detail);
+
+    class Zone
+    {
+    public:
+        explicit Zone(const char *name) : name(name)
+        {
+            if (active.load(std::memory_order_relaxed))
+                begin = now();
+        }
+        // detail 显示在事件的参数里，例如模型文件名
+        Zone(const char *name, const std::string &detail) : Zone(name)
+        {
+            if (begin)
+                detail.copy(this->detail, sizeof(this->detail) - 1);
+        }
+        Zone(const char *name, long long value) : Zone(name)
+        {
+            if (begin)
+                snprintf(detail, sizeof(detail), "%lld", value);
+        }
+        ~Zone()
+        {
+            if (begin)
+                record(name, begin, now(), detail);
+        }
+        Zone(const Zone &) = delete;
+        Zone &operator=(const Zone &) = delete;
+
+    private:
+        const char *name;
+        uint64_t begin = 0;
+        char detail[48] = {};
+    };
+}
+
+#define TRACE_ZONE_CONCAT_(a, b) a##b
+#define TRACE_ZONE_CONCAT(a, b) TRACE_ZONE_CONCAT_(a, b)
+// name 必须是字符串常量（记录的是指针）
+#define TRACE_ZONE(...) trace::Zone TRACE_ZONE_CONCAT(traceZone_, __LINE__)(__VA_ARGS__)
+
+#endif //RASTERIZER_TRACE_H
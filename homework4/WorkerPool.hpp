@@ -0,0 +1,114 @@
+//
+// Persistent fork-join pool for the phases of rasterizer::draw. The worker
+// threads are started once and sleep between phases; run() hands every worker
+// the same function, runs work(0) on the calling thread and returns when all
+// of work(0) ... work(size() - 1) have finished, so a draw no longer starts
+// and joins threads for each of its phases.
+//
+
+#ifndef RASTERIZER_WORKERPOOL_H
+#define RASTERIZER_WORKERPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PerfCounters.hpp"
+#include "Trace.hpp"
+
+class WorkerPool
+{
+public:
+    // 一共 threads 个线程参与 run（包括调用 run 的线程）
+    explicit WorkerPool(int threads)
+    {
+        for (int i = 1; i < threads; ++i)
+            workers.emplace_back([this, i] { loop(i); });
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &w : workers)
+            w.join();
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    int size() const { return int(workers.size()) + 1; }
+
+    // 当前线程执行 work(0)，工作线程执行 work(1) ... work(size() - 1)，全部完成后返回
+    void run(const std::function<void(int)> &work)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &work;
+            pending = int(workers.size());
+            ++generation;
+        }
+        wake.notify_all();
+        // work(0) 抛出异常时也要等工作线程做完再离开：它们还在用 work 和它引用的局部变量
+        try
+        {
+            work(0);
+        }
+        catch (...)
+        {
+            wait();
+            throw;
+        }
+        wait();
+    }
+
+private:
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+        job = nullptr;
+    }
+
+    void loop(int i)
+    {
+        trace::setThreadName("Worker " + std::to_string(i));
+        perf::attachThread();
+        uint64_t seen = 0;
+        while (true)
+        {
+            const std::function<void(int)> *work;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    break;
+                seen = generation;
+                work = job;
+            }
+            (*work)(i);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0)
+                    done.notify_one();
+            }
+        }
+        perf::detachThread();
+    }
+
+    std::vector<std::thread> workers;
+    const std::function<void(int)> *job = nullptr;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    uint64_t generation = 0;
+    int pending = 0;
+    bool stopping = false;
+};
+
+#endif //RASTERIZER_WORKERPOOL_H
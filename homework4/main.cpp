@@ -1,4 +1,9 @@
+#include <array>
+#include <chrono>
 #include <iostream>
+#include <limits>
+#include <thread>
+#include <unordered_map>
 #include <opencv2/opencv.hpp>
 
 #include "global.hpp"
@@ -7,6 +12,10 @@
 #include "Shader.hpp"
 #include "Texture.hpp"
 #include "OBJ_Loader.h"
+#include "BenchReport.hpp"
+#include "MemoryStats.hpp"
+#include "PerfCounters.hpp"
+#include "Trace.hpp"
 
 Eigen::Matrix4f get_view_matrix(Eigen::Vector3f eye_pos)
 {
@@ -117,14 +126,9 @@ struct light
     Eigen::Vector3f intensity;
 };
 
-Eigen::Vector3f texture_fragment_shader(const fragment_shader_payload &payload)
+// 取到纹理颜色之后的光照，逐像素和按 2x2 块的 texture shader 共用
+static Eigen::Vector3f texture_lighting(const fragment_shader_payload &payload, const Eigen::Vector3f &return_color)
 {
-    Eigen::Vector3f return_color = {0, 0, 0};
-    if (payload.texture)
-    {
-        // TODO: Get the texture value at the texture coordinates of the current fragment
-        return_color = payload.texture->getColor(payload.tex_coords.x(), payload.tex_coords.y());
-    }
     Eigen::Vector3f texture_color;
     texture_color << return_color.x(), return_color.y(), return_color.z();
 
@@ -192,6 +196,17 @@ Eigen::Vector3f texture_fragment_shader(const fragment_shader_payload &payload)
     return result_color * 255.f;
 }
 
+Eigen::Vector3f texture_fragment_shader(const fragment_shader_payload &payload)
+{
+    Eigen::Vector3f return_color = {0, 0, 0};
+    if (payload.texture)
+    {
+        // TODO: Get the texture value at the texture coordinates of the current fragment
+        return_color = payload.texture->getColor(payload.tex_coords.x(), payload.tex_coords.y());
+    }
+    return texture_lighting(payload, return_color);
+}
+
 Eigen::Vector3f phong_fragment_shader(const fragment_shader_payload &payload)
 {
     // 全局光照
@@ -259,7 +274,9 @@ Eigen::Vector3f phong_fragment_shader(const fragment_shader_payload &payload)
     return result_color * 255.f;
 }
 
-Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload &payload)
+// 高度图在纹理坐标方向上的变化 dU、dV 和这个像素的高度 height 已知时的 displacement 着色，
+// 逐像素和按 2x2 块的 displacement shader 共用
+static Eigen::Vector3f displacement_lighting(const fragment_shader_payload &payload, float dU, float dV, float height)
 {
 
     Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
@@ -281,7 +298,7 @@ Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload &payl
     Eigen::Vector3f point = payload.view_pos;
     Eigen::Vector3f normal = payload.normal;
 
-    float kh = 0.2, kn = 0.1;
+    float kn = 0.1;
 
     Eigen::Vector3f t;
     t << normal.x() * normal.y() / sqrt(normal.x() * normal.x() + normal.z() * normal.z()),
@@ -295,16 +312,8 @@ Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload &payl
         t.y(), b.y(), normal.y(),
         t.z(), b.z(), normal.z();
 
-    float u = payload.tex_coords.x();
-    float v = payload.tex_coords.y();
-    float h = payload.texture->height;
-    float w = payload.texture->width;
-
-    float dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - payload.texture->getColor(u, v).norm());
-    float dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - payload.texture->getColor(u, v).norm());
-
     // 改变点的位置
-    point = point + kn * normal * payload.texture->getColor(u, v).norm();
+    point = point + kn * normal * height;
     
     Eigen::Vector3f ln = { -dU, -dV, 1.0f};
 
@@ -357,7 +366,23 @@ Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload &payl
     return result_color * 255.f;
 }
 
-Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload &payload)
+Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload &payload)
+{
+    float kh = 0.2, kn = 0.1;
+
+    float u = payload.tex_coords.x();
+    float v = payload.tex_coords.y();
+    float h = payload.texture->height;
+    float w = payload.texture->width;
+
+    float dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - payload.texture->getColor(u, v).norm());
+    float dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - payload.texture->getColor(u, v).norm());
+
+    return displacement_lighting(payload, dU, dV, payload.texture->getColor(u, v).norm());
+}
+
+// 高度图在纹理坐标方向上的变化 dU、dV 已知时扰动后的法向量，逐像素和按 2x2 块的 bump shader 共用
+static Eigen::Vector3f bump_normal(const fragment_shader_payload &payload, float dU, float dV)
 {
 
     Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
@@ -378,9 +403,6 @@ Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload &payload)
     // 每个像素点的法向量
     Eigen::Vector3f normal = payload.normal;
 
-    // 这两个量是什么意思？
-    float kh = 0.2, kn = 0.1;
-
     // TODO: Implement bump mapping here
     // Let n = normal = (x, y, z)
     Eigen::Vector3f t;
@@ -396,16 +418,6 @@ Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload &payload)
         t.y(), b.y(), normal.y(),
         t.z(), b.z(), normal.z();
 
-    // 这里为什么要这样做
-    float u = payload.tex_coords.x();
-    float v = payload.tex_coords.y();
-    float h = payload.texture->height;
-    float w = payload.texture->width;
-
-    // 颜色变化的梯度（为什么要除以w）
-    float dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - payload.texture->getColor(u, v).norm());
-    float dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - payload.texture->getColor(u, v).norm());
-
     Eigen::Vector3f ln = { -dU, -dV, 1.0f};
     // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
     // Vector b = n cross product t
@@ -424,39 +436,322 @@ Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload &payload)
     return result_color * 255.f;
 }
 
+Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload &payload)
+{
+    // 这两个量是什么意思？
+    float kh = 0.2, kn = 0.1;
+
+    // 这里为什么要这样做
+    float u = payload.tex_coords.x();
+    float v = payload.tex_coords.y();
+    float h = payload.texture->height;
+    float w = payload.texture->width;
+
+    // 颜色变化的梯度（为什么要除以w）
+    float dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - payload.texture->getColor(u, v).norm());
+    float dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - payload.texture->getColor(u, v).norm());
+
+    return bump_normal(payload, dU, dV);
+}
+
+// 按 2x2 块着色的版本：纹理坐标的屏幕空间导数决定 mip 级别，每个 lane 只取一次纹理
+
+// 和 GPU 一样整个块用同一个 mip 级别（由 lane 0 所在的行、列的导数决定）；没有纹理时返回 0
+static float quad_mip_level(const quad_fragment_payload &quad)
+{
+    if (!quad.lane[0].texture)
+        return 0;
+    Eigen::Vector2f uv[4];
+    for (int k = 0; k < 4; ++k)
+        uv[k] = quad.lane[k].tex_coords;
+    return quad.lane[0].texture->mipLevel(ddx(uv, 0), ddy(uv, 0));
+}
+
+// 每个 lane 的高度（纹理颜色的模）只取一次，高度对纹理坐标的梯度由块内的导数解出：
+// [ddx(h), ddy(h)] = [[ddx(u), ddx(v)], [ddy(u), ddy(v)]] * [dh/du, dh/dv]。
+// 梯度乘上一个纹素的大小（1/w、1/h）就对应逐像素版本中相邻两个纹素的高度差
+static void quad_height_gradients(const quad_fragment_payload &quad, float (&height)[4], Eigen::Vector2f (&gradient)[4])
+{
+    float level = quad_mip_level(quad);
+    Eigen::Vector2f uv[4];
+    for (int k = 0; k < 4; ++k)
+    {
+        uv[k] = quad.lane[k].tex_coords;
+        height[k] = quad.lane[k].texture->getColorLod(uv[k].x(), uv[k].y(), level).norm();
+    }
+    for (int k = 0; k < 4; ++k)
+    {
+        Eigen::Vector2f uvx = ddx(uv, k), uvy = ddy(uv, k);
+        float hx = ddx(height, k), hy = ddy(height, k);
+        float det = uvx.x() * uvy.y() - uvx.y() * uvy.x();
+        // 纹理坐标在块内不变（或者退化成一条线）时求不出梯度，当作平的
+        if (std::abs(det) > 1e-12f)
+            gradient[k] = Eigen::Vector2f(hx * uvy.y() - uvx.y() * hy, uvx.x() * hy - uvy.x() * hx) / det;
+        else
+            gradient[k] = Eigen::Vector2f::Zero();
+    }
+}
+
+std::array<Eigen::Vector3f, 4> texture_quad_fragment_shader(const quad_fragment_payload &quad)
+{
+    std::array<Eigen::Vector3f, 4> result;
+    result.fill(Eigen::Vector3f::Zero());
+    float level = quad_mip_level(quad);
+    for (int k = 0; k < 4; ++k)
+    {
+        if (!(quad.mask & (1u << k)))
+            continue;
+        const fragment_shader_payload &payload = quad.lane[k];
+        // 和 texture_fragment_shader 一样，没有纹理时纹理颜色当作黑色
+        Eigen::Vector3f color = Eigen::Vector3f::Zero();
+        if (payload.texture)
+            color = payload.texture->getColorLod(payload.tex_coords.x(), payload.tex_coords.y(), level);
+        result[k] = texture_lighting(payload, color);
+    }
+    return result;
+}
+
+std::array<Eigen::Vector3f, 4> bump_quad_fragment_shader(const quad_fragment_payload &quad)
+{
+    float kh = 0.2, kn = 0.1;
+    float height[4];
+    Eigen::Vector2f gradient[4];
+    quad_height_gradients(quad, height, gradient);
+
+    std::array<Eigen::Vector3f, 4> result;
+    result.fill(Eigen::Vector3f::Zero());
+    for (int k = 0; k < 4; ++k)
+    {
+        if (!(quad.mask & (1u << k)))
+            continue;
+        const fragment_shader_payload &payload = quad.lane[k];
+        float dU = kh * kn * gradient[k].x() / payload.texture->width;
+        float dV = kh * kn * gradient[k].y() / payload.texture->height;
+        result[k] = bump_normal(payload, dU, dV);
+    }
+    return result;
+}
+
+std::array<Eigen::Vector3f, 4> displacement_quad_fragment_shader(const quad_fragment_payload &quad)
+{
+    float kh = 0.2, kn = 0.1;
+    float height[4];
+    Eigen::Vector2f gradient[4];
+    quad_height_gradients(quad, height, gradient);
+
+    std::array<Eigen::Vector3f, 4> result;
+    result.fill(Eigen::Vector3f::Zero());
+    for (int k = 0; k < 4; ++k)
+    {
+        if (!(quad.mask & (1u << k)))
+            continue;
+        const fragment_shader_payload &payload = quad.lane[k];
+        float dU = kh * kn * gradient[k].x() / payload.texture->width;
+        float dV = kh * kn * gradient[k].y() / payload.texture->height;
+        result[k] = displacement_lighting(payload, dU, dV, height[k]);
+    }
+    return result;
+}
+
+// 命令行模式用的编译期着色器，声明了各自读取的插值属性
+using normal_shader = static_fragment_shader<varying_normal, normal_fragment_shader>;
+using texture_shader = static_fragment_shader<varying_normal | varying_tex_coords | varying_view_pos, texture_fragment_shader>;
+using phong_shader = static_fragment_shader<varying_color | varying_normal | varying_view_pos, phong_fragment_shader>;
+using bump_shader = static_fragment_shader<varying_normal | varying_tex_coords, bump_fragment_shader>;
+using displacement_shader = static_fragment_shader<varying_all, displacement_fragment_shader>;
+// 按 2x2 块着色的版本。texture 和 displacement 默认用它们；bump 本身很便宜，按块着色时插值 helper lane
+// 的开销超过了省下的纹理采样，默认仍然逐像素，--quad 时才用 bump_quad_shader
+using texture_quad_shader = static_quad_shader<varying_normal | varying_tex_coords | varying_view_pos, texture_quad_fragment_shader>;
+using bump_quad_shader = static_quad_shader<varying_normal | varying_tex_coords, bump_quad_fragment_shader>;
+using displacement_quad_shader = static_quad_shader<varying_all, displacement_quad_fragment_shader>;
+
 int main(int argc, const char **argv)
 {
+    // --trace FILE 可以放在任意位置：把各个阶段的时间线写成 Chrome trace-event JSON；
+    // --perf 用硬件计数器统计各阶段的 IPC 和每个片元的缓存缺失；
+    // --bench FILE 把耗时、吞吐量、内存和输出图像的 hash 写成 JSON（只用于命令行模式），
+    // --baseline FILE 和之前保存的结果比较，变差超过 --threshold 百分比时返回非 0；
+    // --threads N 设置光栅化和着色的线程数（默认使用全部硬件线程）；
+    // --triangle-list 改用逐三角形的 draw（每个三角形自带三个顶点），和带索引的 draw 比较；
+    // --cull back|front|none 设置背面剔除（默认不剔除，输出和不做剔除时完全相同）；
+    // --dynamic-shader 在命令行模式下也通过 std::function 调用着色器（交互模式总是这样），和编译期的着色器比较；
+    // --pixel-shader 让 texture/displacement 也逐像素着色（用相邻纹素求高度差，不用 mip），和按 2x2 块着色比较；
+    // --quad 让 bump 也按 2x2 块着色（默认逐像素，更快）。
+    // 先把它们从参数中去掉，其余参数的含义不变
+    std::vector<const char *> args;
+    std::string benchFile, baselineFile;
+    double threshold = 5;
+    int threads = 0;
+    bool triangleList = false;
+    rst::Cull cull = rst::Cull::None;
+    bool dynamicShader = false;
+    bool pixelShader = false;
+    bool quadBump = false;
+    for (int i = 0; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--trace" && i + 1 < argc)
+            trace::start(argv[++i]);
+        else if (std::string(argv[i]) == "--perf")
+            perf::start();
+        else if (std::string(argv[i]) == "--bench" && i + 1 < argc)
+            benchFile = argv[++i];
+        else if (std::string(argv[i]) == "--baseline" && i + 1 < argc)
+            baselineFile = argv[++i];
+        else if (std::string(argv[i]) == "--threshold" && i + 1 < argc)
+            threshold = std::atof(argv[++i]);
+        else if (std::string(argv[i]) == "--threads" && i + 1 < argc)
+            threads = std::max(0, std::atoi(argv[++i]));
+        else if (std::string(argv[i]) == "--triangle-list")
+            triangleList = true;
+        else if (std::string(argv[i]) == "--dynamic-shader")
+            dynamicShader = true;
+        else if (std::string(argv[i]) == "--pixel-shader")
+            pixelShader = true;
+        else if (std::string(argv[i]) == "--quad")
+            quadBump = true;
+        else if (std::string(argv[i]) == "--cull" && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            cull = mode == "none" ? rst::Cull::None : mode == "front" ? rst::Cull::Front : rst::Cull::Back;
+        }
+        else
+            args.push_back(argv[i]);
+    }
+    argc = int(args.size());
+    argv = args.data();
+
     std::vector<Triangle *> TriangleList;
 
     float angle = 140.0;
     bool command_line = false;
 
     std::string filename = "output.png";
-    objl::Loader Loader;
+    // 解析结果只在建三角形时用到，建好之后就释放
+    auto Loader = std::make_unique<objl::Loader>();
     std::string obj_path = "../models/spot/";
 
     // Load .obj File
     // 加载模型文件
-    bool loadout = Loader.LoadFile("../models/spot/spot_triangulated_good.obj");
-    for (auto mesh : Loader.LoadedMeshes)
+    auto setupStart = std::chrono::steady_clock::now();
+    bool loadout;
+    {
+        TRACE_ZONE("OBJ load");
+        mem::Scope scope(mem::Loader);
+        loadout = Loader->LoadFileFast("../models/spot/spot_triangulated_good.obj");
+    }
+    // 带索引的 draw 用的顶点缓冲区：OBJ 中每个不同的（位置, 纹理坐标, 法向量）组合是一个顶点。
+    // 没有法向量的角和 LoadFile 一样用所在面的法向量，所以每个三角形单独一个顶点，不和其他三角形共用
+    std::vector<Eigen::Vector3f> positions, normals, colors;
+    std::vector<Eigen::Vector2f> texcoords;
+    std::vector<Eigen::Vector3i> indices;
+    if (!triangleList)
+    {
+        mem::Scope scope(mem::Geometry);
+        const objl::IndexedMesh &mesh = Loader->LoadedIndexed;
+        const unsigned int none = objl::IndexedMesh::NoIndex;
+        auto key_hash = [](const std::array<unsigned int, 3> &k)
+        {
+            return std::hash<uint64_t>()((uint64_t(k[0]) * 0x9e3779b1u + k[1]) * 0x9e3779b1u + k[2]);
+        };
+        std::unordered_map<std::array<unsigned int, 3>, int, decltype(key_hash)> vertex_of(
+            mesh.PositionIndices.size(), key_hash);
+        indices.reserve(mesh.PositionIndices.size() / 3);
+        for (size_t i = 0; i + 2 < mesh.PositionIndices.size(); i += 3)
+        {
+            Eigen::Vector3f corner[3];
+            for (int j = 0; j < 3; ++j)
+            {
+                const auto &p = mesh.Positions[mesh.PositionIndices[i + j]];
+                corner[j] = Eigen::Vector3f(p.X, p.Y, p.Z);
+            }
+            // 和 LoadFile 相同的面法向量：(p0 - p1) x (p2 - p1)
+            Eigen::Vector3f face_normal = (corner[0] - corner[1]).cross(corner[2] - corner[1]);
+
+            Eigen::Vector3i triangle;
+            for (int j = 0; j < 3; ++j)
+            {
+                std::array<unsigned int, 3> key = {mesh.PositionIndices[i + j], mesh.TCoordIndices[i + j],
+                                                   mesh.NormalIndices[i + j]};
+                if (key[2] != none)
+                {
+                    auto [it, inserted] = vertex_of.emplace(key, int(positions.size()));
+                    triangle[j] = it->second;
+                    if (!inserted)
+                        continue;
+                }
+                else
+                    triangle[j] = int(positions.size());
+
+                positions.push_back(corner[j]);
+                Eigen::Vector2f uv(0, 0);
+                if (key[1] != none)
+                    uv << mesh.TCoords[key[1]].X, mesh.TCoords[key[1]].Y;
+                texcoords.push_back(uv);
+                if (key[2] != none)
+                    normals.emplace_back(mesh.Normals[key[2]].X, mesh.Normals[key[2]].Y, mesh.Normals[key[2]].Z);
+                else
+                    normals.push_back(face_normal);
+                // 三个顶点的颜色相同
+                colors.emplace_back(148, 121.0, 92.0);
+            }
+            indices.push_back(triangle);
+        }
+    }
+    else
     {
-        for (int i = 0; i < mesh.Vertices.size(); i += 3)
+        for (const auto &mesh : Loader->LoadedMeshes)
         {
-            Triangle *t = new Triangle();
-            for (int j = 0; j < 3; j++)
+            mem::Scope scope(mem::Geometry);
+            for (int i = 0; i < mesh.Vertices.size(); i += 3)
             {
-                // 三角形的三个点
-                t->setVertex(j, Vector4f(mesh.Vertices[i + j].Position.X, mesh.Vertices[i + j].Position.Y, mesh.Vertices[i + j].Position.Z, 1.0));
-                // 三角形的三个顶点的法向量
-                t->setNormal(j, Vector3f(mesh.Vertices[i + j].Normal.X, mesh.Vertices[i + j].Normal.Y, mesh.Vertices[i + j].Normal.Z));
-                // 三角形三个顶点对应的纹理坐标
-                t->setTexCoord(j, Vector2f(mesh.Vertices[i + j].TextureCoordinate.X, mesh.Vertices[i + j].TextureCoordinate.Y));
+                Triangle *t = new Triangle();
+                for (int j = 0; j < 3; j++)
+                {
+                    // 三角形的三个点
+                    t->setVertex(j, Vector4f(mesh.Vertices[i + j].Position.X, mesh.Vertices[i + j].Position.Y, mesh.Vertices[i + j].Position.Z, 1.0));
+                    // 三角形的三个顶点的法向量
+                    t->setNormal(j, Vector3f(mesh.Vertices[i + j].Normal.X, mesh.Vertices[i + j].Normal.Y, mesh.Vertices[i + j].Normal.Z));
+                    // 三角形三个顶点对应的纹理坐标
+                    t->setTexCoord(j, Vector2f(mesh.Vertices[i + j].TextureCoordinate.X, mesh.Vertices[i + j].TextureCoordinate.Y));
+                }
+                TriangleList.push_back(t);
             }
-            TriangleList.push_back(t);
         }
     }
+    Loader.reset();
 
     rst::rasterizer r(700, 700);
+    r.set_threads(threads);
+    r.set_cull(cull);
+
+    rst::pos_buf_id pos_id;
+    rst::ind_buf_id ind_id;
+    rst::col_buf_id col_id;
+    if (!triangleList)
+    {
+        mem::Scope scope(mem::Geometry);
+        pos_id = r.load_positions(positions);
+        ind_id = r.load_indices(indices);
+        col_id = r.load_colors(colors);
+        r.load_normals(normals);
+        r.load_texcoords(texcoords);
+        // rasterizer 中有了一份拷贝
+        positions = {}, normals = {}, colors = {}, texcoords = {}, indices = {};
+    }
+    auto draw = [&]
+    {
+        if (triangleList)
+            r.draw(TriangleList);
+        else
+            r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+    };
+    auto drawWith = [&](const auto &shader)
+    {
+        if (triangleList)
+            r.draw(TriangleList, shader);
+        else
+            r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle, shader);
+    };
 
     // 设置纹理，注意一个模型对应一个纹理
     // 从一张图片生成其对应的纹理
@@ -465,6 +760,7 @@ int main(int argc, const char **argv)
 
     // 这里存放的是函数指针
     std::function<Eigen::Vector3f(fragment_shader_payload)> active_shader = displacement_fragment_shader;
+    std::string shaderName = argc == 3 ? argv[2] : "displacement";
 
 
     if (argc >= 2)
@@ -501,6 +797,8 @@ int main(int argc, const char **argv)
         }
     }
 
+    double setupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setupStart).count();
+
     // 相机所在位置（后面要将其拉到原点）
     Eigen::Vector3f eye_pos = {0, 0, 10};
 
@@ -519,15 +817,85 @@ int main(int argc, const char **argv)
         r.set_view(get_view_matrix(eye_pos));
         r.set_projection(get_projection_matrix(45.0, 1, -0.1, -50));
 
-        r.draw(TriangleList);
+        // benchmark 时画 10 帧取最快的一帧（每帧的结果都相同），第一帧的缓存预热和调度抖动不计入
+        const int drawCount = benchFile.empty() ? 1 : 10;
+        double drawMs = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < drawCount; ++i)
+        {
+            if (i > 0)
+                r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            auto drawStart = std::chrono::steady_clock::now();
+            if (dynamicShader)
+                draw();
+            else if (shaderName == "normal")
+                drawWith(normal_shader());
+            else if (shaderName == "phong")
+                drawWith(phong_shader());
+            else if (shaderName == "bump" && quadBump)
+                drawWith(bump_quad_shader());
+            else if (shaderName == "bump")
+                drawWith(bump_shader());
+            else if (pixelShader && shaderName == "texture")
+                drawWith(texture_shader());
+            else if (pixelShader)
+                drawWith(displacement_shader());
+            else if (shaderName == "texture")
+                drawWith(texture_quad_shader());
+            else
+                drawWith(displacement_quad_shader());
+            drawMs = std::min(drawMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - drawStart).count());
+        }
 
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
-        cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+        {
+            TRACE_ZONE("Present");
+            cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
+            image.convertTo(image, CV_8UC3, 1.0f);
+            cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
 
-        cv::imwrite(filename, image);
+            cv::imwrite(filename, image);
+        }
 
-        return 0;
+        const rst::clip_stats &clip = r.stats().clip;
+        printf("Primitive assembly: %llu triangles in, %llu culled (object), %llu culled (frustum), "
+               "%llu culled (backface), %llu clipped (near), %llu out\n",
+               (unsigned long long)clip.submitted, (unsigned long long)clip.culled_object,
+               (unsigned long long)clip.culled_frustum, (unsigned long long)clip.culled_backface,
+               (unsigned long long)clip.clipped_near, (unsigned long long)clip.emitted);
+
+        trace::stop();
+        perf::report();
+        mem::report();
+
+        int status = 0;
+        if (!benchFile.empty())
+        {
+            bench::Report report;
+            report.set("scene", "spot", bench::Config);
+            report.set("shader", shaderName, bench::Config);
+            report.set("shader_path", dynamicShader ? "std::function" : r.stats().quads > 0 ? "static-quad" : "static",
+                       bench::Config);
+            report.set("shaded_quads", r.stats().quads, bench::Config);
+            report.set("width", 700, bench::Config);
+            report.set("height", 700, bench::Config);
+            report.set("triangles", r.stats().triangles, bench::Config);
+            report.set("draw_path", triangleList ? "triangle-list" : "indexed", bench::Config);
+            report.set("vertices_transformed", r.stats().vertices, bench::Config);
+            report.set("cull", cull == rst::Cull::None ? "none" : cull == rst::Cull::Front ? "front" : "back",
+                       bench::Config);
+            report.set("triangles_rasterized", r.stats().clip.emitted, bench::Config);
+            report.set("threads", threads, bench::Config);
+            report.set("hardware_threads", std::thread::hardware_concurrency(), bench::Config);
+            report.set("setup_ms", setupMs, bench::LowerIsBetter, 1);
+            report.set("draws", drawCount, bench::Config);
+            report.set("draw_ms", drawMs, bench::LowerIsBetter, 0.5);
+            report.set("mfragments_per_s", r.stats().fragments / (drawMs * 1e3), bench::HigherIsBetter);
+            report.set("peak_rss_mb", bench::peakRssMb(), bench::LowerIsBetter, 1);
+            report.set("image_hash", bench::hashFile(filename), bench::Output);
+            report.write(benchFile);
+            if (!baselineFile.empty() && report.compare(baselineFile, threshold) > 0)
+                status = 1;
+        }
+        return status;
     }
 
     while (key != 27)
@@ -538,15 +906,17 @@ int main(int argc, const char **argv)
         r.set_view(get_view_matrix(eye_pos));
         r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
 
-        //r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
-        r.draw(TriangleList);
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
-        cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
-
-        cv::imshow("image", image);
-        cv::imwrite(filename, image);
-        key = cv::waitKey(10);
+        draw();
+        {
+            TRACE_ZONE("Present");
+            cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
+            image.convertTo(image, CV_8UC3, 1.0f);
+            cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+
+            cv::imshow("image", image);
+            cv::imwrite(filename, image);
+            key = cv::waitKey(10);
+        }
 
         if (key == 'a')
         {
@@ -557,5 +927,8 @@ int main(int argc, const char **argv)
             angle += 0.1;
         }
     }
+    trace::stop();
+    perf::report();
+    mem::report();
     return 0;
 }
@@ -3,7 +3,13 @@
 //
 
 #include <algorithm>
+#include <atomic>
+#include <thread>
 #include "rasterizer.hpp"
+#include "MemoryStats.hpp"
+#include "PerfCounters.hpp"
+#include "Trace.hpp"
+#include "WorkerPool.hpp"
 #include <opencv2/opencv.hpp>
 #include <math.h>
 
@@ -12,6 +18,13 @@ rst::pos_buf_id rst::rasterizer::load_positions(const std::vector<Eigen::Vector3
     auto id = get_next_id();
     pos_buf.emplace(id, positions);
 
+    std::array<Eigen::Vector3f, 2> bounds = {Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero()};
+    if (!positions.empty())
+        bounds = {positions[0], positions[0]};
+    for (const auto &p : positions)
+        bounds = {bounds[0].cwiseMin(p), bounds[1].cwiseMax(p)};
+    pos_bounds.emplace(id, bounds);
+
     return {id};
 }
 
@@ -41,6 +54,16 @@ rst::col_buf_id rst::rasterizer::load_normals(const std::vector<Eigen::Vector3f>
     return {id};
 }
 
+rst::col_buf_id rst::rasterizer::load_texcoords(const std::vector<Eigen::Vector2f> &texcoords)
+{
+    auto id = get_next_id();
+    tex_buf.emplace(id, texcoords);
+
+    texcoord_id = id;
+
+    return {id};
+}
+
 // Bresenham's line drawing algorithm
 void rst::rasterizer::draw_line(Eigen::Vector3f begin, Eigen::Vector3f end)
 {
@@ -147,208 +170,465 @@ auto to_vec4(const Eigen::Vector3f &v3, float w = 1.0f)
     return Vector4f(v3.x(), v3.y(), v3.z(), w);
 }
 
-// 这里为什么取成int类型了？
-static bool insideTriangle(int x, int y, const Vector4f *_v)
+rst::rasterizer::vertex_uniforms rst::rasterizer::uniforms() const
 {
-    Vector3f v[3];
-    for (int i = 0; i < 3; i++)
-        v[i] = {_v[i].x(), _v[i].y(), 1.0};
-    Vector3f f0, f1, f2;
-    f0 = v[1].cross(v[0]);
-    f1 = v[2].cross(v[1]);
-    f2 = v[0].cross(v[2]);
-    Vector3f p(x, y, 1.);
-    if ((p.dot(f0) * f0.dot(v[2]) > 0) && (p.dot(f1) * f1.dot(v[0]) > 0) && (p.dot(f2) * f2.dot(v[1]) > 0))
-        return true;
-    return false;
+    vertex_uniforms u;
+    // 这里算出z是什么意思
+    u.f1 = (50 - 0.1) / 2.0;
+    u.f2 = (50 + 0.1) / 2.0;
+
+    // 计算出MVP
+    u.mvp = projection * view * model;
+    u.mv = view * model;
+
+    // 这里存放的法向量是做了变换前的法向量还是做了变换后的法向量
+    // normal.transpose * model.inverse * model * p
+    u.inv_trans = u.mv.inverse().transpose();
+    u.eye_sign = eye_sign(projection);
+    return u;
 }
 
-static std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector4f *v)
+Eigen::Vector4f rst::rasterizer::to_screen(const vertex_uniforms &u, Eigen::Vector4f v) const
 {
-    float c1 = (x * (v[1].y() - v[2].y()) + (v[2].x() - v[1].x()) * y + v[1].x() * v[2].y() - v[2].x() * v[1].y()) / (v[0].x() * (v[1].y() - v[2].y()) + (v[2].x() - v[1].x()) * v[0].y() + v[1].x() * v[2].y() - v[2].x() * v[1].y());
-    float c2 = (x * (v[2].y() - v[0].y()) + (v[0].x() - v[2].x()) * y + v[2].x() * v[0].y() - v[0].x() * v[2].y()) / (v[1].x() * (v[2].y() - v[0].y()) + (v[0].x() - v[2].x()) * v[1].y() + v[2].x() * v[0].y() - v[0].x() * v[2].y());
-    float c3 = (x * (v[0].y() - v[1].y()) + (v[1].x() - v[0].x()) * y + v[0].x() * v[1].y() - v[1].x() * v[0].y()) / (v[2].x() * (v[0].y() - v[1].y()) + (v[1].x() - v[0].x()) * v[2].y() + v[0].x() * v[1].y() - v[1].x() * v[0].y());
-    return {c1, c2, c3};
+    //Homogeneous division
+    // 齐次坐标归一（不用将vec.w写为1吗）
+    v.x() /= v.w();
+    v.y() /= v.w();
+    v.z() /= v.w();
+
+    //Viewport transformation
+    // 视口变换：对应到屏幕坐标的位置（这里为什么要加1）
+    v.x() = 0.5 * width * (v.x() + 1.0);
+    v.y() = 0.5 * height * (v.y() + 1.0);
+    // 为什么是这样求z
+    v.z() = v.z() * u.f1 + u.f2;
+    return v;
 }
 
-void rst::rasterizer::draw(std::vector<Triangle *> &TriangleList)
+rst::rasterizer::transformed_vertex rst::rasterizer::transform_vertex(const vertex_uniforms &u,
+                                                                      const Eigen::Vector4f &position,
+                                                                      const Eigen::Vector3f &normal) const
 {
-    // 这里算出z是什么意思
-    float f1 = (50 - 0.1) / 2.0;
-    float f2 = (50 + 0.1) / 2.0;
+    transformed_vertex out;
+    // 做了视图变换的顶点（齐次坐标转换为普通坐标）
+    out.view_pos = (u.mv * position).head<3>();
 
-    // 计算出MVP
-    Eigen::Matrix4f mvp = projection * view * model;
+    // 这是顶点所对应的屏幕坐标
+    out.clip = u.mvp * position;
+    out.screen = to_screen(u, out.clip);
 
-    // 对每一个三角形进行操作
-    for (const auto &t : TriangleList)
-    {
-        // 变换后的三角形
-        Triangle newtri = *t;
-
-        // 将做了视图变换的三个顶点存放在mm中
-        std::array<Eigen::Vector4f, 3> mm{
-            (view * model * t->v[0]),
-            (view * model * t->v[1]),
-            (view * model * t->v[2])};
-
-        std::array<Eigen::Vector3f, 3> viewspace_pos;
-
-        // 将做了视图变换的齐次坐标转换为普通坐标存放在viewspace_pos中
-        std::transform(mm.begin(), mm.end(), viewspace_pos.begin(), [](auto &v)
-                       { return v.template head<3>(); });
-
-        // 这是三角形三个顶点所对应的屏幕坐标
-        Eigen::Vector4f v[] = {
-            mvp * t->v[0],
-            mvp * t->v[1],
-            mvp * t->v[2]};
-
-        //Homogeneous division
-        // 齐次坐标归一（不用将vec.w写为1吗）
-        for (auto &vec : v)
-        {
-            vec.x() /= vec.w();
-            vec.y() /= vec.w();
-            vec.z() /= vec.w();
-        }
+    // 计算新的法向量？为什么要这么算？
+    out.normal = (u.inv_trans * to_vec4(normal, 0.0f)).head<3>();
+    return out;
+}
+
+int rst::rasterizer::thread_count() const
+{
+    return threads > 0 ? threads : int(std::max(1u, std::thread::hardware_concurrency()));
+}
 
-        // 这里存放的法向量是做了变换前的法向量还是做了变换后的法向量
-        // normal.transpose * model.inverse * model * p
-        Eigen::Matrix4f inv_trans = (view * model).inverse().transpose();
+void rst::rasterizer::set_threads(int n)
+{
+    threads = n;
+    if (pool->size() != thread_count())
+        pool = std::make_unique<WorkerPool>(thread_count());
+}
 
-        // 计算新的三角形的法向量？
-        // 为什么要这么算？
-        Eigen::Vector4f n[] = {
-            inv_trans * to_vec4(t->normal[0], 0.0f),
-            inv_trans * to_vec4(t->normal[1], 0.0f),
-            inv_trans * to_vec4(t->normal[2], 0.0f)};
+void rst::rasterizer::begin_batch(draw_batch &batch, int count, int thread_num)
+{
+    int tile_count = ((width + tile_size - 1) / tile_size) * ((height + tile_size - 1) / tile_size);
+    mem::Scope scope(mem::Geometry);
+    batch.segments.resize(thread_num);
+    for (auto &segment : batch.segments)
+    {
+        segment.triangles.reserve(count / thread_num + 1);
+        segment.view_pos.reserve(count / thread_num + 1);
+    }
+    batch.bins.assign(thread_num, std::vector<std::vector<int>>(tile_count));
+    last_stats = draw_stats();
+    last_stats.triangles = count;
+}
 
-        //Viewport transformation
-        // 视口变换
-        for (auto &vert : v)
+void rst::rasterizer::assemble(const vertex_uniforms &u, const clip_vertex *v, bool inside, draw_segment &out) const
+{
+    ++out.clip.submitted;
+    unsigned any = 0;
+    if (!inside)
+    {
+        unsigned c0 = outcode(v[0].v.clip, u.eye_sign, clip_near);
+        unsigned c1 = outcode(v[1].v.clip, u.eye_sign, clip_near);
+        unsigned c2 = outcode(v[2].v.clip, u.eye_sign, clip_near);
+        if (c0 & c1 & c2)
         {
-            // 对应到屏幕坐标的位置（这里为什么要加1）
-            vert.x() = 0.5 * width * (vert.x() + 1.0);
-            vert.y() = 0.5 * height * (vert.y() + 1.0);
-            // 为什么是这样求z
-            vert.z() = vert.z() * f1 + f2;
+            ++out.clip.culled_frustum;
+            return;
         }
+        any = c0 | c1 | c2;
+    }
+    if (cull != Cull::None && culled(cull, facing(v[0].v.clip, v[1].v.clip, v[2].v.clip, u.eye_sign)))
+    {
+        ++out.clip.culled_backface;
+        return;
+    }
 
-        for (int i = 0; i < 3; ++i)
+    auto emit = [&](const clip_vertex &a, const clip_vertex &b, const clip_vertex &c)
+    {
+        const clip_vertex *corners[] = {&a, &b, &c};
+        out.triangles.emplace_back();
+        out.view_pos.emplace_back();
+        Triangle &t = out.triangles.back();
+        for (int j = 0; j < 3; ++j)
         {
+            const clip_vertex &cv = *corners[j];
             //screen space coordinates
             // 原来这个函数传的普通坐标，现在传的是齐次坐标
-            newtri.setVertex(i, v[i]);
+            t.setVertex(j, cv.v.screen);
+            //view space normal
+            t.setNormal(j, cv.v.normal);
+            t.setColor(j, cv.color.x(), cv.color.y(), cv.color.z());
+            t.setTexCoord(j, cv.tex_coord);
+            out.view_pos.back()[j] = cv.v.view_pos;
         }
+        ++out.clip.emitted;
+    };
+    if (!(any & outside_near))
+    {
+        emit(v[0], v[1], v[2]);
+        return;
+    }
+
+    // 和近平面相交：裁剪后是 3 或 4 个顶点的凸多边形，新顶点的屏幕坐标重新计算，再按扇形拆成三角形
+    ++out.clip.clipped_near;
+    clip_vertex polygon[4];
+    int n = clip_near_plane(v, polygon, u.eye_sign, clip_near,
+                            [](const clip_vertex &cv) -> const Eigen::Vector4f & { return cv.v.clip; },
+                            [&](const clip_vertex &a, const clip_vertex &b, float t)
+    {
+        clip_vertex r;
+        r.v.clip = a.v.clip + t * (b.v.clip - a.v.clip);
+        r.v.screen = to_screen(u, r.v.clip);
+        r.v.view_pos = a.v.view_pos + t * (b.v.view_pos - a.v.view_pos);
+        r.v.normal = a.v.normal + t * (b.v.normal - a.v.normal);
+        r.color = a.color + t * (b.color - a.color);
+        r.tex_coord = a.tex_coord + t * (b.tex_coord - a.tex_coord);
+        return r;
+    });
+    for (int k = 1; k + 1 < n; ++k)
+        emit(polygon[0], polygon[k], polygon[k + 1]);
+}
+
+void rst::rasterizer::bin_triangle(draw_batch &batch, int i, int segment) const
+{
+    // 建立边函数，放进包围盒覆盖的每个分块；退化的三角形不会覆盖任何像素
+    tile_rect box;
+    edge_setup &setup = batch.setups[i];
+    if (!setup.setup(batch.triangles[i].v) || !bounding_box(setup, box))
+        return;
+    int tiles_x = (width + tile_size - 1) / tile_size;
+    for (int ty = (box.y0 - 1) / tile_size; ty <= (box.y1 - 1) / tile_size; ++ty)
+        for (int tx = box.x0 / tile_size; tx <= box.x1 / tile_size; ++tx)
+            batch.bins[segment][ty * tiles_x + tx].push_back(i);
+}
 
-        for (int i = 0; i < 3; ++i)
+void rst::rasterizer::setup_and_bin(draw_batch &batch, int thread_num)
+{
+    // 装配出的三角形数事先不知道，先求出每一段在总的编号中的起点
+    std::vector<int> first(thread_num + 1, 0);
+    for (int w = 0; w < thread_num; ++w)
+    {
+        first[w + 1] = first[w] + int(batch.segments[w].triangles.size());
+        last_stats.clip += batch.segments[w].clip;
+    }
+    int count = first[thread_num];
+    {
+        mem::Scope scope(mem::Geometry);
+        batch.triangles.resize(count);
+        batch.view_pos.resize(count);
+        batch.setups.resize(count);
+    }
+
+    TRACE_ZONE("Triangle setup + binning");
+    perf::Phase phase("Triangle setup + binning");
+    phase.setUnits(count, "triangle");
+    pool->run([&](int w)
+    {
+        draw_segment &segment = batch.segments[w];
+        for (int k = 0; k < int(segment.triangles.size()); ++k)
         {
-            //view space normal
-            // 新的三角形的法向量？
-            newtri.setNormal(i, n[i].head<3>());
+            int i = first[w] + k;
+            batch.triangles[i] = std::move(segment.triangles[k]);
+            batch.view_pos[i] = segment.view_pos[k];
+            bin_triangle(batch, i, w);
         }
+    });
+}
 
-        // 为该三角形设置颜色
-        // 三个顶点的颜色相同？
-        newtri.setColor(0, 148, 121.0, 92.0);
-        newtri.setColor(1, 148, 121.0, 92.0);
-        newtri.setColor(2, 148, 121.0, 92.0);
+// 两种 draw 都分三个阶段完成：
+// 1. 三角形分成连续的几段，每个线程处理一段：图元装配（剔除视锥外和背面的三角形，裁掉近平面之前的部分），
+//    结果按提交的顺序留在这一段中。带索引的 draw 在这之前先把所有顶点分段变换一遍，
+//    装配时只按索引取变换后的顶点；逐三角形的 draw 在装配时变换三角形的三个顶点
+// 2. 各段拼起来就是提交的顺序。每个线程再为自己那一段建立边函数，并把每个三角形放进它的包围盒
+//    覆盖的分块中。每段有自己的一组分块列表，所以不需要加锁
+// 3. 线程每次领取一个分块，按提交顺序光栅化（覆盖和深度测试）分块中的三角形，
+//    再对分块内的可见像素着色。分块之间没有重叠，frame_buf/depth_buf 也不需要加锁，
+//    每个像素上的深度测试顺序和单线程完全相同，所以结果也完全相同
+namespace
+{
+    // set_fragment_shader 设置的着色器：在运行时才知道读取哪些属性，所以全部插值
+    struct dynamic_fragment_shader
+    {
+        static constexpr unsigned varyings = varying_all;
+        const std::function<Eigen::Vector3f(fragment_shader_payload)> &shade;
 
-        // Also pass view space vertice position
-        rasterize_triangle(newtri, viewspace_pos);
-    }
+        Eigen::Vector3f operator()(const fragment_shader_payload &payload) const { return shade(payload); }
+    };
 }
 
-// 三维点的插值
-static Eigen::Vector3f interpolate(float alpha, float beta, float gamma, const Eigen::Vector3f &vert1, const Eigen::Vector3f &vert2, const Eigen::Vector3f &vert3, float weight)
+void rst::rasterizer::draw(std::vector<Triangle *> &TriangleList)
 {
-    return (alpha * vert1 + beta * vert2 + gamma * vert3) / weight;
+    dynamic_fragment_shader shader{fragment_shader};
+    draw_list(TriangleList, [&](const draw_batch &batch, const tile_rect &tile, draw_stats &stats)
+              { shade(batch, tile, stats, shader); });
 }
 
-static Eigen::Vector2f interpolate(float alpha, float beta, float gamma, const Eigen::Vector2f &vert1, const Eigen::Vector2f &vert2, const Eigen::Vector2f &vert3, float weight)
+void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type)
 {
-    auto u = (alpha * vert1[0] + beta * vert2[0] + gamma * vert3[0]);
-    auto v = (alpha * vert1[1] + beta * vert2[1] + gamma * vert3[1]);
+    dynamic_fragment_shader shader{fragment_shader};
+    draw_indexed(pos_buffer, ind_buffer, col_buffer, type,
+                 [&](const draw_batch &batch, const tile_rect &tile, draw_stats &stats)
+                 { shade(batch, tile, stats, shader); });
+}
+
+void rst::rasterizer::draw_list(std::vector<Triangle *> &TriangleList, const tile_shader &shade_tile)
+{
+    vertex_uniforms u = uniforms();
+    int thread_num = pool->size();
+    int count = int(TriangleList.size());
+    draw_batch batch;
+    begin_batch(batch, count, thread_num);
+    last_stats.vertices = uint64_t(count) * 3;
 
-    u /= weight;
-    v /= weight;
+    {
+        TRACE_ZONE("Vertex transform + assembly");
+        perf::Phase phase("Vertex transform + assembly");
+        phase.setUnits(count, "triangle");
+        pool->run([&](int w)
+        {
+            mem::Scope scope(mem::Geometry);
+            // 对每一个三角形进行操作
+            for (int i = count * int64_t(w) / thread_num; i < count * int64_t(w + 1) / thread_num; ++i)
+            {
+                const Triangle *t = TriangleList[i];
+                clip_vertex v[3];
+                for (int j = 0; j < 3; ++j)
+                {
+                    v[j].v = transform_vertex(u, t->v[j], t->normal[j]);
+                    // 为该三角形设置颜色
+                    // 三个顶点的颜色相同？
+                    v[j].color = Eigen::Vector3f(148, 121.0, 92.0);
+                    v[j].tex_coord = t->tex_coords[j];
+                }
+                assemble(u, v, false, batch.segments[w]);
+            }
+        });
+    }
 
-    return Eigen::Vector2f(u, v);
+    setup_and_bin(batch, thread_num);
+    draw_tiles(batch, thread_num, shade_tile);
 }
 
-//Screen space rasterization
-void rst::rasterizer::rasterize_triangle(const Triangle &t, const std::array<Eigen::Vector3f, 3> &view_pos)
+void rst::rasterizer::draw_indexed(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type,
+                                   const tile_shader &shade_tile)
 {
-    // v中存放三角形3个顶点的齐次坐标
-    auto v = t.toVector4();
-
-    int minX = INT32_MAX;
-    int maxX = INT32_MIN;
-    int minY = INT32_MAX;
-    int maxY = INT32_MIN;
+    if (type != rst::Primitive::Triangle)
+    {
+        throw std::runtime_error("Drawing primitives other than triangle is not implemented yet!");
+    }
+    const auto &positions = pos_buf[pos_buffer.pos_id];
+    const auto &bounds = pos_bounds[pos_buffer.pos_id];
+    const auto &indices = ind_buf[ind_buffer.ind_id];
+    const auto &colors = col_buf[col_buffer.col_id];
+    // 没有载入法向量或纹理坐标时用 0
+    const std::vector<Eigen::Vector3f> *normals = normal_id >= 0 ? &nor_buf[normal_id] : nullptr;
+    const std::vector<Eigen::Vector2f> *texcoords = texcoord_id >= 0 ? &tex_buf[texcoord_id] : nullptr;
+
+    vertex_uniforms u = uniforms();
+    int thread_num = pool->size();
+    int vertex_count = int(positions.size());
+    int count = int(indices.size());
+    draw_batch batch;
+    begin_batch(batch, count, thread_num);
+
+    // 整个物体的包围盒在某一个平面之外时什么都不用做；完全在视锥内时装配中不用再逐个三角形地测试视锥
+    bool inside = false;
+    if (!positions.empty() && box_outcode(u.mvp, bounds[0], bounds[1], u.eye_sign, clip_near, inside))
+    {
+        last_stats.clip.submitted = count;
+        last_stats.clip.culled_object = count;
+        return;
+    }
+    last_stats.vertices = vertex_count;
 
-    float alpha = 0.0;
-    float beta = 0.0;
-    float gamma = 0.0;
+    // 变换后的顶点（相当于一个放得下所有顶点的 post-transform cache）
+    std::vector<transformed_vertex> vertices;
+    {
+        mem::Scope scope(mem::Geometry);
+        vertices.resize(vertex_count);
+    }
 
-    // 找到所对应的包围盒
-    for(unsigned i = 0; i < 3; ++i)
     {
-        if(maxX < v[i].x())
-            maxX = v[i].x();   // 注意这里是向下取整
-        if(minX > v[i].x())
-            minX = v[i].x();
-        if(maxY < v[i].y())
-            maxY = v[i].y();
-        if(minY > v[i].y())
-            minY = v[i].y();
+        TRACE_ZONE("Vertex transform");
+        perf::Phase phase("Vertex transform");
+        phase.setUnits(vertex_count, "vertex");
+        pool->run([&](int w)
+        {
+            for (int i = vertex_count * int64_t(w) / thread_num; i < vertex_count * int64_t(w + 1) / thread_num; ++i)
+                vertices[i] = transform_vertex(u, to_vec4(positions[i], 1.0f),
+                                               normals ? (*normals)[i] : Eigen::Vector3f::Zero());
+        });
     }
 
-    for(int x = minX; x <= maxX; ++x )
     {
-        for(int y = minY; y <= maxY; ++y)
+        TRACE_ZONE("Primitive assembly");
+        perf::Phase phase("Primitive assembly");
+        phase.setUnits(count, "triangle");
+        pool->run([&](int w)
         {
-            // 取像素的中心点
-            if(insideTriangle(float(x + 0.5), float(y + 0.5), t.v))
+            mem::Scope scope(mem::Geometry);
+            for (int i = count * int64_t(w) / thread_num; i < count * int64_t(w + 1) / thread_num; ++i)
             {
-                // 计算出alpha, beta, gamma
-                auto tp = computeBarycentric2D(float(x + 0.5), float(y + 0.5), t.v);
-                std::tie(alpha, beta, gamma) = tp;
+                clip_vertex v[3];
+                for (int j = 0; j < 3; ++j)
+                {
+                    int k = indices[i][j];
+                    v[j].v = vertices[k];
+                    v[j].color = colors[k];
+                    v[j].tex_coord = texcoords ? (*texcoords)[k] : Eigen::Vector2f::Zero();
+                }
+                assemble(u, v, inside, batch.segments[w]);
+            }
+        });
+    }
+
+    setup_and_bin(batch, thread_num);
+    draw_tiles(batch, thread_num, shade_tile);
+}
+
+void rst::rasterizer::draw_tiles(draw_batch &batch, int thread_num, const tile_shader &shade_tile)
+{
+    int tiles_x = (width + tile_size - 1) / tile_size;
+    int tile_count = int(batch.bins.empty() ? 0 : batch.bins[0].size());
+
+    TRACE_ZONE("Rasterize + shade");
+    perf::Phase phase("Rasterize + shade");
+    std::vector<draw_stats> worker_stats(thread_num);
+    std::atomic<int> next_tile{0};
+    pool->run([&](int w)
+    {
+        draw_stats stats;
+        for (int tile = next_tile++; tile < tile_count; tile = next_tile++)
+        {
+            TRACE_ZONE("Tile", tile);
+            tile_rect rect;
+            rect.x0 = (tile % tiles_x) * tile_size;
+            rect.x1 = std::min(rect.x0 + tile_size, width) - 1;
+            rect.y0 = (tile / tiles_x) * tile_size + 1;
+            rect.y1 = std::min(rect.y0 + tile_size - 1, height);
+
+            for (int y = rect.y0; y <= rect.y1; ++y)
+                std::fill_n(visibility_buf.begin() + get_index(rect.x0, y), rect.x1 - rect.x0 + 1, -1);
+            for (const auto &segment : batch.bins)
+                for (int i : segment[tile])
+                    rasterize_triangle(batch.triangles[i], batch.setups[i], i, rect, stats);
+            shade_tile(batch, rect, stats);
+        }
+        worker_stats[w] = stats;
+    });
+    for (const auto &stats : worker_stats)
+    {
+        last_stats.fragments += stats.fragments;
+        last_stats.shaded += stats.shaded;
+        last_stats.quads += stats.quads;
+        last_stats.hiz_rejected += stats.hiz_rejected;
+    }
+    phase.setUnits(last_stats.shaded, "fragment");
+}
 
-                //这里这么写是为了应对w不为1的情况！
-                float Z = 1.0 / (alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-                float zp = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-                zp *= Z;
+bool rst::rasterizer::bounding_box(const edge_setup &s, tile_rect &box) const
+{
+    // 裁到屏幕范围内：get_index 把 y 映射到 height - y 行，所以 y 的有效范围是 [1, height]
+    box.x0 = std::max(s.x0, 0);
+    box.x1 = std::min(s.x1, width - 1);
+    box.y0 = std::max(s.y0, 1);
+    box.y1 = std::min(s.y1, height);
+    return box.x0 <= box.x1 && box.y0 <= box.y1;
+}
 
+float rst::rasterizer::far_depth(int bx, int by)
+{
+    int block = by * hiz_width + bx;
+    if (hiz_dirty[block])
+    {
+        float far = std::numeric_limits<float>::infinity();
+        int x1 = std::min(bx * hiz_size + hiz_size, width);
+        int y1 = std::min(by * hiz_size + hiz_size, height);
+        for (int y = by * hiz_size + 1; y <= y1; ++y)
+        {
+            const float *row = &depth_buf[get_index(0, y)];
+            for (int x = bx * hiz_size; x < x1; ++x)
+                far = std::min(far, row[x]);
+        }
+        hiz_far[block] = far;
+        hiz_dirty[block] = 0;
+    }
+    return hiz_far[block];
+}
 
-                if(depth_buf[get_index(x, y)] < zp)
+//Screen space rasterization
+void rst::rasterizer::rasterize_triangle(const Triangle &t, const edge_setup &s, int index, const tile_rect &tile,
+                                         draw_stats &stats)
+{
+    // 深度的插值要除以 w（为了应对 w 不为 1 的情况），每个顶点的 1/w 和 z/w 只算一次
+    float inv_w[3], z_w[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        inv_w[i] = 1.0f / t.v[i].w();
+        z_w[i] = t.v[i].z() / t.v[i].w();
+    }
+    // 透视校正的深度是三个顶点深度的加权平均，不会比最近的顶点更近；留一点余量覆盖插值的舍入误差
+    float nearest = std::max({t.v[0].z(), t.v[1].z(), t.v[2].z()});
+    nearest += (std::fabs(nearest) + 1.0f) * 1e-5f;
+
+    int x0 = std::max(s.x0, tile.x0), x1 = std::min(s.x1, tile.x1);
+    int y0 = std::max(s.y0, tile.y0), y1 = std::min(s.y1, tile.y1);
+    // 逐块扫描：块内已经写下的深度全都比三角形最近的点还近时，整块跳过（最后一个像素也通不过深度测试）。
+    // 块内逐行扫描，覆盖测试和重心坐标都由边函数递推得到
+    for (int by = (y0 - 1) / hiz_size; by <= (y1 - 1) / hiz_size; ++by)
+    {
+        for (int bx = x0 / hiz_size; bx <= x1 / hiz_size; ++bx)
+        {
+            if (nearest <= far_depth(bx, by))
+            {
+                ++stats.hiz_rejected;
+                continue;
+            }
+            int block = by * hiz_width + bx;
+            scan_triangle(s, std::max(x0, bx * hiz_size), std::max(y0, by * hiz_size + 1),
+                          std::min(x1, bx * hiz_size + hiz_size - 1), std::min(y1, by * hiz_size + hiz_size),
+                          [&](int x, int y, float alpha, float beta, float gamma)
+            {
+                float Z = 1.0f / (alpha * inv_w[0] + beta * inv_w[1] + gamma * inv_w[2]);
+                float zp = (alpha * z_w[0] + beta * z_w[1] + gamma * z_w[2]) * Z;
+
+                ++stats.fragments;
+                int ind = get_index(x, y);
+                if (depth_buf[ind] < zp)
                 {
-                    depth_buf[get_index(x, y)] = zp;
-
-                    // 插值出三角形内各个像素点的颜色
-                    auto interpolated_color = interpolate(alpha, beta, gamma, t.color[0], t.color[1], t.color[2], 1);
-                    // 插值出三角形内各个像素点的法向量
-                    auto interpolated_normal = interpolate(alpha, beta, gamma, t.normal[0], t.normal[1], t.normal[2], 1);
-                    // 插值出三角形内各个像素点的纹理坐标
-                    auto interpolated_texcoords = interpolate(alpha, beta, gamma, t.tex_coords[0], t.tex_coords[1], t.tex_coords[2], 1);
-                    // 定义视图变换后，还没有进行透视投影前三角形内的每个像素点的位置
-                    auto interpolated_shadingcoords = interpolate(alpha, beta, gamma, view_pos[0], view_pos[1], view_pos[2], 1);
-                    
-                    // 注意这里将插值得到的法向量纹理坐标归一化
-                    // 这里对应这三种做法，一种是直接利用顶点查询到的颜色，将顶点的颜色进行插值
-                    // 一种是通过顶点对应的法向量插值得到各个像素点的法向量，通过对法向量进行着色操作
-                    // 一种是通过对顶点对应的纹理坐标进行插值，找到各个像素点对应的纹理坐标进行操作
-                    // 将插值得到的数据和那一张纹理贴图封装成一个数据结构方便后续使用
-                    fragment_shader_payload payload( interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, texture ? &*texture : nullptr);
-                    payload.view_pos = interpolated_shadingcoords;
-
-                    // 得到这个像素点对应的颜色
-                    auto pixel_color = fragment_shader(payload);
-
-                    set_pixel(Eigen::Vector2i(x, y), pixel_color);
+                    depth_buf[ind] = zp;
+                    visibility_buf[ind] = index;
+                    hiz_dirty[block] = 1;
                 }
-            }
+            });
         }
     }
 }
@@ -378,19 +658,30 @@ void rst::rasterizer::clear(rst::Buffers buff)
     {
         // 
         std::fill(depth_buf.begin(), depth_buf.end(), -std::numeric_limits<float>::infinity());
+        std::fill(hiz_far.begin(), hiz_far.end(), -std::numeric_limits<float>::infinity());
+        std::fill(hiz_dirty.begin(), hiz_dirty.end(), 0);
     }
 }
 
 rst::rasterizer::rasterizer(int w, int h) : width(w), height(h)
 {
+    mem::Scope scope(mem::Framebuffer);
     frame_buf.resize(w * h);
     depth_buf.resize(w * h);
+    visibility_buf.resize(w * h, -1);
+    hiz_width = (w + hiz_size - 1) / hiz_size;
+    hiz_far.resize(hiz_width * ((h + hiz_size - 1) / hiz_size));
+    hiz_dirty.resize(hiz_far.size(), 1);
 
 
     // 将纹理初始化为nullptr
     texture = std::nullopt;
+
+    pool = std::make_unique<WorkerPool>(thread_count());
 }
 
+rst::rasterizer::~rasterizer() = default;
+
 int rst::rasterizer::get_index(int x, int y)
 {
     // 这里是为了适应openCV
@@ -7,12 +7,46 @@
 #include <eigen3/Eigen/Eigen>
 #include <optional>
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <type_traits>
 #include "global.hpp"
+#include "Clipping.hpp"
+#include "EdgeFunction.hpp"
 #include "Shader.hpp"
 #include "Triangle.hpp"
 
 using namespace Eigen;
 
+class WorkerPool;
+
+// 逐像素的覆盖测试和重心坐标（屏幕空间，只用到顶点的 x、y）。rasterizer 已经改用 EdgeFunction.hpp
+// 中的定点边函数，这两个函数留作对照，KernelBench 用它们和边函数比较
+// 这里为什么取成int类型了？
+inline bool insideTriangle(int x, int y, const Vector4f *_v)
+{
+    Vector3f v[3];
+    for (int i = 0; i < 3; i++)
+        v[i] = {_v[i].x(), _v[i].y(), 1.0};
+    Vector3f f0, f1, f2;
+    f0 = v[1].cross(v[0]);
+    f1 = v[2].cross(v[1]);
+    f2 = v[0].cross(v[2]);
+    Vector3f p(x, y, 1.);
+    if ((p.dot(f0) * f0.dot(v[2]) > 0) && (p.dot(f1) * f1.dot(v[0]) > 0) && (p.dot(f2) * f2.dot(v[1]) > 0))
+        return true;
+    return false;
+}
+
+inline std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector4f *v)
+{
+    float c1 = (x * (v[1].y() - v[2].y()) + (v[2].x() - v[1].x()) * y + v[1].x() * v[2].y() - v[2].x() * v[1].y()) / (v[0].x() * (v[1].y() - v[2].y()) + (v[2].x() - v[1].x()) * v[0].y() + v[1].x() * v[2].y() - v[2].x() * v[1].y());
+    float c2 = (x * (v[2].y() - v[0].y()) + (v[0].x() - v[2].x()) * y + v[2].x() * v[0].y() - v[0].x() * v[2].y()) / (v[1].x() * (v[2].y() - v[0].y()) + (v[0].x() - v[2].x()) * v[1].y() + v[2].x() * v[0].y() - v[0].x() * v[2].y());
+    float c3 = (x * (v[0].y() - v[1].y()) + (v[1].x() - v[0].x()) * y + v[0].x() * v[1].y() - v[1].x() * v[0].y()) / (v[2].x() * (v[0].y() - v[1].y()) + (v[1].x() - v[0].x()) * v[2].y() + v[0].x() * v[1].y() - v[1].x() * v[0].y());
+    return {c1, c2, c3};
+}
+
 namespace rst
 {
     enum class Buffers
@@ -57,20 +91,46 @@ namespace rst
         int col_id = 0;
     };
 
+    // 屏幕上的一块矩形区域（两端都包含），y 和 set_pixel 一样取 [1, height]
+    struct tile_rect
+    {
+        int x0, y0, x1, y1;
+    };
+
+    // 最近一次 draw 的统计，用来把各阶段的开销折算到每个三角形、每个片元上
+    struct draw_stats
+    {
+        uint64_t triangles = 0; // 提交的三角形
+        uint64_t vertices = 0;  // 变换的顶点（带索引的 draw 中每个顶点只变换一次，否则每个三角形 3 个）
+        uint64_t fragments = 0; // 通过覆盖测试、做了深度测试的片元
+        uint64_t shaded = 0;    // 调用 fragment shader 的像素
+        uint64_t quads = 0;     // 按 2x2 块着色时调用 shader 的次数（每次 4 个 lane，其中 shaded 之外的是 helper lane）
+        uint64_t hiz_rejected = 0; // 被粗粒度深度整块剔除的（三角形, 8x8 块）
+        clip_stats clip;           // 图元装配中各项剔除和裁剪的三角形数
+    };
+
     class rasterizer
     {
     public:
         rasterizer(int w, int h);
+        ~rasterizer();
         pos_buf_id load_positions(const std::vector<Eigen::Vector3f>& positions);
         ind_buf_id load_indices(const std::vector<Eigen::Vector3i>& indices);
         col_buf_id load_colors(const std::vector<Eigen::Vector3f>& colors);
         col_buf_id load_normals(const std::vector<Eigen::Vector3f>& normals);
+        col_buf_id load_texcoords(const std::vector<Eigen::Vector2f>& texcoords);
 
         void set_model(const Eigen::Matrix4f& m);
         void set_view(const Eigen::Matrix4f& v);
         void set_projection(const Eigen::Matrix4f& p);
 
         void set_texture(Texture tex) { texture = tex; }
+        // draw 使用的线程数，0 表示使用全部硬件线程。工作线程常驻，只在线程数变化时重新创建
+        void set_threads(int n);
+        // 背面剔除，默认不剔除
+        void set_cull(Cull c) { cull = c; }
+        // 近平面到相机的距离（get_projection_matrix 的 |zNear|），更近的部分被裁掉
+        void set_clip_near(float d) { clip_near = d; }
 
         void set_vertex_shader(std::function<Eigen::Vector3f(vertex_shader_payload)> vert_shader);
         void set_fragment_shader(std::function<Eigen::Vector3f(fragment_shader_payload)> frag_shader);
@@ -79,15 +139,116 @@ namespace rst
 
         void clear(Buffers buff);
 
+        // 带索引的 draw：顶点属性来自 load_positions/load_normals/load_texcoords/load_colors 载入的缓冲区
+        // （按下标一一对应），每个顶点只变换一次，三角形再按索引取变换后的顶点。只支持 Primitive::Triangle
         void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type);
+        // 每个三角形自带三个顶点，顶点在每个用到它的三角形中都要变换一次
         void draw(std::vector<Triangle *> &TriangleList);
 
+        // 片元着色器在编译期确定的 draw。Shader 提供 static constexpr unsigned varyings（见 Shader.hpp）和
+        // Eigen::Vector3f operator()(const fragment_shader_payload&) const：只插值它声明的属性，
+        // 着色器内联到逐像素的循环中。operator() 接受 quad_fragment_payload 时按 2x2 块着色，着色器可以用
+        // ddx/ddy 求屏幕空间导数。上面两个 draw 调用 set_fragment_shader 设置的 std::function，
+        // 每个像素都插值全部属性，可以在运行时切换着色器
+        template <typename Shader>
+        void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type,
+                  const Shader& shader)
+        {
+            draw_indexed(pos_buffer, ind_buffer, col_buffer, type,
+                         [&](const draw_batch& batch, const tile_rect& tile, draw_stats& stats)
+                         { shade(batch, tile, stats, shader); });
+        }
+        template <typename Shader>
+        void draw(std::vector<Triangle *> &TriangleList, const Shader& shader)
+        {
+            draw_list(TriangleList, [&](const draw_batch& batch, const tile_rect& tile, draw_stats& stats)
+                      { shade(batch, tile, stats, shader); });
+        }
+
         std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
+        const draw_stats& stats() const { return last_stats; }
 
     private:
         void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
 
-        void rasterize_triangle(const Triangle& t, const std::array<Eigen::Vector3f, 3>& world_pos);
+        // 一次 draw 中对所有顶点都相同的矩阵，每次 draw 只算一次
+        struct vertex_uniforms
+        {
+            Eigen::Matrix4f mv, mvp, inv_trans;
+            float f1, f2;
+            float eye_sign; // 见 Clipping.hpp
+        };
+        // 变换后的顶点：齐次坐标，屏幕坐标（x、y 是像素，z 是深度，w 留给透视校正）、视图空间的位置和法向量
+        struct transformed_vertex
+        {
+            Eigen::Vector4f clip;
+            Eigen::Vector4f screen;
+            Eigen::Vector3f view_pos;
+            Eigen::Vector3f normal;
+        };
+        // 图元装配中三角形的一个顶点：裁剪时所有属性都在齐次坐标中线性插值
+        struct clip_vertex
+        {
+            transformed_vertex v;
+            Eigen::Vector3f color;
+            Eigen::Vector2f tex_coord;
+        };
+        // 一个线程装配出的三角形（按提交顺序）
+        struct draw_segment
+        {
+            std::vector<Triangle> triangles;
+            std::vector<std::array<Eigen::Vector3f, 3>> view_pos;
+            clip_stats clip;
+        };
+        // 两种 draw 共用的后半段：装配好的三角形、边函数和分块
+        struct draw_batch
+        {
+            std::vector<draw_segment> segments;
+            std::vector<Triangle> triangles;
+            std::vector<std::array<Eigen::Vector3f, 3>> view_pos;
+            std::vector<edge_setup> setups;
+            // bins[段][分块] 是这一段中和分块相交的三角形编号（递增）
+            std::vector<std::vector<std::vector<int>>> bins;
+        };
+
+        vertex_uniforms uniforms() const;
+        Eigen::Vector4f to_screen(const vertex_uniforms& u, Eigen::Vector4f clip) const;
+        transformed_vertex transform_vertex(const vertex_uniforms& u, const Eigen::Vector4f& position,
+                                            const Eigen::Vector3f& normal) const;
+        int thread_count() const;
+        void begin_batch(draw_batch& batch, int count, int thread_num);
+        // 剔除、裁剪一个三角形，结果（0 到 2 个三角形）追加到 out 中。inside 为 true 时物体整个在视锥内，
+        // 不需要再逐个三角形地测试视锥
+        void assemble(const vertex_uniforms& u, const clip_vertex* v, bool inside, draw_segment& out) const;
+        // 按段的顺序拼起装配好的三角形，建立边函数并分块
+        void setup_and_bin(draw_batch& batch, int thread_num);
+        // 建立第 i 个三角形的边函数，放进第 segment 段中它覆盖的分块
+        void bin_triangle(draw_batch& batch, int i, int segment) const;
+        // 对一个分块中的可见像素着色
+        using tile_shader = std::function<void(const draw_batch&, const tile_rect&, draw_stats&)>;
+        void draw_indexed(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type,
+                          const tile_shader& shade_tile);
+        void draw_list(std::vector<Triangle *> &TriangleList, const tile_shader& shade_tile);
+        // 线程每次领取一个分块，光栅化后调用 shade_tile 着色
+        void draw_tiles(draw_batch& batch, int thread_num, const tile_shader& shade_tile);
+
+        // 三角形在屏幕上的包围盒（裁到屏幕范围内），和屏幕不相交时返回 false
+        bool bounding_box(const edge_setup& s, tile_rect& box) const;
+        // 只做覆盖和深度测试（限制在 tile 内），通过的像素记下三角形的编号（visibility_buf）
+        void rasterize_triangle(const Triangle& t, const edge_setup& s, int index, const tile_rect& tile, draw_stats& stats);
+        // 对 tile 内每个可见像素只着色一次：由边函数算出重心坐标，插值 Shader::varyings 中的属性后调用 shader
+        template <typename Shader>
+        void shade(const draw_batch& batch, const tile_rect& tile, draw_stats& stats, const Shader& shader);
+        // 按 2x2 块着色：块内每个可见的三角形调用一次 shader，四个 lane 都用这个三角形插值
+        template <typename Shader>
+        void shade_quads(const draw_batch& batch, const tile_rect& tile, draw_stats& stats, const Shader& shader);
+        // 用第 index 个三角形在像素 (x, y) 的重心坐标插值 Varyings 中的属性
+        template <unsigned Varyings>
+        void interpolate_varyings(const draw_batch& batch, int index, int x, int y, fragment_shader_payload& payload) const;
+        // 同上，一次插值以 (x, y) 为左下角的 2x2 块的四个 lane：每个属性分量的四个 lane 放在一个
+        // Eigen::Array4f 中（SSE/NEON 的一个寄存器），结果和逐个 lane 调用 interpolate_varyings 完全相同
+        template <unsigned Varyings>
+        void interpolate_quad(const draw_batch& batch, int index, int x, int y, quad_fragment_payload& quad) const;
 
         // VERTEX SHADER -> MVP -> Clipping -> /.W -> VIEWPORT -> DRAWLINE/DRAWTRI -> FRAGSHADER
 
@@ -97,11 +258,15 @@ namespace rst
         Eigen::Matrix4f projection;
 
         int normal_id = -1;
+        int texcoord_id = -1;
 
         std::map<int, std::vector<Eigen::Vector3f>> pos_buf;
+        // 每个位置缓冲区的包围盒（最小、最大），整个物体的视锥剔除用
+        std::map<int, std::array<Eigen::Vector3f, 2>> pos_bounds;
         std::map<int, std::vector<Eigen::Vector3i>> ind_buf;
         std::map<int, std::vector<Eigen::Vector3f>> col_buf;
         std::map<int, std::vector<Eigen::Vector3f>> nor_buf;
+        std::map<int, std::vector<Eigen::Vector2f>> tex_buf;
 
         // c++17
         std::optional<Texture> texture;
@@ -112,11 +277,203 @@ namespace rst
 
         std::vector<Eigen::Vector3f> frame_buf;
         std::vector<float> depth_buf;
+        // 粗粒度深度：每 hiz_size x hiz_size 像素一块，记录块内最远（最小）的深度。
+        // 写入像素时只把块标记为 dirty，下次查询时再重新求最小值；没更新时的值偏小，剔除仍然正确
+        static constexpr int hiz_size = 8;
+        int hiz_width = 0;
+        std::vector<float> hiz_far;
+        std::vector<uint8_t> hiz_dirty;
+        float far_depth(int bx, int by);
+        // 每个像素上当前 draw 中深度测试胜出的三角形编号，-1 表示没有
+        std::vector<int> visibility_buf;
         int get_index(int x, int y);
 
         int width, height;
+        draw_stats last_stats;
+
+        // 光栅化和着色按 tile_size x tile_size 的分块并行，每个分块只由一个线程写
+        // （tile_size 是 hiz_size 的倍数，粗粒度深度的每一块也只属于一个分块）
+        static constexpr int tile_size = 64;
+        int threads = 0;
+        // draw 的各个阶段都交给这些线程（构造时按硬件线程数创建，set_threads 时按需重建）
+        std::unique_ptr<WorkerPool> pool;
+
+        Cull cull = Cull::None;
+        float clip_near = 0.1f;
 
         int next_id = 0;
         int get_next_id() { return next_id++; }
     };
+
+    // 三维点的插值
+    inline Eigen::Vector3f interpolate(float alpha, float beta, float gamma, const Eigen::Vector3f &vert1, const Eigen::Vector3f &vert2, const Eigen::Vector3f &vert3, float weight)
+    {
+        return (alpha * vert1 + beta * vert2 + gamma * vert3) / weight;
+    }
+
+    inline Eigen::Vector2f interpolate(float alpha, float beta, float gamma, const Eigen::Vector2f &vert1, const Eigen::Vector2f &vert2, const Eigen::Vector2f &vert3, float weight)
+    {
+        auto u = (alpha * vert1[0] + beta * vert2[0] + gamma * vert3[0]);
+        auto v = (alpha * vert1[1] + beta * vert2[1] + gamma * vert3[1]);
+
+        u /= weight;
+        v /= weight;
+
+        return Eigen::Vector2f(u, v);
+    }
+
+    template <unsigned Varyings>
+    void rasterizer::interpolate_varyings(const draw_batch &batch, int index, int x, int y,
+                                          fragment_shader_payload &payload) const
+    {
+        const Triangle &t = batch.triangles[index];
+        float alpha = 0.0;
+        float beta = 0.0;
+        float gamma = 0.0;
+
+        // 边函数是精确的整数，直接求值和光栅化时递推得到的重心坐标完全相同
+        batch.setups[index].barycentric(x, y, alpha, beta, gamma);
+
+        // 插值出三角形内各个像素点的颜色、法向量（归一化）、纹理坐标，
+        // 以及视图变换后、还没有进行透视投影前三角形内的每个像素点的位置
+        if constexpr ((Varyings & varying_color) != 0)
+            payload.color = interpolate(alpha, beta, gamma, t.color[0], t.color[1], t.color[2], 1);
+        if constexpr ((Varyings & varying_normal) != 0)
+            payload.normal = interpolate(alpha, beta, gamma, t.normal[0], t.normal[1], t.normal[2], 1).normalized();
+        if constexpr ((Varyings & varying_tex_coords) != 0)
+            payload.tex_coords = interpolate(alpha, beta, gamma, t.tex_coords[0], t.tex_coords[1], t.tex_coords[2], 1);
+        if constexpr ((Varyings & varying_view_pos) != 0)
+            payload.view_pos = interpolate(alpha, beta, gamma, batch.view_pos[index][0], batch.view_pos[index][1], batch.view_pos[index][2], 1);
+    }
+
+    template <unsigned Varyings>
+    void rasterizer::interpolate_quad(const draw_batch &batch, int index, int x, int y, quad_fragment_payload &quad) const
+    {
+        const Triangle &t = batch.triangles[index];
+        Eigen::Array4f alpha, beta, gamma;
+        for (int k = 0; k < 4; ++k)
+            batch.setups[index].barycentric(x + (k & 1), y + (k >> 1), alpha[k], beta[k], gamma[k]);
+
+        // 四个 lane 同时插值一个分量，运算顺序和 interpolate 相同
+        auto lerp = [&](float a, float b, float c) -> Eigen::Array4f { return alpha * a + beta * b + gamma * c; };
+
+        if constexpr ((Varyings & varying_color) != 0)
+            for (int c = 0; c < 3; ++c)
+            {
+                Eigen::Array4f v = lerp(t.color[0][c], t.color[1][c], t.color[2][c]);
+                for (int k = 0; k < 4; ++k)
+                    quad.lane[k].color[c] = v[k];
+            }
+        if constexpr ((Varyings & varying_normal) != 0)
+        {
+            Eigen::Array4f n[3];
+            for (int c = 0; c < 3; ++c)
+                n[c] = lerp(t.normal[0][c], t.normal[1][c], t.normal[2][c]);
+            // 和 normalized() 一样：长度为 0 时保持不变
+            Eigen::Array4f length2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+            Eigen::Array4f length = (length2 > 0).select(length2.sqrt(), Eigen::Array4f::Ones());
+            for (int c = 0; c < 3; ++c)
+            {
+                n[c] /= length;
+                for (int k = 0; k < 4; ++k)
+                    quad.lane[k].normal[c] = n[c][k];
+            }
+        }
+        if constexpr ((Varyings & varying_tex_coords) != 0)
+            for (int c = 0; c < 2; ++c)
+            {
+                Eigen::Array4f v = lerp(t.tex_coords[0][c], t.tex_coords[1][c], t.tex_coords[2][c]);
+                for (int k = 0; k < 4; ++k)
+                    quad.lane[k].tex_coords[c] = v[k];
+            }
+        if constexpr ((Varyings & varying_view_pos) != 0)
+            for (int c = 0; c < 3; ++c)
+            {
+                const auto &p = batch.view_pos[index];
+                Eigen::Array4f v = lerp(p[0][c], p[1][c], p[2][c]);
+                for (int k = 0; k < 4; ++k)
+                    quad.lane[k].view_pos[c] = v[k];
+            }
+    }
+
+    template <typename Shader>
+    void rasterizer::shade(const draw_batch &batch, const tile_rect &tile, draw_stats &stats, const Shader &shader)
+    {
+        if constexpr (std::is_invocable_v<const Shader &, const quad_fragment_payload &>)
+        {
+            shade_quads(batch, tile, stats, shader);
+        }
+        else
+        {
+            // 没有声明的属性保持为 0
+            fragment_shader_payload payload(Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero(), Eigen::Vector2f::Zero(),
+                                            texture ? &*texture : nullptr);
+            payload.view_pos = Eigen::Vector3f::Zero();
+
+            for (int y = tile.y0; y <= tile.y1; ++y)
+            {
+                for (int x = tile.x0; x <= tile.x1; ++x)
+                {
+                    int index = visibility_buf[get_index(x, y)];
+                    if (index < 0)
+                        continue;
+                    ++stats.shaded;
+                    interpolate_varyings<Shader::varyings>(batch, index, x, y, payload);
+
+                    // 得到这个像素点对应的颜色
+                    set_pixel(Eigen::Vector2i(x, y), shader(payload));
+                }
+            }
+        }
+    }
+
+    template <typename Shader>
+    void rasterizer::shade_quads(const draw_batch &batch, const tile_rect &tile, draw_stats &stats, const Shader &shader)
+    {
+        quad_fragment_payload quad;
+        for (auto &payload : quad.lane)
+        {
+            payload = fragment_shader_payload(Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero(), Eigen::Vector2f::Zero(),
+                                              texture ? &*texture : nullptr);
+            payload.view_pos = Eigen::Vector3f::Zero();
+        }
+
+        // 分块从 tile_size 的整数倍（加 1）开始，块不会跨过分块；屏幕边上不完整的块中，
+        // 屏幕外的 lane 只作为 helper lane
+        for (int y = tile.y0; y <= tile.y1; y += 2)
+        {
+            for (int x = tile.x0; x <= tile.x1; x += 2)
+            {
+                int ids[4];
+                unsigned pending = 0;
+                for (int k = 0; k < 4; ++k)
+                {
+                    int px = x + (k & 1), py = y + (k >> 1);
+                    ids[k] = px <= tile.x1 && py <= tile.y1 ? visibility_buf[get_index(px, py)] : -1;
+                    if (ids[k] >= 0)
+                        pending |= 1u << k;
+                }
+
+                // 块内每个可见的三角形着色一次（三角形的边上块中会有多个三角形）
+                while (pending)
+                {
+                    int index = ids[__builtin_ctz(pending)];
+                    quad.mask = 0;
+                    for (int k = 0; k < 4; ++k)
+                        if (ids[k] == index)
+                            quad.mask |= 1u << k;
+                    pending &= ~quad.mask;
+                    ++stats.quads;
+                    stats.shaded += __builtin_popcount(quad.mask);
+
+                    interpolate_quad<Shader::varyings>(batch, index, x, y, quad);
+
+                    std::array<Eigen::Vector3f, 4> colors = shader(quad);
+                    for (int k = 0; k < 4; ++k)
+                        if (quad.mask & (1u << k))
+                            set_pixel(Eigen::Vector2i(x + (k & 1), y + (k >> 1)), colors[k]);
+                }
+            }
+        }
+    }
 }
@@ -0,0 +1,58 @@
+//
+// Microbenchmark of the ray/triangle test of the Whitted tracer. The inputs
+// are random but generated from a fixed seed, so every run (and every build
+// being compared) times exactly the same work; see MicroBench.hpp for the
+// timing methodology.
+//
+//     ./KernelBench [--reps N] [--warmup N] [--filter NAME]
+//
+#include <random>
+#include <vector>
+#include "MicroBench.hpp"
+#include "Triangle.hpp"
+
+namespace
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+    Vector3f randomVector() { return Vector3f(dist(rng), dist(rng), dist(rng)); }
+
+    struct TriRay
+    {
+        Vector3f v0, v1, v2;
+        Vector3f orig, dir;
+    };
+}
+
+int main(int argc, char **argv)
+{
+    auto options = microbench::parseOptions(argc, argv);
+    const size_t n = 1 << 14;
+
+    // 大约一半的光线打中：光线从随机位置射向三角形重心附近的随机点
+    std::vector<TriRay> inputs;
+    for (size_t i = 0; i < n; ++i)
+    {
+        Vector3f c = randomVector() * 4.0f;
+        Vector3f v0 = c + randomVector(), v1 = c + randomVector(), v2 = c + randomVector();
+        Vector3f orig = randomVector() * 8.0f;
+        Vector3f target = (v0 + v1 + v2) * (1.0f / 3) + randomVector() * 0.5f;
+        inputs.push_back({v0, v1, v2, orig, normalize(target - orig)});
+    }
+
+    microbench::printHeader(options);
+
+    microbench::run(options, "rayTriangleIntersect", n, [&]
+    {
+        int hits = 0;
+        for (const auto &in : inputs)
+        {
+            float t, u, v;
+            hits += rayTriangleIntersect(in.v0, in.v1, in.v2, in.orig, in.dir, t, u, v);
+        }
+        microbench::doNotOptimize(hits);
+    });
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <fstream>
 #include "Vector.hpp"
 #include "Renderer.hpp"
+#include "ImageWriter.hpp"
 #include "Scene.hpp"
 #include <optional>
 
@@ -255,7 +256,7 @@ Vector3f castRay(
 // primary rays and cast these rays into the scene. The content of the framebuffer is
 // saved to a file.
 // [/comment]
-void Renderer::Render(const Scene &scene)
+void Renderer::Render(const Scene &scene, const std::string &filename)
 {
     std::vector<Vector3f> framebuffer(scene.width * scene.height);
 
@@ -293,15 +294,6 @@ void Renderer::Render(const Scene &scene)
     }
 
     // save framebuffer to file
-    FILE *fp = fopen("binary.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i)
-    {
-        static unsigned char color[3];
-        color[0] = (char)(255 * clamp(0, 1, framebuffer[i].x));
-        color[1] = (char)(255 * clamp(0, 1, framebuffer[i].y));
-        color[2] = (char)(255 * clamp(0, 1, framebuffer[i].z));
-        fwrite(color, 1, 3, fp);
-    }
-    fclose(fp);
+    // 并行完成 gamma 校正和量化，整幅图一次写出（后缀为 .pfm 时保存未截断的浮点结果）
+    writeImage(filename, framebuffer, scene.width, scene.height, 1.0f);
 }
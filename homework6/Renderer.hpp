@@ -12,7 +12,7 @@ struct hit_payload
 class Renderer
 {
 public:
-    void Render(const Scene& scene);
+    void Render(const Scene& scene, const std::string& filename = "binary.ppm");
 
 private:
 };
\ No newline at end of file
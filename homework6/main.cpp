@@ -7,8 +7,14 @@
 // In the main function of the program, we create the scene (create objects and lights)
 // as well as set the options for the render (image width and height, maximum recursion
 // depth, field-of-view, etc.). We then call the render function().
-int main()
+int main(int argc, char** argv)
 {
+    // 输出文件，格式由后缀决定（.ppm / .pfm / .png）
+    std::string output = "binary.ppm";
+    for (int i = 1; i + 1 < argc; ++i)
+        if (std::string(argv[i]) == "-o" || std::string(argv[i]) == "--output")
+            output = argv[++i];
+
     // 定义屏幕
     Scene scene(1280, 960);
 
@@ -42,7 +48,7 @@ int main()
 
     // 这里是渲染屏幕
     Renderer r;
-    r.Render(scene);
+    r.Render(scene, output);
 
     return 0;
 }
\ No newline at end of file
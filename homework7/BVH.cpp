@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include "BVH.hpp"
 
 BVHAccel::BVHAccel(std::vector<Object *> p, int maxPrimsInNode,
@@ -15,7 +16,10 @@ BVHAccel::BVHAccel(std::vector<Object *> p, int maxPrimsInNode,
         return;
 
     // 传进去的是一个包含所有物体的数组
+    auto buildStart = std::chrono::steady_clock::now();
     root = recursiveBuild(primitives);
+    bvhBuildNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - buildStart).count();
 
     time(&stop);
     double diff = difftime(stop, start);
@@ -21,6 +21,8 @@ struct BVHPrimitiveInfo;
 
 // BVHAccel Declarations
 inline int leafNodes, totalLeafNodes, totalPrimitives, interiorNodes;
+// 所有 BVH 建树累计花费的时间（纳秒），由 benchmark 报告
+inline std::atomic<int64_t> bvhBuildNanoseconds{0};
 class BVHAccel {
 
 public:
@@ -0,0 +1,179 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sys/resource.h>
+#include "BenchReport.hpp"
+
+namespace bench
+{
+    Report::Entry &Report::find(const std::string &key, Kind kind)
+    {
+        for (auto &e : entries)
+            if (e.key == key)
+                return e;
+        entries.push_back({key, false, 0, "", kind, 0});
+        return entries.back();
+    }
+
+    void Report::set(const std::string &key, double value, Kind kind, double noise)
+    {
+        Entry &e = find(key, kind);
+        e.isNumber = true;
+        e.number = value;
+        e.kind = kind;
+        e.noise = noise;
+    }
+
+    void Report::set(const std::string &key, const std::string &value, Kind kind)
+    {
+        Entry &e = find(key, kind);
+        e.isNumber = false;
+        e.text = value;
+        e.kind = kind;
+    }
+
+    bool Report::write(const std::string &path) const
+    {
+        FILE *f = fopen(path.c_str(), "w");
+        if (!f)
+        {
+            fprintf(stderr, "Cannot write benchmark results to %s\n", path.c_str());
+            return false;
+        }
+        fprintf(f, "{\n");
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            const Entry &e = entries[i];
+            if (e.isNumber)
+                fprintf(f, "  \"%s\": %.6g", e.key.c_str(), e.number);
+            else
+                fprintf(f, "  \"%s\": \"%s\"", e.key.c_str(), e.text.c_str());
+            fprintf(f, i + 1 < entries.size() ? ",\n" : "\n");
+        }
+        fprintf(f, "}\n");
+        fclose(f);
+        printf("Wrote benchmark results to %s\n", path.c_str());
+        return true;
+    }
+
+    namespace
+    {
+        // 只需要读 Report::write 写出的扁平 JSON：在文本中找到 "key": 后面的值
+        bool lookup(const std::string &json, const std::string &key, bool &isNumber, double &number,
+                    std::string &text)
+        {
+            size_t p = json.find("\"" + key + "\"");
+            if (p == std::string::npos)
+                return false;
+            p = json.find(':', p + key.size() + 2);
+            if (p == std::string::npos)
+                return false;
+            p = json.find_first_not_of(" \t\r\n", p + 1);
+            if (p == std::string::npos)
+                return false;
+            if (json[p] == '"')
+            {
+                size_t end = json.find('"', p + 1);
+                if (end == std::string::npos)
+                    return false;
+                isNumber = false;
+                text = json.substr(p + 1, end - p - 1);
+                return true;
+            }
+            char *end = nullptr;
+            number = strtod(json.c_str() + p, &end);
+            isNumber = end != json.c_str() + p;
+            return isNumber;
+        }
+    }
+
+    int Report::compare(const std::string &baselinePath, double thresholdPercent) const
+    {
+        std::ifstream in(baselinePath);
+        if (!in)
+        {
+            printf("No benchmark baseline at %s (store one with the bench-baseline target)\n",
+                   baselinePath.c_str());
+            return -1;
+        }
+        std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        printf("Compared with %s (threshold %.1f%%):\n", baselinePath.c_str(), thresholdPercent);
+        int regressions = 0;
+        bool configDiffers = false;
+        for (const Entry &e : entries)
+        {
+            bool isNumber = false;
+            double base = 0;
+            std::string baseText;
+            if (!lookup(json, e.key, isNumber, base, baseText))
+            {
+                printf("  %-16s %14s -> %14s\n", e.key.c_str(), "(none)",
+                       e.isNumber ? std::to_string(e.number).c_str() : e.text.c_str());
+                continue;
+            }
+
+            if (!e.isNumber || !isNumber)
+            {
+                bool same = !e.isNumber && !isNumber && baseText == e.text;
+                const char *verdict = same ? "" : e.kind == Output ? "  CHANGED" : "  differs";
+                printf("  %-16s %14s -> %14s%s\n", e.key.c_str(), baseText.c_str(), e.text.c_str(), verdict);
+                regressions += !same && e.kind == Output;
+                configDiffers |= !same && e.kind == Config;
+                continue;
+            }
+
+            double change = base != 0 ? 100.0 * (e.number - base) / std::fabs(base) : 0;
+            const char *verdict = "";
+            if (e.kind == Config && e.number != base)
+            {
+                verdict = "  differs";
+                configDiffers = true;
+            }
+            else if (std::fabs(e.number - base) <= e.noise)
+                ;
+            else if ((e.kind == LowerIsBetter && change > thresholdPercent) ||
+                     (e.kind == HigherIsBetter && change < -thresholdPercent) ||
+                     (e.kind == Output && e.number != base))
+            {
+                verdict = "  REGRESSION";
+                ++regressions;
+            }
+            else if ((e.kind == LowerIsBetter && change < -thresholdPercent) ||
+                     (e.kind == HigherIsBetter && change > thresholdPercent))
+                verdict = "  improved";
+            printf("  %-16s %14.6g -> %14.6g %+7.1f%%%s\n", e.key.c_str(), base, e.number, change, verdict);
+        }
+        if (configDiffers)
+            printf("  warning: the baseline was run with a different configuration\n");
+        printf("%d regression(s)\n", regressions);
+        return regressions;
+    }
+
+    std::string hashFile(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return "";
+        uint64_t h = 0xcbf29ce484222325ull;
+        char buffer[1 << 16];
+        while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0)
+        {
+            for (std::streamsize i = 0; i < in.gcount(); ++i)
+                h = (h ^ uint8_t(buffer[i])) * 0x100000001b3ull;
+        }
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", (unsigned long long)h);
+        return text;
+    }
+
+    double peakRssMb()
+    {
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+        return usage.ru_maxrss / 1024.0;
+    }
+}
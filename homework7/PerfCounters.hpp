@@ -0,0 +1,82 @@
+//
+// Hardware performance counters around named phases (Linux perf_event_open).
+//
+// perf::start() opens cycles, instructions, L1D read misses, last-level cache
+// misses and branch misses for the whole process; the counters are inherited by
+// threads created afterwards, and their counts are folded in when those threads
+// exit. A perf::Phase reads the counters when it is created and destroyed and
+// adds the difference to the totals of its name, so a phase that runs every
+// frame accumulates. perf::report() prints IPC and, when a phase was given a
+// unit count (rays, fragments, ...), misses per unit.
+//
+// When perf_event_open is not permitted (perf_event_paranoid, containers,
+// non-Linux) or a counter is not supported by the CPU, start() says so once,
+// the missing counters print as "-" and the phases still report wall time.
+//
+
+#ifndef RAYTRACING_PERFCOUNTERS_H
+#define RAYTRACING_PERFCOUNTERS_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace perf
+{
+    enum Counter
+    {
+        Cycles,
+        Instructions,
+        L1DMisses,
+        LLCMisses,
+        BranchMisses,
+        CounterCount
+    };
+
+    struct Reading
+    {
+        uint64_t value[CounterCount] = {};
+        std::chrono::steady_clock::time_point time;
+    };
+
+    // 由 start() 打开，需要在要统计的线程创建之前调用
+    inline bool active = false;
+
+    // 打开计数器；完全不可用时返回 false（之后仍然统计各阶段的时间）
+    bool start();
+    Reading read();
+    void add(const char *name, const Reading &begin, const Reading &end, uint64_t units, const char *unit);
+    // 打印所有阶段的统计结果并关闭计数器
+    void report();
+
+    class Phase
+    {
+    public:
+        explicit Phase(const char *name) : name(name)
+        {
+            if (active)
+                begin = read();
+        }
+        ~Phase()
+        {
+            if (active)
+                add(name, begin, read(), units, unit);
+        }
+        // 这个阶段处理了多少个单位（光线、片元……），用来计算每个单位的缺失次数
+        void setUnits(uint64_t count, const char *name)
+        {
+            units = count;
+            unit = name;
+        }
+        Phase(const Phase &) = delete;
+        Phase &operator=(const Phase &) = delete;
+
+    private:
+        const char *name;
+        const char *unit = nullptr;
+        uint64_t units = 0;
+        Reading begin;
+    };
+}
+
+#endif //RAYTRACING_PERFCOUNTERS_H
@@ -5,6 +5,10 @@
 #include <fstream>
 #include "Scene.hpp"
 #include "Renderer.hpp"
+#include "ImageWriter.hpp"
+#include "MemoryStats.hpp"
+#include "PerfCounters.hpp"
+#include "Trace.hpp"
 
 
 inline float deg2rad(const float& deg) { return deg * M_PI / 180.0; }
@@ -14,8 +18,10 @@ const float EPSILON = 0.00001;
 // The main render function. This where we iterate over all pixels in the image,
 // generate primary rays and cast these rays into the scene. The content of the
 // framebuffer is saved to a file.
-void Renderer::Render(const Scene& scene)
+void Renderer::Render(const Scene& scene, const std::string& filename)
 {
+    // framebuffer 和输出时的缓冲区
+    mem::Scope memoryScope(mem::Framebuffer);
     std::vector<Vector3f> framebuffer(scene.width * scene.height);
 
     float scale = tan(deg2rad(scene.fov * 0.5));
@@ -24,8 +30,13 @@ void Renderer::Render(const Scene& scene)
     // 相机位置不在原点了，为什么还是能那么取？？？
     Vector3f eye_pos(-1, 5, 10);
     
+    TRACE_ZONE("Render frame");
+    auto renderPhase = std::make_unique<perf::Phase>("Render");
+    renderPhase->setUnits(uint64_t(scene.width) * scene.height, "camera ray");
     int m = 0;
     for (uint32_t j = 0; j < scene.height; ++j) {
+        // 单线程逐行渲染，每一行记为一段
+        TRACE_ZONE("Row", (long long)j);
         for (uint32_t i = 0; i < scene.width; ++i) {
             // generate primary ray direction
             float x = (2 * (i + 0.5) / (float)scene.width - 1) * imageAspectRatio * scale;
@@ -41,16 +52,12 @@ void Renderer::Render(const Scene& scene)
         UpdateProgress(j / (float)scene.height);
     }
     UpdateProgress(1.f);
+    renderPhase.reset();
 
     // save framebuffer to file
-    FILE* fp = fopen("binary.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i) {
-        static unsigned char color[3];
-        color[0] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].x));
-        color[1] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].y));
-        color[2] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].z));
-        fwrite(color, 1, 3, fp);
-    }
-    fclose(fp);    
+    // 并行完成 gamma 校正和量化，整幅图一次写出（后缀为 .pfm 时保存未截断的浮点结果）
+    TRACE_ZONE("Tone map + write", filename);
+    perf::Phase phase("Tone map + write");
+    phase.setUnits(uint64_t(scene.width) * scene.height, "pixel");
+    writeImage(filename, framebuffer, scene.width, scene.height, 1.0f);
 }
@@ -3,11 +3,15 @@
 //
 
 #include "Scene.hpp"
+#include "MemoryStats.hpp"
+#include "Trace.hpp"
 
 void Scene::buildBVH()
 {
+    TRACE_ZONE("Scene BVH build");
     printf(" - Generating BVH...\n\n");
     // 创建BVH结构
+    mem::Scope scope(mem::BVH);
     this->bvh = new BVHAccel(objects, 1, BVHAccel::SplitMethod::NAIVE);
 }
 
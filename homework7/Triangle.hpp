@@ -3,8 +3,10 @@
 #include "BVH.hpp"
 #include "Intersection.hpp"
 #include "Material.hpp"
+#include "MemoryStats.hpp"
 #include "OBJ_Loader.hpp"
 #include "Object.hpp"
+#include "Trace.hpp"
 #include "Triangle.hpp"
 #include <cassert>
 #include <array>
@@ -78,8 +80,12 @@ class MeshTriangle : public Object
 public:
     MeshTriangle(const std::string &filename)
     {
+        mem::Scope loading(mem::Loader);
         objl::Loader loader;
-        loader.LoadFile(filename);
+        {
+            TRACE_ZONE("OBJ load", filename);
+            loader.LoadFileFast(filename);
+        }
 
         assert(loader.LoadedMeshes.size() == 1);
         auto mesh = loader.LoadedMeshes[0];
@@ -93,6 +99,7 @@ public:
 
         for (int i = 0; i < mesh.Vertices.size(); i += 3)
         {
+            mem::Scope geometry(mem::Geometry);
             std::array<Vector3f, 3> face_vertices;
             for (int j = 0; j < 3; j++)
             {
@@ -118,6 +125,7 @@ public:
         // 一个三角形组成的模型初始化为一个包围盒！
         bounding_box = Bounds3(min_vert, max_vert);
 
+        mem::Scope scope(mem::BVH);
         std::vector<Object *> ptrs;
 
         // 将所有的三角形都放入这里面中
@@ -126,6 +134,7 @@ public:
             ptrs.push_back(&tri);
 
         // 我觉得这一步才是最慢的！
+        TRACE_ZONE("Mesh BVH build", filename);
         bvh = new BVHAccel(ptrs);
     }
 
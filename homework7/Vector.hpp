@@ -27,8 +27,8 @@ public:
     { return Vector3f(v.x * r, v.y * r, v.z * r); }
     friend std::ostream & operator << (std::ostream &os, const Vector3f &v)
     { return os << v.x << ", " << v.y << ", " << v.z; }
-    double       operator[](int index) const;
-    double&      operator[](int index);
+    float        operator[](int index) const;
+    float&       operator[](int index);
 
     // 取两个点的x，y，z中较小的值组成一个新的点
     static Vector3f Min(const Vector3f &p1, const Vector3f &p2) {
@@ -41,7 +41,10 @@ public:
                        std::max(p1.z, p2.z));
     }
 };
-inline double Vector3f::operator[](int index) const {
+inline float Vector3f::operator[](int index) const {
+    return (&x)[index];
+}
+inline float& Vector3f::operator[](int index) {
     return (&x)[index];
 }
 
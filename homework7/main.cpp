@@ -1,4 +1,8 @@
+#include "BenchReport.hpp"
+#include "MemoryStats.hpp"
+#include "PerfCounters.hpp"
 #include "Renderer.hpp"
+#include "Trace.hpp"
 #include "Scene.hpp"
 #include "Triangle.hpp"
 #include "Vector.hpp"
@@ -11,8 +15,34 @@
 // function().
 int main(int argc, char** argv)
 {
+    // 输出文件，格式由后缀决定（.ppm / .pfm / .png）
+    std::string output = "binary.ppm";
+    std::string benchFile, baselineFile;
+    double threshold = 5;
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((std::string(argv[i]) == "-o" || std::string(argv[i]) == "--output") && i + 1 < argc)
+            output = argv[++i];
+        // 把载入、建 BVH、逐行渲染和写图的时间线写成 Chrome trace-event JSON
+        else if (std::string(argv[i]) == "--trace" && i + 1 < argc)
+            trace::start(argv[++i]);
+        // 用硬件计数器统计载入、渲染和写图各阶段的 IPC 和缓存缺失
+        else if (std::string(argv[i]) == "--perf")
+            perf::start();
+        // 把这次运行的耗时、吞吐量、内存和输出图像的 hash 写成 JSON（见 BenchReport.hpp）
+        else if (std::string(argv[i]) == "--bench" && i + 1 < argc)
+            benchFile = argv[++i];
+        // 和之前保存的结果比较，变差超过 --threshold 百分比时返回非 0
+        else if (std::string(argv[i]) == "--baseline" && i + 1 < argc)
+            baselineFile = argv[++i];
+        else if (std::string(argv[i]) == "--threshold" && i + 1 < argc)
+            threshold = std::atof(argv[++i]);
+    }
+
     Scene scene(1280, 960);
 
+    auto setupStart = std::chrono::steady_clock::now();
+    auto setupPhase = std::make_unique<perf::Phase>("Scene load + BVH build");
     MeshTriangle bunny("../models/bunny/bunny.obj");
 
     // 得到兔子对应的所有三角形
@@ -21,17 +51,43 @@ int main(int argc, char** argv)
     scene.Add(std::make_unique<Light>(Vector3f(-20, 70, 20), 3000));
     scene.Add(std::make_unique<Light>(Vector3f(20, 70, 20), 3000));
     scene.buildBVH();
+    setupPhase.reset();
+    double setupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setupStart).count();
 
     Renderer r;
 
     auto start = std::chrono::system_clock::now();
-    r.Render(scene);
+    auto renderStart = std::chrono::steady_clock::now();
+    r.Render(scene, output);
     auto stop = std::chrono::system_clock::now();
+    double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+    trace::stop();
+    perf::report();
+    mem::report();
+
+    int status = 0;
+    if (!benchFile.empty())
+    {
+        bench::Report report;
+        report.set("scene", "bunny", bench::Config);
+        report.set("width", scene.width, bench::Config);
+        report.set("height", scene.height, bench::Config);
+        report.set("setup_ms", setupMs, bench::LowerIsBetter, 1);
+        report.set("bvh_build_ms", bvhBuildNanoseconds * 1e-6, bench::LowerIsBetter, 1);
+        report.set("render_ms", renderMs, bench::LowerIsBetter, 1);
+        // 只统计相机光线（每个像素一条），反射、折射和阴影光线的数量和场景有关
+        report.set("mrays_per_s", double(scene.width) * scene.height / (renderMs * 1e3), bench::HigherIsBetter);
+        report.set("peak_rss_mb", bench::peakRssMb(), bench::LowerIsBetter, 1);
+        report.set("image_hash", bench::hashFile(output), bench::Output);
+        report.write(benchFile);
+        if (!baselineFile.empty() && report.compare(baselineFile, threshold) > 0)
+            status = 1;
+    }
 
     std::cout << "Render complete: \n";
     std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::hours>(stop - start).count() << " hours\n";
     std::cout << "          : " << std::chrono::duration_cast<std::chrono::minutes>(stop - start).count() << " minutes\n";
     std::cout << "          : " << std::chrono::duration_cast<std::chrono::seconds>(stop - start).count() << " seconds\n";
 
-    return 0;
+    return status;
 }
\ No newline at end of file
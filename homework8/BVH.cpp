@@ -1,6 +1,17 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <thread>
 #include "BVH.hpp"
+#include "RayStats.hpp"
+
+static void addBuildTime(std::chrono::steady_clock::time_point start)
+{
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    bvhBuildNanoseconds.fetch_add(ns.count(), std::memory_order_relaxed);
+}
 
 BVHAccel::BVHAccel(std::vector<Object *> p, int maxPrimsInNode, SplitMethod splitMethod)
     : maxPrimsInNode(std::min(255, maxPrimsInNode)), splitMethod(splitMethod), primitives(std::move(p))
@@ -9,7 +20,9 @@ BVHAccel::BVHAccel(std::vector<Object *> p, int maxPrimsInNode, SplitMethod spli
     time(&start);
     if (primitives.empty())
         return;
-    root = recursiveBuild(primitives);
+    auto buildStart = std::chrono::steady_clock::now();
+    root = splitMethod == SplitMethod::LBVH ? buildLBVH() : recursiveBuild(primitives);
+    addBuildTime(buildStart);
     time(&stop);
 
     double diff = difftime(stop, start);
@@ -20,6 +33,12 @@ BVHAccel::BVHAccel(std::vector<Object *> p, int maxPrimsInNode, SplitMethod spli
     printf("\rBVH Generation complete: \nTime Taken: %i hrs, %i mins, %i secs\n\n", hrs, mins, secs);
 }
 
+BVHAccel::BVHAccel(std::vector<Object *> p, BVHBuildNode *prebuiltRoot, const CompressedBVHNode *nodes, size_t nodeCount)
+    : root(prebuiltRoot), maxPrimsInNode(1), splitMethod(SplitMethod::NAIVE), primitives(std::move(p))
+{
+    compressed = std::make_unique<CompressedBVH>(nodes, nodeCount, primitives);
+}
+
 BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects)
 {
     BVHBuildNode *node = new BVHBuildNode();
@@ -108,9 +127,444 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects)
     return node;
 }
 
+BVHAccel::~BVHAccel()
+{
+    releaseBuildTree();
+}
+
+static void deleteTree(BVHBuildNode *node)
+{
+    if (!node)
+        return;
+    deleteTree(node->left);
+    deleteTree(node->right);
+    delete node;
+}
+
+static size_t countNodes(const BVHBuildNode *node)
+{
+    return node ? 1 + countNodes(node->left) + countNodes(node->right) : 0;
+}
+
+void BVHAccel::compress()
+{
+    auto start = std::chrono::steady_clock::now();
+    compressed = std::make_unique<CompressedBVH>(root, primitives);
+    addBuildTime(start);
+}
+
+void BVHAccel::releaseBuildTree()
+{
+    deleteTree(root);
+    root = nullptr;
+}
+
+size_t BVHAccel::buildTreeBytes() const
+{
+    return countNodes(root) * sizeof(BVHBuildNode);
+}
+
+void BVHAccel::printMemoryReport(const char *name, size_t geometryBytes) const
+{
+    double tris = std::max<size_t>(1, primitives.size());
+    size_t binary = buildTreeBytes();
+    size_t packed = compressed ? compressed->memoryBytes() : 0;
+    printf("BVH memory [%s]: %zu prims, geometry %.1f B/prim | binary %zu nodes %.1f B/prim"
+           " | compressed %zu nodes %.1f B/prim\n",
+           name, primitives.size(), geometryBytes / tris,
+           countNodes(root), binary / tris,
+           compressed ? compressed->nodeCount() : 0, packed / tris);
+}
+
+// ---------------------------------------------------------------------------
+// Treelet restructuring (Karras & Aila, "Fast Parallel Construction of
+// High-Quality Bounding Volume Hierarchies"): for every node, take the treelet
+// of its 7 largest descendants and rebuild it with the partition of minimal SAH
+// cost, found by dynamic programming over all subsets of the treelet leaves.
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    const float kTraversalCost = 1.2f;
+    const float kIntersectCost = 1.0f;
+
+    inline bool isLeaf(const BVHBuildNode *node) { return !node->left && !node->right; }
+
+    float updateCost(BVHBuildNode *node)
+    {
+        float sa = node->bounds.SurfaceArea();
+        if (isLeaf(node))
+            node->cost = kIntersectCost * sa;
+        else
+            node->cost = kTraversalCost * sa + node->left->cost + node->right->cost;
+        return node->cost;
+    }
+
+    float computeCosts(BVHBuildNode *node)
+    {
+        if (!isLeaf(node))
+        {
+            computeCosts(node->left);
+            computeCosts(node->right);
+        }
+        return updateCost(node);
+    }
+
+    void restructureTreelet(BVHBuildNode *root, int treeletSize)
+    {
+        // 从根的两个子节点出发，不断展开表面积最大的内部结点，得到 treelet 的叶子
+        std::vector<BVHBuildNode *> leaves{root->left, root->right};
+        std::vector<BVHBuildNode *> internals{root};
+        while ((int)leaves.size() < treeletSize)
+        {
+            int best = -1;
+            double bestArea = -1;
+            for (int i = 0; i < (int)leaves.size(); ++i)
+                if (!isLeaf(leaves[i]) && leaves[i]->bounds.SurfaceArea() > bestArea)
+                {
+                    best = i;
+                    bestArea = leaves[i]->bounds.SurfaceArea();
+                }
+            if (best < 0)
+                break;
+            BVHBuildNode *expand = leaves[best];
+            internals.push_back(expand);
+            leaves[best] = expand->left;
+            leaves.push_back(expand->right);
+        }
+
+        int n = leaves.size();
+        if (n < 3)
+            return;
+
+        int full = (1 << n) - 1;
+        std::vector<float> cost(1 << n), area(1 << n);
+        std::vector<int> split(1 << n, 0);
+        for (int s = 1; s <= full; ++s)
+        {
+            Bounds3 b;
+            for (int i = 0; i < n; ++i)
+                if (s & (1 << i))
+                    b = Union(b, leaves[i]->bounds);
+            area[s] = b.SurfaceArea();
+        }
+        for (int i = 0; i < n; ++i)
+            cost[1 << i] = leaves[i]->cost;
+
+        // 按子集大小从小到大求每个子集的最优划分
+        for (int size = 2; size <= n; ++size)
+            for (int s = 1; s <= full; ++s)
+            {
+                if (__builtin_popcount(s) != size)
+                    continue;
+                int lowest = s & -s;
+                float best = std::numeric_limits<float>::max();
+                // 只枚举包含最低位的子集，避免 (P, S\P) 和 (S\P, P) 重复
+                for (int p = (s - 1) & s; p > 0; p = (p - 1) & s)
+                {
+                    if (!(p & lowest))
+                        continue;
+                    float c = cost[p] + cost[s ^ p];
+                    if (c < best)
+                    {
+                        best = c;
+                        split[s] = p;
+                    }
+                }
+                cost[s] = kTraversalCost * area[s] + best;
+            }
+
+        if (cost[full] >= root->cost * (1 - 1e-6f))
+            return;
+
+        // 重新连接 treelet，内部结点直接复用（根结点保持不变，父结点的指针不用改）
+        int nextInternal = 1;
+        std::function<BVHBuildNode *(int, BVHBuildNode *)> rebuild = [&](int s, BVHBuildNode *node) -> BVHBuildNode *
+        {
+            if (__builtin_popcount(s) == 1)
+                return leaves[__builtin_ctz(s)];
+            if (!node)
+                node = internals[nextInternal++];
+            node->left = rebuild(split[s], nullptr);
+            node->right = rebuild(s ^ split[s], nullptr);
+            node->bounds = Union(node->left->bounds, node->right->bounds);
+            node->area = node->left->area + node->right->area;
+            updateCost(node);
+            return node;
+        };
+        rebuild(full, root);
+    }
+
+    // 后序遍历：先优化子树，再优化以 node 为根的 treelet；靠近根的几层并行
+    void optimizeSubtree(BVHBuildNode *node, int treeletSize, int parallelDepth)
+    {
+        if (isLeaf(node))
+            return;
+        if (parallelDepth > 0)
+        {
+            auto left = std::async(std::launch::async, optimizeSubtree, node->left, treeletSize, parallelDepth - 1);
+            optimizeSubtree(node->right, treeletSize, parallelDepth - 1);
+            left.get();
+        }
+        else
+        {
+            optimizeSubtree(node->left, treeletSize, 0);
+            optimizeSubtree(node->right, treeletSize, 0);
+        }
+        updateCost(node);
+        restructureTreelet(node, treeletSize);
+        updateCost(node);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Refit and linear BVH (Lauterbach et al. 2009, Karras 2012) for animated
+// scenes.
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    struct MortonPrimitive
+    {
+        uint32_t code;
+        uint32_t index;
+    };
+
+    // 把 10 位整数的每一位之间插入两个 0
+    inline uint32_t leftShift3(uint32_t x)
+    {
+        if (x == (1 << 10))
+            --x;
+        x = (x | (x << 16)) & 0b00000011000000000000000011111111;
+        x = (x | (x << 8)) & 0b00000011000000001111000000001111;
+        x = (x | (x << 4)) & 0b00000011000011000011000011000011;
+        x = (x | (x << 2)) & 0b00001001001001001001001001001001;
+        return x;
+    }
+
+    inline uint32_t encodeMorton3(const Vector3f &v)
+    {
+        return (leftShift3(uint32_t(v.z)) << 2) | (leftShift3(uint32_t(v.y)) << 1) | leftShift3(uint32_t(v.x));
+    }
+
+    // 在 [0, n) 上把 f(begin, end, thread) 分给若干个线程执行
+    template <typename F>
+    void parallelChunks(size_t n, int threads, F &&f)
+    {
+        std::vector<std::thread> workers;
+        size_t chunk = (n + threads - 1) / threads;
+        for (int t = 0; t < threads; ++t)
+        {
+            size_t begin = std::min(n, t * chunk), end = std::min(n, begin + chunk);
+            workers.emplace_back(f, begin, end, t);
+        }
+        for (auto &w : workers)
+            w.join();
+    }
+
+    // LSD 基数排序，每遍 8 位；每个线程先统计自己那一段的直方图，再按前缀和分散写入
+    void radixSort(std::vector<MortonPrimitive> &v, int threads)
+    {
+        const int bitsPerPass = 8, buckets = 1 << bitsPerPass;
+        std::vector<MortonPrimitive> tmp(v.size());
+        std::vector<size_t> counts(threads * buckets);
+
+        for (int shift = 0; shift < 30; shift += bitsPerPass)
+        {
+            std::fill(counts.begin(), counts.end(), 0);
+            parallelChunks(v.size(), threads, [&](size_t begin, size_t end, int t)
+            {
+                for (size_t i = begin; i < end; ++i)
+                    ++counts[t * buckets + ((v[i].code >> shift) & (buckets - 1))];
+            });
+
+            size_t offset = 0;
+            for (int b = 0; b < buckets; ++b)
+                for (int t = 0; t < threads; ++t)
+                {
+                    size_t c = counts[t * buckets + b];
+                    counts[t * buckets + b] = offset;
+                    offset += c;
+                }
+
+            parallelChunks(v.size(), threads, [&](size_t begin, size_t end, int t)
+            {
+                for (size_t i = begin; i < end; ++i)
+                    tmp[counts[t * buckets + ((v[i].code >> shift) & (buckets - 1))]++] = v[i];
+            });
+            std::swap(v, tmp);
+        }
+    }
+
+    BVHBuildNode *emitLBVH(const MortonPrimitive *mp, int n, int bitIndex,
+                           const std::vector<Object *> &primitives, int parallelDepth)
+    {
+        BVHBuildNode *node = new BVHBuildNode();
+        if (n == 1)
+        {
+            Object *object = primitives[mp[0].index];
+            node->bounds = object->getBounds();
+            node->object = object;
+            node->area = object->getArea();
+            return node;
+        }
+
+        // 找到这一段 Morton 码第一个不同的位，按该位划分；全部相同时从中间切开
+        int split = n / 2;
+        for (; bitIndex >= 0; --bitIndex)
+        {
+            uint32_t mask = 1u << bitIndex;
+            if ((mp[0].code & mask) == (mp[n - 1].code & mask))
+                continue;
+            split = std::partition_point(mp, mp + n, [mask](const MortonPrimitive &p)
+                                         { return !(p.code & mask); }) - mp;
+            break;
+        }
+
+        if (parallelDepth > 0 && n > 4096)
+        {
+            auto left = std::async(std::launch::async, emitLBVH, mp, split, bitIndex - 1,
+                                   std::cref(primitives), parallelDepth - 1);
+            node->right = emitLBVH(mp + split, n - split, bitIndex - 1, primitives, parallelDepth - 1);
+            node->left = left.get();
+        }
+        else
+        {
+            node->left = emitLBVH(mp, split, bitIndex - 1, primitives, 0);
+            node->right = emitLBVH(mp + split, n - split, bitIndex - 1, primitives, 0);
+        }
+        node->bounds = Union(node->left->bounds, node->right->bounds);
+        node->area = node->left->area + node->right->area;
+        return node;
+    }
+
+    void refitNode(BVHBuildNode *node)
+    {
+        if (isLeaf(node))
+        {
+            node->bounds = node->object->getBounds();
+            node->area = node->object->getArea();
+            return;
+        }
+        refitNode(node->left);
+        refitNode(node->right);
+        node->bounds = Union(node->left->bounds, node->right->bounds);
+        node->area = node->left->area + node->right->area;
+    }
+
+    int hardwareThreads()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+BVHBuildNode *BVHAccel::buildLBVH()
+{
+    if (primitives.empty())
+        return nullptr;
+
+    int threads = std::min<int>(hardwareThreads(), primitives.size() / 1024 + 1);
+
+    // 用图元中心的包围盒把坐标归一化到 [0, 1024)
+    Bounds3 centroidBounds;
+    for (auto *object : primitives)
+        centroidBounds = Union(centroidBounds, object->getBounds().Centroid());
+
+    std::vector<MortonPrimitive> morton(primitives.size());
+    parallelChunks(primitives.size(), threads, [&](size_t begin, size_t end, int)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            Vector3f p = centroidBounds.Offset(primitives[i]->getBounds().Centroid()) * 1024.0f;
+            morton[i] = {encodeMorton3(p), uint32_t(i)};
+        }
+    });
+
+    radixSort(morton, threads);
+
+    int parallelDepth = 0;
+    while ((1 << parallelDepth) < threads)
+        ++parallelDepth;
+    return emitLBVH(morton.data(), morton.size(), 29, primitives, parallelDepth);
+}
+
+void BVHAccel::refit()
+{
+    if (!root)
+        return;
+    refitNode(root);
+    if (compressed)
+        compress();
+}
+
+void BVHAccel::rebuildLBVH()
+{
+    releaseBuildTree();
+    root = buildLBVH();
+    referenceSahCost = sahCost();
+    if (compressed)
+        compress();
+}
+
+bool BVHAccel::update(float maxDegradation)
+{
+    // 二叉树已经释放（静态模型）时只能重建
+    if (!root)
+    {
+        rebuildLBVH();
+        return true;
+    }
+    if (referenceSahCost < 0)
+        referenceSahCost = sahCost();
+
+    refitNode(root);
+    if (sahCost() > referenceSahCost * maxDegradation)
+    {
+        rebuildLBVH();
+        return true;
+    }
+    if (compressed)
+        compress();
+    return false;
+}
+
+double BVHAccel::sahCost() const
+{
+    if (!root)
+        return 0;
+    return computeCosts(root) / root->bounds.SurfaceArea();
+}
+
+void BVHAccel::optimizeTreelets(int treeletSize, int rounds)
+{
+    if (!root || isLeaf(root))
+        return;
+    treeletSize = std::clamp(treeletSize, 3, 12);
+
+    auto start = std::chrono::steady_clock::now();
+    double before = sahCost();
+
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int parallelDepth = 0;
+    while ((1 << parallelDepth) < threads)
+        ++parallelDepth;
+
+    for (int r = 0; r < rounds; ++r)
+        optimizeSubtree(root, treeletSize, parallelDepth);
+
+    double after = sahCost();
+    auto stop = std::chrono::steady_clock::now();
+    addBuildTime(start);
+    printf("Treelet optimization: SAH cost %.2f -> %.2f (%.1f%%), %d rounds in %.1f ms\n",
+           before, after, 100.0 * (after - before) / before, rounds,
+           std::chrono::duration<double, std::milli>(stop - start).count());
+}
+
 Intersection BVHAccel::Intersect(const Ray &ray) const
 {
     Intersection isect;
+    if (compressed)
+        return compressed->Intersect(ray);
     if (!root)
         return isect;
     isect = BVHAccel::getIntersection(root, ray);
@@ -127,6 +581,8 @@ Intersection BVHAccel::getIntersection(BVHBuildNode *node, const Ray &ray) const
     {
         return intersect;
     }
+    RT_STAT(nodesVisited);
+    RT_STAT(boxTests);
 
     Vector3f invdir(1. / ray.direction.x, 1. / ray.direction.y, 1. / ray.direction.z);
 
@@ -14,6 +14,7 @@
 #include "Bounds3.hpp"
 #include "Intersection.hpp"
 #include "Vector.hpp"
+#include "CompressedBVH.hpp"
 
 struct BVHBuildNode;
 // BVHAccel Forward Declarations
@@ -21,14 +22,22 @@ struct BVHPrimitiveInfo;
 
 // BVHAccel Declarations
 inline int leafNodes, totalLeafNodes, totalPrimitives, interiorNodes;
+// treelet 优化时每个 treelet 的叶子数，0 表示不做优化（由 main 的 --trbvh 打开）
+inline int bvhTreeletSize = 0;
+// 每个模型建完 BVH 后打印各种结点的内存占用（由 main 的 --bvh-stats 打开，需要遍历整棵树）
+inline bool bvhStats = false;
+// 所有 BVH 建树、treelet 优化和压缩累计花费的时间（纳秒，各线程相加），由 benchmark 报告
+inline std::atomic<int64_t> bvhBuildNanoseconds{0};
 class BVHAccel {
 
 public:
     // BVHAccel Public Types
-    enum class SplitMethod { NAIVE, SAH };
+    enum class SplitMethod { NAIVE, SAH, LBVH };
 
     // BVHAccel Public Methods
     BVHAccel(std::vector<Object*> p, int maxPrimsInNode = 1, SplitMethod splitMethod = SplitMethod::NAIVE);
+    // 用已经建好的树构造（场景缓存），不再建树；prebuiltRoot 可以为空，nodes 指向外部内存
+    BVHAccel(std::vector<Object*> p, BVHBuildNode* prebuiltRoot, const CompressedBVHNode* nodes, size_t nodeCount);
     Bounds3 WorldBound() const;
     ~BVHAccel();
 
@@ -37,15 +46,39 @@ public:
     bool IntersectP(const Ray &ray) const;
 
     // 存放BVH加速结构的根结点
-    BVHBuildNode* root;
+    BVHBuildNode* root = nullptr;
+
+    // 压缩后的 4 叉 BVH，建立之后求交都走这里
+    std::unique_ptr<CompressedBVH> compressed;
+    void compress();
+    // 建树之后按 SAH 重新排列小的 treelet（TRBVH），rounds 为整棵树处理的遍数
+    void optimizeTreelets(int treeletSize = 7, int rounds = 3);
+    // 整棵树的 SAH 代价（按根结点表面积归一化）
+    double sahCost() const;
+
+    // 动画场景每帧调用：图元移动之后自底向上更新包围盒（refit）；
+    // 如果 refit 之后 SAH 代价比建树时变差超过 maxDegradation 倍，就用 LBVH 重建
+    // 返回 true 表示这一帧重建了
+    bool update(float maxDegradation = 1.5f);
+    void refit();
+    void rebuildLBVH();
+
+    // 释放二叉树（只用于求交、不需要采样的模型）
+    void releaseBuildTree();
+    size_t buildTreeBytes() const;
+    void printMemoryReport(const char* name, size_t geometryBytes) const;
 
     // BVHAccel Private Methods
     BVHBuildNode* recursiveBuild(std::vector<Object*>objects);
+    // Morton 码 + 并行基数排序的线性 BVH（LBVH）
+    BVHBuildNode* buildLBVH();
 
     // BVHAccel Private Data
     const int maxPrimsInNode;
     const SplitMethod splitMethod;
     std::vector<Object*> primitives;
+    // 建树（或上一次重建）时的 SAH 代价，用来判断 refit 之后质量下降了多少
+    double referenceSahCost = -1;
 
     void getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf);
     void Sample(Intersection &pos, float &pdf);
@@ -57,6 +90,7 @@ struct BVHBuildNode {
     BVHBuildNode *right;
     Object* object;
     float area;
+    float cost = 0; // 以该结点为根的子树的 SAH 代价（未归一化）
 
 public:
     int splitAxis=0, firstPrimOffset=0, nPrimitives=0;
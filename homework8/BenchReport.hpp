@@ -0,0 +1,64 @@
+//
+// End-to-end benchmark results as flat JSON, and comparison with a baseline.
+//
+// main fills a bench::Report while it runs with --bench FILE (wall times,
+// throughput, BVH build time, peak RSS, a hash of the written image) and
+// writes it out. With --baseline FILE the report is compared with an earlier
+// one: a timing that got slower, or a throughput that dropped, by more than
+// the threshold counts as a regression, and so does a different image hash
+// (the render is deterministic for a fixed seed). Configuration values
+// (resolution, spp, ...) are only checked for equality so that results from
+// different settings are not compared silently.
+//
+
+#ifndef RAYTRACING_BENCHREPORT_H
+#define RAYTRACING_BENCHREPORT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+    enum Kind
+    {
+        Config,          // 配置，比较时要求相同
+        LowerIsBetter,   // 时间、内存
+        HigherIsBetter,  // 吞吐量
+        Output           // 输出结果（图像 hash），不同时算退化
+    };
+
+    class Report
+    {
+    public:
+        // 变化的绝对值不超过 noise 时不算退化或改进（例如只有几毫秒的阶段）
+        void set(const std::string &key, double value, Kind kind, double noise = 0);
+        void set(const std::string &key, const std::string &value, Kind kind);
+
+        bool write(const std::string &path) const;
+        // 和 baselinePath 中的结果比较并打印每一项的变化，返回退化的项数；
+        // 基准文件不存在或无法解析时返回 -1
+        int compare(const std::string &baselinePath, double thresholdPercent) const;
+
+    private:
+        struct Entry
+        {
+            std::string key;
+            bool isNumber;
+            double number;
+            std::string text;
+            Kind kind;
+            double noise;
+        };
+        std::vector<Entry> entries;
+
+        Entry &find(const std::string &key, Kind kind);
+    };
+
+    // 文件内容的 FNV-1a hash（16 位十六进制），文件不存在时返回空串
+    std::string hashFile(const std::string &path);
+    // 进程（多进程渲染时为最大的那个子进程）的峰值常驻内存（MB）
+    double peakRssMb();
+}
+
+#endif //RAYTRACING_BENCHREPORT_H
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include "BVH.hpp"
+#include "CompressedBVH.hpp"
+#include "RayStats.hpp"
+
+namespace
+{
+    // 2^e，直接拼出浮点数的指数位，避免遍历时调用 ldexp
+    inline float exp2i(int e)
+    {
+        uint32_t bits = uint32_t(e + 127) << 23;
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    // 找到最小的 e 使得 origin + 255 * 2^e 仍然不小于 hi
+    int chooseExponent(float lo, float hi)
+    {
+        float extent = hi - lo;
+        int e = -126;
+        if (extent > 0)
+        {
+            int k;
+            std::frexp(extent / 255.0f, &k);
+            e = std::max(-126, k);
+        }
+        while (e < 127 && lo + 255.0f * exp2i(e) < hi)
+            ++e;
+        return e;
+    }
+
+    inline bool slab(const Bounds3 &b, const Ray &ray, float &tEnter)
+    {
+        float tx1 = (b.pMin.x - ray.origin.x) * ray.direction_inv.x;
+        float tx2 = (b.pMax.x - ray.origin.x) * ray.direction_inv.x;
+        float ty1 = (b.pMin.y - ray.origin.y) * ray.direction_inv.y;
+        float ty2 = (b.pMax.y - ray.origin.y) * ray.direction_inv.y;
+        float tz1 = (b.pMin.z - ray.origin.z) * ray.direction_inv.z;
+        float tz2 = (b.pMax.z - ray.origin.z) * ray.direction_inv.z;
+
+        tEnter = std::max(std::min(tx1, tx2), std::max(std::min(ty1, ty2), std::min(tz1, tz2)));
+        float tExit = std::min(std::max(tx1, tx2), std::min(std::max(ty1, ty2), std::max(tz1, tz2)));
+        return tEnter <= tExit && tExit > 0;
+    }
+}
+
+Bounds3 CompressedBVHNode::childBounds(int i) const
+{
+    float lo[3], hi[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        float s = exp2i(exponent[a]);
+        lo[a] = origin[a] + qlo[a][i] * s;
+        hi[a] = origin[a] + qhi[a][i] * s;
+    }
+    Bounds3 b;
+    b.pMin = Vector3f(lo[0], lo[1], lo[2]);
+    b.pMax = Vector3f(hi[0], hi[1], hi[2]);
+    return b;
+}
+
+CompressedBVH::CompressedBVH(BVHBuildNode *root, const std::vector<Object *> &p)
+    : primitives(p)
+{
+    if (!root)
+        return;
+
+    primIndex.reserve(primitives.size());
+    for (uint32_t i = 0; i < primitives.size(); ++i)
+        primIndex.emplace_back(primitives[i], i);
+    std::sort(primIndex.begin(), primIndex.end());
+
+    // 二叉树最多有 2n-1 个结点，4 叉后大约减少到 1/3
+    nodes.reserve(primitives.size() / 2 + 1);
+
+    if (!root->left && !root->right)
+    {
+        // 整棵树只有一个图元时，用一个只有一个子节点的结点包住它
+        BVHBuildNode wrapper;
+        wrapper.bounds = root->bounds;
+        wrapper.left = root;
+        emitNode(&wrapper);
+    }
+    else
+        emitNode(root);
+    primIndex.clear();
+    primIndex.shrink_to_fit();
+
+    nodeData = nodes.data();
+    count = nodes.size();
+    computeStackSize();
+}
+
+CompressedBVH::CompressedBVH(const CompressedBVHNode *external, size_t n, const std::vector<Object *> &p)
+    : primitives(p), nodeData(external), count(n)
+{
+    computeStackSize();
+}
+
+void CompressedBVH::computeStackSize()
+{
+    if (count == 0)
+        return;
+    // 自己维护栈，不递归：退化的树可能有上万层
+    int depth = 0;
+    std::vector<std::pair<uint32_t, int>> pending = {{0, 1}};
+    while (!pending.empty())
+    {
+        auto [index, level] = pending.back();
+        pending.pop_back();
+        depth = std::max(depth, level);
+        const CompressedBVHNode &node = nodeData[index];
+        for (int i = 0; i < 4; ++i)
+            if (node.child[i] != CompressedBVHNode::EMPTY && !node.isLeaf(i))
+                pending.push_back({node.child[i], level + 1});
+    }
+    stackSize = 3 * depth + 1;
+}
+
+uint32_t CompressedBVH::emitNode(BVHBuildNode *node)
+{
+    // 把二叉树中表面积最大的内部结点不断展开，直到凑满 4 个子节点
+    BVHBuildNode *kids[4];
+    int n = 0;
+    if (node->left)
+        kids[n++] = node->left;
+    if (node->right)
+        kids[n++] = node->right;
+    while (n < 4)
+    {
+        int best = -1;
+        double bestArea = -1;
+        for (int i = 0; i < n; ++i)
+        {
+            bool internal = kids[i]->left && kids[i]->right;
+            if (internal && kids[i]->bounds.SurfaceArea() > bestArea)
+            {
+                best = i;
+                bestArea = kids[i]->bounds.SurfaceArea();
+            }
+        }
+        if (best < 0)
+            break;
+        BVHBuildNode *expand = kids[best];
+        kids[best] = expand->left;
+        kids[n++] = expand->right;
+    }
+
+    uint32_t index = nodes.size();
+    nodes.emplace_back();
+    {
+        CompressedBVHNode &out = nodes[index];
+        const Bounds3 &pb = node->bounds;
+        out.leafMask = 0;
+        for (int a = 0; a < 3; ++a)
+        {
+            out.origin[a] = pb.pMin[a];
+            out.exponent[a] = chooseExponent(pb.pMin[a], pb.pMax[a]);
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            out.child[i] = CompressedBVHNode::EMPTY;
+            for (int a = 0; a < 3; ++a)
+            {
+                out.qlo[a][i] = 0;
+                out.qhi[a][i] = 0;
+            }
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            const Bounds3 &cb = kids[i]->bounds;
+            for (int a = 0; a < 3; ++a)
+            {
+                float o = out.origin[a], s = exp2i(out.exponent[a]);
+                int lo = std::clamp(int(std::floor((cb.pMin[a] - o) / s)), 0, 255);
+                int hi = std::clamp(int(std::ceil((cb.pMax[a] - o) / s)), 0, 255);
+                // 浮点舍入后仍要保证量化包围盒包含原包围盒
+                while (lo > 0 && o + lo * s > cb.pMin[a])
+                    --lo;
+                while (hi < 255 && o + hi * s < cb.pMax[a])
+                    ++hi;
+                out.qlo[a][i] = uint8_t(lo);
+                out.qhi[a][i] = uint8_t(hi);
+            }
+        }
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        uint32_t c;
+        if (!kids[i]->left && !kids[i]->right)
+        {
+            auto it = std::lower_bound(primIndex.begin(), primIndex.end(),
+                                       std::make_pair(kids[i]->object, 0u));
+            c = it->second;
+            nodes[index].leafMask |= uint8_t(1u << i);
+        }
+        else
+        {
+            // 递归时 nodes 可能重新分配，所以这里只能通过下标访问
+            c = emitNode(kids[i]);
+        }
+        nodes[index].child[i] = c;
+    }
+    return index;
+}
+
+Intersection CompressedBVH::Intersect(const Ray &ray) const
+{
+    Intersection best;
+    if (count == 0)
+        return best;
+
+    struct Entry
+    {
+        uint32_t node;
+        float tEnter;
+    };
+    // 一般的树用栈上的数组，更深的树才分配
+    constexpr int inlineStack = 64;
+    Entry inlineEntries[inlineStack];
+    std::vector<Entry> heapEntries;
+    Entry *stack = inlineEntries;
+    if (stackSize > inlineStack)
+    {
+        heapEntries.resize(stackSize);
+        stack = heapEntries.data();
+    }
+    int top = 0;
+    stack[top++] = {0, -std::numeric_limits<float>::infinity()};
+
+    while (top > 0)
+    {
+        Entry e = stack[--top];
+        if (e.tEnter > best.distance)
+            continue;
+
+        const CompressedBVHNode &node = nodeData[e.node];
+        RT_STAT(nodesVisited);
+
+        // 先求出所有被击中的子节点，按进入距离从近到远处理
+        Entry hits[4];
+        int hitCount = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (node.child[i] == CompressedBVHNode::EMPTY)
+                continue;
+            float tEnter;
+            RT_STAT(boxTests);
+            if (!slab(node.childBounds(i), ray, tEnter) || tEnter > best.distance)
+                continue;
+            if (node.isLeaf(i))
+            {
+                Intersection h = primitives[node.child[i]]->getIntersection(ray);
+                if (h.happened && h.distance < best.distance)
+                    best = h;
+                continue;
+            }
+            int j = hitCount++;
+            while (j > 0 && hits[j - 1].tEnter < tEnter)
+            {
+                hits[j] = hits[j - 1];
+                --j;
+            }
+            hits[j] = {node.child[i], tEnter};
+        }
+        // hits 按距离从远到近排列，近的最后入栈、最先弹出
+        for (int i = 0; i < hitCount; ++i)
+        {
+            assert(top < std::max(stackSize, inlineStack));
+            stack[top++] = hits[i];
+        }
+    }
+    return best;
+}
@@ -0,0 +1,74 @@
+//
+// Compressed 4-wide BVH.
+//
+// Each node stores the box of its parent as an origin plus a power-of-two step
+// per axis, and the boxes of up to four children as 8-bit offsets from that
+// origin. Child and primitive references are 32-bit indices into flat arrays,
+// so a node is 56 bytes for four children instead of four individually
+// allocated BVHBuildNodes.
+//
+// The quantized boxes always contain the exact ones (min rounded down, max
+// rounded up), so traversal never misses a hit of the binary tree.
+//
+
+#ifndef RAYTRACING_COMPRESSEDBVH_H
+#define RAYTRACING_COMPRESSEDBVH_H
+
+#include <cstdint>
+#include <vector>
+#include "Bounds3.hpp"
+#include "Intersection.hpp"
+#include "Object.hpp"
+#include "Ray.hpp"
+
+struct BVHBuildNode;
+
+struct CompressedBVHNode
+{
+    static constexpr uint32_t EMPTY = 0xffffffffu;
+
+    float origin[3];    // 父节点包围盒的最小点
+    int8_t exponent[3]; // 每个轴的量化步长为 2^exponent
+    uint8_t leafMask;   // 第 i 位为 1 表示第 i 个子节点直接指向图元
+    uint8_t qlo[3][4];  // [轴][子节点] 量化后的最小点
+    uint8_t qhi[3][4];  // [轴][子节点] 量化后的最大点
+    uint32_t child[4];  // 子节点下标，或图元下标（叶子），空位为 EMPTY
+
+    bool isLeaf(int i) const { return (leafMask >> i) & 1; }
+    Bounds3 childBounds(int i) const;
+};
+
+static_assert(sizeof(CompressedBVHNode) == 56, "CompressedBVHNode layout changed");
+
+class CompressedBVH
+{
+public:
+    // root 为已经建好的二叉 BVH，primitives 为叶子所引用的图元（按下标引用）
+    CompressedBVH(BVHBuildNode *root, const std::vector<Object *> &primitives);
+    // 直接使用外部内存中的结点（例如 mmap 进来的场景缓存），不做拷贝
+    CompressedBVH(const CompressedBVHNode *external, size_t count, const std::vector<Object *> &primitives);
+
+    Intersection Intersect(const Ray &ray) const;
+
+    const CompressedBVHNode *data() const { return nodeData; }
+    size_t nodeCount() const { return count; }
+    size_t memoryBytes() const { return count * sizeof(CompressedBVHNode); }
+
+private:
+    const std::vector<Object *> &primitives;
+
+    // 自己建树时结点存放在 nodes 中；从缓存载入时 nodes 为空，nodeData 指向外部内存
+    std::vector<CompressedBVHNode> nodes;
+    const CompressedBVHNode *nodeData = nullptr;
+    size_t count = 0;
+    // 遍历栈的最大深度：每弹出一个结点最多压入 4 个子节点（净增 3），所以是 3 * 内部结点层数 + 1。
+    // LBVH 和 treelet 重排可能建出很深的树，超过 Intersect 中栈上数组的大小时改用堆上的栈
+    int stackSize = 1;
+
+    uint32_t emitNode(BVHBuildNode *node);
+    void computeStackSize();
+
+    std::vector<std::pair<Object *, uint32_t>> primIndex;
+};
+
+#endif //RAYTRACING_COMPRESSEDBVH_H
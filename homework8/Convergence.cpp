@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include "Convergence.hpp"
+
+namespace
+{
+    // 读入 ImageWriter 写出的 PFM：三通道、小端（scale 为负），行从下往上存
+    bool readPfm(const std::string &filename, std::vector<Vector3f> &pixels, int &width, int &height)
+    {
+        FILE *fp = fopen(filename.c_str(), "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "Cannot open reference image %s\n", filename.c_str());
+            return false;
+        }
+        char magic[3] = {};
+        float scale = 0;
+        bool ok = fscanf(fp, "%2s %d %d %f", magic, &width, &height, &scale) == 4 && fgetc(fp) != EOF;
+        if (!ok || std::string(magic) != "PF" || width <= 0 || height <= 0)
+        {
+            fprintf(stderr, "%s is not a three-channel PFM image\n", filename.c_str());
+            fclose(fp);
+            return false;
+        }
+        if (scale > 0)
+        {
+            fprintf(stderr, "%s is big-endian; only little-endian PFM is supported\n", filename.c_str());
+            fclose(fp);
+            return false;
+        }
+
+        pixels.resize(size_t(width) * height);
+        std::vector<float> row(size_t(width) * 3);
+        for (int y = height - 1; y >= 0 && ok; --y)
+        {
+            ok = fread(row.data(), sizeof(float), row.size(), fp) == row.size();
+            for (int x = 0; x < width && ok; ++x)
+                pixels[size_t(y) * width + x] = Vector3f(row[3 * x], row[3 * x + 1], row[3 * x + 2]);
+        }
+        fclose(fp);
+        if (!ok)
+            fprintf(stderr, "Reference image %s is truncated\n", filename.c_str());
+        return ok;
+    }
+}
+
+std::vector<double> parseCheckpoints(const std::string &list)
+{
+    std::vector<double> checkpoints;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        double t = std::atof(item.c_str());
+        if (t > 0)
+            checkpoints.push_back(t);
+    }
+    std::sort(checkpoints.begin(), checkpoints.end());
+    return checkpoints;
+}
+
+bool runConvergence(const Scene &scene, Renderer r, const ConvergenceOptions &options)
+{
+    std::vector<Vector3f> reference;
+    int width = 0, height = 0;
+    if (!readPfm(options.reference, reference, width, height))
+        return false;
+    if (width != scene.width || height != scene.height)
+    {
+        fprintf(stderr, "Reference image is %dx%d but the scene is rendered at %dx%d\n", width, height,
+                scene.width, scene.height);
+        return false;
+    }
+    if (options.checkpoints.empty())
+    {
+        fprintf(stderr, "No convergence checkpoints given\n");
+        return false;
+    }
+
+    // 只有新文件才写表头，这样多次运行（不同的 label）可以追加到同一个 CSV 中
+    FILE *existing = fopen(options.csv.c_str(), "r");
+    bool newFile = existing == nullptr;
+    if (existing)
+        fclose(existing);
+    FILE *csv = fopen(options.csv.c_str(), "a");
+    if (!csv)
+    {
+        fprintf(stderr, "Cannot write convergence results to %s\n", options.csv.c_str());
+        return false;
+    }
+    if (newFile)
+        fprintf(csv, "label,budget_s,seconds,spp,rmse,relmse\n");
+
+    printf("Converging towards %s: %d spp per pass, %zu checkpoint(s) up to %.1f s\n", options.reference.c_str(),
+           r.spp, options.checkpoints.size(), options.checkpoints.back());
+    printf("%10s %10s %8s %12s %12s\n", "budget_s", "seconds", "spp", "rmse", "relmse");
+
+    std::vector<Vector3f> sum(reference.size()), pass;
+    uint32_t baseSeed = r.seed;
+    r.progress = [](float) {};
+    double seconds = 0;
+    size_t next = 0;
+    bool ok = true;
+    for (uint32_t passes = 1; next < options.checkpoints.size(); ++passes)
+    {
+        r.seed = baseSeed + passes;
+        auto start = std::chrono::steady_clock::now();
+        if (!r.RenderToBuffer(scene, pass))
+        {
+            ok = false;
+            break;
+        }
+        for (size_t i = 0; i < sum.size(); ++i)
+            sum[i] = sum[i] + pass[i];
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds < options.checkpoints[next])
+            continue;
+
+        double squared = 0, relative = 0;
+        for (size_t i = 0; i < sum.size(); ++i)
+        {
+            Vector3f estimate = sum[i] / float(passes);
+            for (int c = 0; c < 3; ++c)
+            {
+                double e = estimate[c], ref = reference[i][c];
+                squared += (e - ref) * (e - ref);
+                relative += (e - ref) * (e - ref) / (ref * ref + 0.01);
+            }
+        }
+        double count = 3.0 * sum.size();
+        double rmse = std::sqrt(squared / count), relmse = relative / count;
+        // 一遍渲染可能跨过好几个时间点，每个时间点都记一行
+        for (; next < options.checkpoints.size() && seconds >= options.checkpoints[next]; ++next)
+        {
+            long spp = long(passes) * r.spp;
+            fprintf(csv, "%s,%g,%.4f,%ld,%.6g,%.6g\n", options.label.c_str(), options.checkpoints[next], seconds,
+                    spp, rmse, relmse);
+            printf("%10g %10.3f %8ld %12.6g %12.6g\n", options.checkpoints[next], seconds, spp, rmse, relmse);
+        }
+        fflush(csv);
+    }
+    fclose(csv);
+    if (ok)
+        printf("Wrote convergence results to %s\n", options.csv.c_str());
+    return ok;
+}
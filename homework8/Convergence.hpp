@@ -0,0 +1,51 @@
+//
+// Time-to-quality benchmark.
+//
+// The image is rendered progressively: pass after pass of r.spp samples per
+// pixel, each pass with its own seed, accumulated into a running mean. At
+// fixed wall-clock checkpoints (render time only, the error computation is not
+// counted) the running mean is compared with a stored high-spp reference
+// render and one CSV row is appended:
+//
+//     label,budget_s,seconds,spp,rmse,relmse
+//
+// rmse is the root of the mean squared error over all pixels and channels,
+// relmse the mean of (estimate - reference)^2 / (reference^2 + 0.01), which
+// weights dark regions the way they are perceived. Because the rows are keyed
+// by time and not by spp, builds or settings with different per-sample cost
+// (sampling strategy, integrator, denoising, thread count) can be compared at
+// equal time budgets; --label tells the runs apart when several append to the
+// same CSV.
+//
+// The reference is an ordinary .pfm render with many samples, e.g.
+//
+//     ./RayTracing --size 256x256 --spp 4096 -o reference.pfm
+//     ./RayTracing --size 256x256 --converge reference.pfm --checkpoints 1,2,5,10,30 --csv convergence.csv
+//
+// The passes use the seeds seed+1, seed+2, ..., so they never repeat the
+// random sequence of a reference rendered with the same --seed.
+//
+
+#ifndef RAYTRACING_CONVERGENCE_H
+#define RAYTRACING_CONVERGENCE_H
+
+#include <string>
+#include <vector>
+#include "Renderer.hpp"
+
+struct ConvergenceOptions
+{
+    std::string reference;          // 参考图像（.pfm）
+    std::vector<double> checkpoints; // 递增的时间点（秒）
+    std::string csv = "convergence.csv";
+    std::string label = "default";
+};
+
+// "1,2,5,10" -> {1, 2, 5, 10}（排序，去掉非正数）
+std::vector<double> parseCheckpoints(const std::string &list);
+
+// r 按值传入：每一遍渲染会改写它的 seed 和 progress。失败时（参考图像无法读取、
+// 分辨率不符、CSV 无法写入、渲染失败）返回 false
+bool runConvergence(const Scene &scene, Renderer r, const ConvergenceOptions &options);
+
+#endif //RAYTRACING_CONVERGENCE_H
@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "ImageWriter.hpp"
+#include "Trace.hpp"
+#include "global.hpp"
+
+#ifdef RT_WITH_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+namespace
+{
+    // 与原来逐像素写文件时的公式完全一致
+    inline unsigned char quantizeExact(float c, float gamma)
+    {
+        float v = clamp(0, 1, c);
+        return (unsigned char)(255 * (gamma == 1.0f ? v : std::pow(v, gamma)));
+    }
+
+    // threshold[b] 为量化结果不小于 b 的最小输入，threshold[0] = -inf；
+    // coarse[k] 为输入 k / kCoarse 的量化结果，查表之后最多再往上修正几格
+    struct GammaTable
+    {
+        static constexpr int kCoarse = 4096;
+
+        float gamma;
+        float threshold[257];
+        unsigned char coarse[kCoarse + 1];
+
+        explicit GammaTable(float g) : gamma(g)
+        {
+            threshold[0] = -std::numeric_limits<float>::infinity();
+            threshold[256] = std::numeric_limits<float>::infinity();
+            uint32_t one;
+            float f1 = 1.0f;
+            std::memcpy(&one, &f1, sizeof(one));
+            for (int b = 1; b < 256; ++b)
+            {
+                // 非负浮点数的位模式与数值同序，直接在位模式上二分
+                uint32_t lo = 0, hi = one;
+                while (lo < hi)
+                {
+                    uint32_t mid = lo + (hi - lo) / 2;
+                    float x;
+                    std::memcpy(&x, &mid, sizeof(x));
+                    if (quantizeExact(x, gamma) >= b)
+                        hi = mid;
+                    else
+                        lo = mid + 1;
+                }
+                std::memcpy(&threshold[b], &lo, sizeof(float));
+            }
+            for (int k = 0; k <= kCoarse; ++k)
+                coarse[k] = quantizeExact(float(k) / kCoarse, gamma);
+        }
+
+        inline unsigned char operator()(float c) const
+        {
+            float v = clamp(0, 1, c);
+            // kCoarse 是 2 的幂，v * kCoarse 没有舍入误差，所以 coarse[k] 不会超过精确结果
+            int b = coarse[int(v * kCoarse)];
+            while (v >= threshold[b + 1])
+                ++b;
+            return (unsigned char)b;
+        }
+    };
+
+    const GammaTable &gammaTable(float gamma)
+    {
+        // 一般只会用到一两个 gamma，按需建表并缓存
+        static std::mutex mutex;
+        static std::vector<std::unique_ptr<GammaTable>> tables;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &t : tables)
+            if (t->gamma == gamma)
+                return *t;
+        tables.push_back(std::make_unique<GammaTable>(gamma));
+        return *tables.back();
+    }
+
+    // 按行把 [0, rows) 分给多个线程
+    template <typename F>
+    void parallelRows(int rows, F &&f)
+    {
+        int threads = std::max(1, std::min<int>(std::thread::hardware_concurrency(), rows / 16));
+        std::vector<std::thread> workers;
+        for (int t = 1; t < threads; ++t)
+            workers.emplace_back([&, t] { f(rows * t / threads, rows * (t + 1) / threads); });
+        f(0, rows / threads);
+        for (auto &w : workers)
+            w.join();
+    }
+
+    bool endsWith(const std::string &s, const char *suffix)
+    {
+        size_t n = std::strlen(suffix);
+        if (s.size() < n)
+            return false;
+        for (size_t i = 0; i < n; ++i)
+            if (std::tolower((unsigned char)s[s.size() - n + i]) != suffix[i])
+                return false;
+        return true;
+    }
+
+    bool writeBuffer(const std::string &filename, const std::vector<char> &buffer)
+    {
+        TRACE_ZONE("File write", filename);
+        FILE *fp = fopen(filename.c_str(), "wb");
+        if (!fp)
+        {
+            fprintf(stderr, "Cannot open %s for writing\n", filename.c_str());
+            return false;
+        }
+        bool ok = fwrite(buffer.data(), 1, buffer.size(), fp) == buffer.size();
+        ok = fclose(fp) == 0 && ok;
+        return ok;
+    }
+}
+
+ImageFormat imageFormatFromFilename(const std::string &filename)
+{
+    if (endsWith(filename, ".pfm"))
+        return ImageFormat::PFM;
+    if (endsWith(filename, ".png"))
+        return ImageFormat::PNG;
+    return ImageFormat::PPM;
+}
+
+void quantizePixels(const Vector3f *pixels, size_t count, unsigned char *out, float gamma, bool bgr)
+{
+    const GammaTable &table = gammaTable(gamma);
+    int r = bgr ? 2 : 0, b = bgr ? 0 : 2;
+    for (size_t i = 0; i < count; ++i, out += 3)
+    {
+        out[r] = table(pixels[i].x);
+        out[1] = table(pixels[i].y);
+        out[b] = table(pixels[i].z);
+    }
+}
+
+bool writeImage(const std::string &filename, const Vector3f *framebuffer,
+                int width, int height, float gamma)
+{
+    auto start = std::chrono::steady_clock::now();
+    ImageFormat format = imageFormatFromFilename(filename);
+    bool ok = false;
+
+    if (format == ImageFormat::PFM)
+    {
+        // PFM：行从下往上存，scale 为负表示小端
+        char header[64];
+        int headerSize = snprintf(header, sizeof(header), "PF\n%d %d\n-1.0\n", width, height);
+        std::vector<char> buffer(headerSize + size_t(width) * height * 3 * sizeof(float));
+        std::memcpy(buffer.data(), header, headerSize);
+        float *body = reinterpret_cast<float *>(buffer.data() + headerSize);
+        parallelRows(height, [&](int begin, int end)
+        {
+            for (int y = begin; y < end; ++y)
+            {
+                const Vector3f *row = &framebuffer[size_t(height - 1 - y) * width];
+                float *out = body + size_t(y) * width * 3;
+                for (int x = 0; x < width; ++x)
+                {
+                    float rgb[3] = {row[x].x, row[x].y, row[x].z};
+                    std::memcpy(out + 3 * x, rgb, sizeof(rgb));
+                }
+            }
+        });
+        ok = writeBuffer(filename, buffer);
+    }
+    else if (format == ImageFormat::PNG)
+    {
+#ifdef RT_WITH_OPENCV
+        cv::Mat image(height, width, CV_8UC3);
+        parallelRows(height, [&](int begin, int end)
+        {
+            quantizePixels(&framebuffer[size_t(begin) * width], size_t(end - begin) * width,
+                           image.ptr<unsigned char>(begin), gamma, true);
+        });
+        ok = cv::imwrite(filename, image);
+#else
+        fprintf(stderr, "PNG output needs OpenCV; rebuild with OpenCV or write .ppm/.pfm instead\n");
+        return false;
+#endif
+    }
+    else
+    {
+        char header[64];
+        int headerSize = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+        std::vector<char> buffer(headerSize + size_t(width) * height * 3);
+        std::memcpy(buffer.data(), header, headerSize);
+        unsigned char *body = reinterpret_cast<unsigned char *>(buffer.data() + headerSize);
+        parallelRows(height, [&](int begin, int end)
+        {
+            TRACE_ZONE("Tone map", (long long)begin);
+            quantizePixels(&framebuffer[size_t(begin) * width], size_t(end - begin) * width,
+                           body + size_t(begin) * width * 3, gamma);
+        });
+        ok = writeBuffer(filename, buffer);
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    printf("Wrote %s (%dx%d) in %.1f ms\n", filename.c_str(), width, height,
+           std::chrono::duration<double, std::milli>(stop - start).count());
+    return ok;
+}
+
+ImageStreamWriter::ImageStreamWriter(const std::string &filename, int w, int h, float g)
+    : format(imageFormatFromFilename(filename)), width(w), height(h), gamma(g)
+{
+    if (format == ImageFormat::PNG)
+    {
+        fprintf(stderr, "Streaming output supports .ppm and .pfm only (got %s)\n", filename.c_str());
+        return;
+    }
+    fp = fopen(filename.c_str(), "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "Cannot open %s for writing\n", filename.c_str());
+        return;
+    }
+    if (format == ImageFormat::PFM)
+    {
+        headerSize = fprintf(fp, "PF\n%d %d\n-1.0\n", width, height);
+        rowBuffer.resize(size_t(width) * 3 * sizeof(float));
+    }
+    else
+    {
+        headerSize = fprintf(fp, "P6\n%d %d\n255\n", width, height);
+        rowBuffer.resize(size_t(width) * 3);
+    }
+    position = headerSize;
+}
+
+ImageStreamWriter::~ImageStreamWriter()
+{
+    close();
+}
+
+bool ImageStreamWriter::writeRow(int y, const Vector3f *row)
+{
+    if (!ok())
+        return false;
+    long offset;
+    if (format == ImageFormat::PFM)
+    {
+        // PFM 的行从下往上存
+        offset = headerSize + long(height - 1 - y) * long(rowBuffer.size());
+        float *out = reinterpret_cast<float *>(rowBuffer.data());
+        for (int x = 0; x < width; ++x)
+        {
+            out[3 * x] = row[x].x;
+            out[3 * x + 1] = row[x].y;
+            out[3 * x + 2] = row[x].z;
+        }
+    }
+    else
+    {
+        offset = headerSize + long(y) * long(rowBuffer.size());
+        quantizePixels(row, width, rowBuffer.data(), gamma);
+    }
+    if (offset != position && fseek(fp, offset, SEEK_SET) != 0)
+        failed = true;
+    else if (fwrite(rowBuffer.data(), 1, rowBuffer.size(), fp) != rowBuffer.size())
+        failed = true;
+    position = failed ? -1 : offset + long(rowBuffer.size());
+    return !failed;
+}
+
+bool ImageStreamWriter::close()
+{
+    if (!fp)
+        return false;
+    bool result = fclose(fp) == 0 && !failed;
+    fp = nullptr;
+    return result;
+}
@@ -0,0 +1,66 @@
+//
+// Output stage of the renderer.
+//
+// The framebuffer is tone-mapped (clamp to [0, 1] + gamma) and quantised in
+// parallel into one contiguous buffer, which is then written with a single
+// fwrite. The format follows the file extension:
+//   .ppm  8-bit binary PPM (default)
+//   .pfm  32-bit float PFM, the unclamped radiance for denoising/compositing
+//   .png  8-bit PNG through OpenCV (only when built with RT_WITH_OPENCV)
+//
+// Quantisation uses a 4096-entry table of the gamma curve plus the 255 exact
+// thresholds between output values: one lookup and (rarely) a step or two of
+// correction instead of a std::pow per channel, and the bytes are exactly
+// those of 255 * pow(clamp(0, 1, c), gamma).
+//
+
+#ifndef RAYTRACING_IMAGEWRITER_H
+#define RAYTRACING_IMAGEWRITER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Vector.hpp"
+
+enum class ImageFormat { PPM, PFM, PNG };
+
+ImageFormat imageFormatFromFilename(const std::string &filename);
+
+// gamma 为 1 时就是简单的 clamp + 量化
+bool writeImage(const std::string &filename, const Vector3f *framebuffer,
+                int width, int height, float gamma = 1.0f);
+inline bool writeImage(const std::string &filename, const std::vector<Vector3f> &framebuffer,
+                       int width, int height, float gamma = 1.0f)
+{
+    return writeImage(filename, framebuffer.data(), width, height, gamma);
+}
+
+// 把一段像素量化成 8 位颜色（每个像素 3 个字节，bgr 为 true 时按 OpenCV 的 BGR 顺序）
+void quantizePixels(const Vector3f *pixels, size_t count, unsigned char *out, float gamma, bool bgr = false);
+
+// 逐行写出图像，不需要整幅 framebuffer 在内存中（只支持 .ppm / .pfm）。
+// 行可以按任意顺序写入，每一行直接写到文件中对应的位置
+class ImageStreamWriter
+{
+public:
+    ImageStreamWriter(const std::string &filename, int width, int height, float gamma = 1.0f);
+    ~ImageStreamWriter();
+    ImageStreamWriter(const ImageStreamWriter &) = delete;
+    ImageStreamWriter &operator=(const ImageStreamWriter &) = delete;
+
+    bool ok() const { return fp != nullptr && !failed; }
+    bool writeRow(int y, const Vector3f *row);
+    bool close();
+
+private:
+    FILE *fp = nullptr;
+    ImageFormat format;
+    int width, height;
+    float gamma;
+    long headerSize = 0;
+    long position = -1; // 当前文件位置，顺序写入时不需要 seek
+    bool failed = false;
+    std::vector<unsigned char> rowBuffer;
+};
+
+#endif //RAYTRACING_IMAGEWRITER_H
@@ -0,0 +1,121 @@
+//
+// Microbenchmarks of the innermost kernels of the path tracer: the ray/box
+// slab test, the ray/triangle tests, the random number generator and BRDF
+// sampling. The inputs are random but generated from a fixed seed, so every
+// run (and every build being compared) times exactly the same work; see
+// MicroBench.hpp for the timing methodology.
+//
+//     ./KernelBench [--reps N] [--warmup N] [--filter NAME]
+//
+#include <random>
+#include <vector>
+#include "MicroBench.hpp"
+#include "Triangle.hpp"
+
+const float EPSILON = 0.00001;
+
+namespace
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+    Vector3f randomVector() { return Vector3f(dist(rng), dist(rng), dist(rng)); }
+
+    // 大约一半的光线打中：光线从盒子/三角形附近的随机位置射向目标附近的随机点
+    Ray rayTowards(const Vector3f &target, float spread)
+    {
+        Vector3f orig = randomVector() * 8.0f;
+        return Ray(orig, normalize(target + randomVector() * spread - orig));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    auto options = microbench::parseOptions(argc, argv);
+    const size_t n = 1 << 14;
+
+    std::vector<Bounds3> boxes;
+    std::vector<Ray> boxRays;
+    std::vector<std::array<int, 3>> dirIsNeg;
+    Material material(DIFFUSE, Vector3f(0.0f));
+    std::vector<Triangle> triangles;
+    std::vector<Ray> triRays;
+    std::vector<Vector3f> normals, incoming;
+    triangles.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        Vector3f c = randomVector() * 4.0f;
+        boxes.emplace_back(c - Vector3f(0.5f), c + Vector3f(0.5f));
+        boxRays.push_back(rayTowards(c, 1.0f));
+        const Vector3f &d = boxRays.back().direction;
+        dirIsNeg.push_back({d.x > 0, d.y > 0, d.z > 0});
+
+        Vector3f v0 = c + randomVector(), v1 = c + randomVector(), v2 = c + randomVector();
+        triangles.emplace_back(v0, v1, v2, &material);
+        triRays.push_back(rayTowards((v0 + v1 + v2) / 3, 0.5f));
+
+        normals.push_back(normalize(randomVector()));
+        incoming.push_back(normalize(randomVector()));
+    }
+
+    microbench::printHeader(options);
+
+    microbench::run(options, "Bounds3::IntersectP", n, [&]
+    {
+        int hits = 0;
+        for (size_t i = 0; i < n; ++i)
+            hits += boxes[i].IntersectP(boxRays[i], boxRays[i].direction_inv, dirIsNeg[i]);
+        microbench::doNotOptimize(hits);
+    });
+
+    microbench::run(options, "rayTriangleIntersect", n, [&]
+    {
+        int hits = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            float t, u, v;
+            const Triangle &tri = triangles[i];
+            hits += rayTriangleIntersect(tri.v0, tri.v1, tri.v2, triRays[i].origin, triRays[i].direction, t, u, v);
+        }
+        microbench::doNotOptimize(hits);
+    });
+
+    microbench::run(options, "Triangle::getIntersection", n, [&]
+    {
+        int hits = 0;
+        for (size_t i = 0; i < n; ++i)
+            hits += triangles[i].getIntersection(triRays[i]).happened;
+        microbench::doNotOptimize(hits);
+    });
+
+    seed_random(1);
+    microbench::run(options, "get_random_float", n, [&]
+    {
+        float sum = 0;
+        for (size_t i = 0; i < n; ++i)
+            sum += get_random_float();
+        microbench::doNotOptimize(sum);
+    });
+
+    seed_random(1);
+    microbench::run(options, "Material::sample (diffuse)", n, [&]
+    {
+        Vector3f sum;
+        for (size_t i = 0; i < n; ++i)
+            sum = sum + material.sample(incoming[i], normals[i]);
+        microbench::doNotOptimize(sum);
+    });
+
+    microbench::run(options, "Material::eval + pdf (diffuse)", n, [&]
+    {
+        float sum = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            Vector3f wo = normalize(normals[i] + incoming[i]);
+            sum += material.eval(incoming[i], wo, normals[i]).x + material.pdf(incoming[i], wo, normals[i]);
+        }
+        microbench::doNotOptimize(sum);
+    });
+
+    return 0;
+}
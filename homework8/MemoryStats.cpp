@@ -0,0 +1,141 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sys/resource.h>
+#include "MemoryStats.hpp"
+
+namespace mem
+{
+    namespace
+    {
+        struct Counters
+        {
+            std::atomic<int64_t> live{0};
+            std::atomic<int64_t> peak{0};
+            std::atomic<uint64_t> allocations{0};
+        };
+
+        // 都是常量初始化，在任何静态构造函数调用 new 之前就已经可用
+        Counters heap[CategoryCount];
+        Counters total;
+        std::atomic<int64_t> external[CategoryCount];
+        std::atomic<int64_t> externalPeak[CategoryCount];
+
+        const char *names[CategoryCount] = {"other", "geometry", "BVH", "textures", "framebuffers", "loader"};
+
+        void raisePeak(std::atomic<int64_t> &peak, int64_t value)
+        {
+            int64_t old = peak.load(std::memory_order_relaxed);
+            while (value > old && !peak.compare_exchange_weak(old, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        void account(Counters &c, int64_t bytes)
+        {
+            int64_t now = c.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+            if (bytes > 0)
+            {
+                c.allocations.fetch_add(1, std::memory_order_relaxed);
+                raisePeak(c.peak, now);
+            }
+        }
+
+        // 放在每块内存前面，16 字节保证返回的指针仍然按 max_align_t 对齐
+        struct alignas(16) Header
+        {
+            uint64_t size;
+            uint32_t category;
+        };
+        static_assert(sizeof(Header) == 16, "header must keep malloc alignment");
+
+        void *allocate(size_t size)
+        {
+            auto *h = static_cast<Header *>(std::malloc(sizeof(Header) + size));
+            if (!h)
+                return nullptr;
+            h->size = size;
+            h->category = current;
+            account(heap[current], int64_t(size));
+            account(total, int64_t(size));
+            return h + 1;
+        }
+
+        void release(void *p)
+        {
+            if (!p)
+                return;
+            Header *h = static_cast<Header *>(p) - 1;
+            account(heap[h->category], -int64_t(h->size));
+            account(total, -int64_t(h->size));
+            std::free(h);
+        }
+
+        void *allocateOrThrow(size_t size)
+        {
+            void *p = allocate(size);
+            if (!p)
+                throw std::bad_alloc();
+            return p;
+        }
+    }
+
+    void External::reset(Category c, size_t bytes)
+    {
+        if (size)
+            external[category].fetch_sub(int64_t(size), std::memory_order_relaxed);
+        category = c;
+        size = bytes;
+        if (size)
+            raisePeak(externalPeak[c], external[c].fetch_add(int64_t(size), std::memory_order_relaxed) + int64_t(size));
+    }
+
+    namespace
+    {
+        // 按大小选单位：B / KB / MB / GB
+        const char *format(int64_t bytes, char (&out)[16])
+        {
+            const char *units[] = {"B", "KB", "MB", "GB"};
+            double value = double(bytes);
+            int u = 0;
+            while (u < 3 && value >= 1024)
+            {
+                value /= 1024;
+                ++u;
+            }
+            snprintf(out, sizeof(out), u == 0 ? "%.0f %s" : "%.1f %s", value, units[u]);
+            return out;
+        }
+    }
+
+    void report()
+    {
+        char a[16], b[16], c[16], d[16];
+        printf("Memory by category (heap = operator new; mapped = mmap'd files, OpenCV buffers):\n");
+        printf("  %-13s %11s %11s %12s %11s %11s\n", "category", "heap live", "heap peak", "allocations",
+               "mapped", "mapped peak");
+        for (int i = 0; i < CategoryCount; ++i)
+            printf("  %-13s %11s %11s %12llu %11s %11s\n", names[i], format(heap[i].live, a),
+                   format(heap[i].peak, b), (unsigned long long)heap[i].allocations, format(external[i], c),
+                   format(externalPeak[i], d));
+        printf("  %-13s %11s %11s %12llu\n", "total", format(total.live, a), format(total.peak, b),
+               (unsigned long long)total.allocations);
+
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            printf("  peak resident set size: %s\n", format(int64_t(usage.ru_maxrss) * 1024, a));
+    }
+}
+
+// 替换全局的 operator new/delete；对齐版本（align_val_t）没有替换，不计入统计
+void *operator new(size_t size) { return mem::allocateOrThrow(size); }
+void *operator new[](size_t size) { return mem::allocateOrThrow(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return mem::allocate(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return mem::allocate(size); }
+void operator delete(void *p) noexcept { mem::release(p); }
+void operator delete[](void *p) noexcept { mem::release(p); }
+void operator delete(void *p, size_t) noexcept { mem::release(p); }
+void operator delete[](void *p, size_t) noexcept { mem::release(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { mem::release(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { mem::release(p); }
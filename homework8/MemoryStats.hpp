@@ -0,0 +1,74 @@
+//
+// Heap accounting per subsystem.
+//
+// MemoryStats.cpp replaces the global operator new/delete: every block gets a
+// small header recording its size and the category that was current on the
+// allocating thread, so frees are attributed correctly even when they happen
+// on another thread. Code marks what it allocates with a mem::Scope:
+//
+//     mem::Scope scope(mem::BVH);
+//     root = recursiveBuild(primitives);   // every node counts as BVH
+//
+// Memory that does not come from operator new (mmap'd caches and
+// framebuffers, OpenCV image buffers) is registered with mem::External and
+// reported in its own column, since a mapping is address space rather than
+// resident memory. mem::report() prints live and peak bytes per category and
+// the peak resident set size of the process.
+//
+
+#ifndef RAYTRACING_MEMORYSTATS_H
+#define RAYTRACING_MEMORYSTATS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mem
+{
+    enum Category
+    {
+        Other,       // 没有标记的分配
+        Geometry,    // 三角形、顶点、材质
+        BVH,         // BVH 节点（二叉树和压缩的 4 叉树）
+        Textures,
+        Framebuffer, // framebuffer 和输出图像的编码缓冲区
+        Loader,      // 解析 OBJ 时的临时数据
+        CategoryCount
+    };
+
+    // 当前线程新分配的内存记到哪个类别
+    inline thread_local Category current = Other;
+
+    class Scope
+    {
+    public:
+        explicit Scope(Category c) : previous(current) { current = c; }
+        ~Scope() { current = previous; }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        Category previous;
+    };
+
+    // 不经过 operator new 的内存（mmap、OpenCV 的图像缓冲区），存在期间计入 category
+    class External
+    {
+    public:
+        External() = default;
+        External(Category c, size_t bytes) { reset(c, bytes); }
+        ~External() { reset(Other, 0); }
+        External(const External &) = delete;
+        External &operator=(const External &) = delete;
+
+        void reset(Category c, size_t bytes);
+
+    private:
+        Category category = Other;
+        size_t size = 0;
+    };
+
+    // 打印各类别当前和峰值占用的内存
+    void report();
+}
+
+#endif //RAYTRACING_MEMORYSTATS_H
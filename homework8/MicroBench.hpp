@@ -0,0 +1,108 @@
+//
+// Timing harness for kernel microbenchmarks.
+//
+// A kernel is a lambda that processes a whole array of prepared inputs once.
+// microbench::run() calls it a few times to warm up caches, branch predictors
+// and the CPU clock, then times each of the following repetitions on its own
+// and reports the per-input time as median, 10th/90th percentile and minimum.
+// The median is the number to compare before and after a change; a wide
+// p10..p90 spread means the machine was busy and the run should be repeated.
+// pinThread() keeps the benchmark on one core so that migrations do not show
+// up as outliers.
+//
+
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace microbench
+{
+    struct Options
+    {
+        int warmup = 3;
+        int reps = 30;
+        std::string filter; // 只运行名字中包含这个字符串的 kernel
+    };
+
+    // --reps N、--warmup N、--filter NAME
+    inline Options parseOptions(int argc, char **argv)
+    {
+        Options o;
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::strcmp(argv[i], "--reps") == 0 && i + 1 < argc)
+                o.reps = std::max(1, std::atoi(argv[++i]));
+            else if (std::strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+                o.warmup = std::max(0, std::atoi(argv[++i]));
+            else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+                o.filter = argv[++i];
+        }
+        return o;
+    }
+
+    // 把当前线程固定在 cpu 上，失败时（非 Linux、cpu 不可用）返回 false
+    inline bool pinThread(int cpu = 0)
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+
+    // 让编译器认为 value 被使用了，避免整个 kernel 被优化掉
+    template <typename T>
+    inline void doNotOptimize(const T &value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    inline void printHeader(const Options &o)
+    {
+        bool pinned = pinThread(0);
+        printf("%d warmup + %d timed repetitions per kernel, %s\n", o.warmup, o.reps,
+               pinned ? "pinned to CPU 0" : "thread not pinned");
+        printf("%-36s %10s %10s %10s %10s\n", "kernel (ns per call)", "median", "p10", "p90", "min");
+    }
+
+    // kernel 每次调用处理 n 个输入；返回每个输入的中位数时间（ns）
+    template <typename F>
+    double run(const Options &o, const char *name, size_t n, F &&kernel)
+    {
+        if (!o.filter.empty() && std::string(name).find(o.filter) == std::string::npos)
+            return 0;
+
+        for (int i = 0; i < o.warmup; ++i)
+            kernel();
+
+        std::vector<double> samples(o.reps);
+        for (auto &s : samples)
+        {
+            auto start = std::chrono::steady_clock::now();
+            kernel();
+            auto stop = std::chrono::steady_clock::now();
+            s = std::chrono::duration<double, std::nano>(stop - start).count() / n;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&](double p) { return samples[size_t(p * (samples.size() - 1) + 0.5)]; };
+        printf("%-36s %10.2f %10.2f %10.2f %10.2f\n", name, percentile(0.5), percentile(0.1), percentile(0.9),
+               samples.front());
+        return percentile(0.5);
+    }
+}
+
+#endif //MICROBENCH_H
@@ -0,0 +1,92 @@
+//
+// Load-time benchmark of objl::Loader: the original line-by-line LoadFile
+// against the memory-mapped, multi-threaded LoadFileFast. Both results are
+// compared vertex by vertex, so this also checks that the fast path is a
+// drop-in replacement.
+//
+// usage: ObjLoadBench [reps] [file.obj ...]
+//
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "OBJ_Loader.hpp"
+
+namespace
+{
+    bool sameVector(const objl::Vector3 &a, const objl::Vector3 &b)
+    {
+        return std::memcmp(&a, &b, sizeof(a)) == 0;
+    }
+
+    bool sameVertices(const std::vector<objl::Vertex> &a, const std::vector<objl::Vertex> &b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if (!sameVector(a[i].Position, b[i].Position) || !sameVector(a[i].Normal, b[i].Normal) ||
+                a[i].TextureCoordinate.X != b[i].TextureCoordinate.X ||
+                a[i].TextureCoordinate.Y != b[i].TextureCoordinate.Y)
+                return false;
+        }
+        return true;
+    }
+
+    bool sameResult(const objl::Loader &a, const objl::Loader &b)
+    {
+        if (a.LoadedMeshes.size() != b.LoadedMeshes.size() || a.LoadedIndices != b.LoadedIndices ||
+            !sameVertices(a.LoadedVertices, b.LoadedVertices))
+            return false;
+        for (size_t i = 0; i < a.LoadedMeshes.size(); ++i)
+        {
+            const objl::Mesh &ma = a.LoadedMeshes[i], &mb = b.LoadedMeshes[i];
+            if (ma.MeshName != mb.MeshName || ma.Indices != mb.Indices || !sameVertices(ma.Vertices, mb.Vertices))
+                return false;
+        }
+        return true;
+    }
+
+    template <typename F>
+    double timeMs(int reps, F &&f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < reps; ++r)
+            f();
+        auto stop = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(stop - start).count() / reps;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int reps = argc > 1 ? std::max(1, std::atoi(argv[1])) : 10;
+    std::vector<std::string> files;
+    for (int i = 2; i < argc; ++i)
+        files.push_back(argv[i]);
+    if (files.empty())
+        files = {"../models/bunny/bunny.obj", "../models/cornellbox/floor.obj",
+                 "../models/cornellbox/tallbox.obj", "../models/cornellbox/light.obj"};
+
+    bool allSame = true;
+    for (auto &file : files)
+    {
+        objl::Loader slow, fast;
+        if (!slow.LoadFile(file) || !fast.LoadFileFast(file))
+        {
+            printf("%-40s failed to load\n", file.c_str());
+            allSame = false;
+            continue;
+        }
+        bool same = sameResult(slow, fast);
+        allSame = allSame && same;
+
+        double slowMs = timeMs(reps, [&] { objl::Loader l; l.LoadFile(file); });
+        double fastMs = timeMs(reps, [&] { objl::Loader l; l.LoadFileFast(file); });
+        printf("%-40s %7zu tris  LoadFile %8.2f ms  LoadFileFast %8.2f ms  speedup %5.2fx  %s\n",
+               file.c_str(), fast.LoadedIndices.size() / 3, slowMs, fastMs, slowMs / fastMs,
+               same ? "identical" : "MISMATCH");
+    }
+    return allSame ? 0 : 1;
+}
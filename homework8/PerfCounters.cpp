@@ -0,0 +1,177 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include "PerfCounters.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace perf
+{
+    namespace
+    {
+        const char *counterNames[CounterCount] = {"cycles", "instr", "L1D miss", "LLC miss", "br miss"};
+        int fds[CounterCount] = {-1, -1, -1, -1, -1};
+
+        struct Totals
+        {
+            std::string name;
+            uint64_t value[CounterCount] = {};
+            double seconds = 0;
+            int calls = 0;
+            uint64_t units = 0;
+            std::string unit;
+        };
+        std::mutex totalsMutex;
+        std::vector<Totals> totals; // 按第一次出现的顺序
+
+#ifdef __linux__
+        int open(uint32_t type, uint64_t config)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // 计数器不够用时内核会轮流计数，读出时按实际计数的时间比例放大
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            return int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    bool start()
+    {
+#ifdef __linux__
+        const uint64_t l1dReadMiss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        fds[Cycles] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        int error = errno;
+        fds[Instructions] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        fds[L1DMisses] = open(PERF_TYPE_HW_CACHE, l1dReadMiss);
+        fds[LLCMisses] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        fds[BranchMisses] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+        int opened = 0;
+        for (int fd : fds)
+            opened += fd >= 0;
+        if (opened == 0)
+            printf("Perf counters unavailable (%s); reporting wall time only\n", strerror(error));
+        else if (opened < CounterCount)
+        {
+            printf("Perf counters: not supported here:");
+            for (int i = 0; i < CounterCount; ++i)
+                if (fds[i] < 0)
+                    printf(" %s", counterNames[i]);
+            printf("\n");
+        }
+        active = true;
+        return opened > 0;
+#else
+        printf("Perf counters need Linux perf_event_open; reporting wall time only\n");
+        active = true;
+        return false;
+#endif
+    }
+
+    Reading read()
+    {
+        Reading r;
+#ifdef __linux__
+        for (int i = 0; i < CounterCount; ++i)
+        {
+            uint64_t data[3]; // value, time enabled, time running
+            if (fds[i] < 0 || ::read(fds[i], data, sizeof(data)) != sizeof(data))
+                continue;
+            r.value[i] = data[2] > 0 && data[2] < data[1] ? uint64_t(double(data[0]) * data[1] / data[2]) : data[0];
+        }
+#endif
+        r.time = std::chrono::steady_clock::now();
+        return r;
+    }
+
+    void add(const char *name, const Reading &begin, const Reading &end, uint64_t units, const char *unit)
+    {
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        Totals *t = nullptr;
+        for (auto &item : totals)
+            if (item.name == name)
+                t = &item;
+        if (!t)
+        {
+            totals.emplace_back();
+            t = &totals.back();
+            t->name = name;
+        }
+        for (int i = 0; i < CounterCount; ++i)
+            t->value[i] += end.value[i] - begin.value[i];
+        t->seconds += std::chrono::duration<double>(end.time - begin.time).count();
+        t->calls += 1;
+        t->units += units;
+        if (unit)
+            t->unit = unit;
+    }
+
+    void report()
+    {
+        if (!active)
+            return;
+        active = false;
+
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        printf("Perf counters (user space, all threads):\n");
+        printf("  %-22s %10s %14s %14s %6s %12s %12s %12s\n", "phase", "time ms", counterNames[Cycles],
+               counterNames[Instructions], "IPC", counterNames[L1DMisses], counterNames[LLCMisses],
+               counterNames[BranchMisses]);
+        auto column = [](int counter, uint64_t value, int width)
+        {
+            if (fds[counter] < 0)
+                printf(" %*s", width, "-");
+            else
+                printf(" %*llu", width, (unsigned long long)value);
+        };
+        for (auto &t : totals)
+        {
+            printf("  %-22s %10.1f", t.name.c_str(), t.seconds * 1e3);
+            column(Cycles, t.value[Cycles], 14);
+            column(Instructions, t.value[Instructions], 14);
+            if (fds[Cycles] >= 0 && fds[Instructions] >= 0 && t.value[Cycles] > 0)
+                printf(" %6.2f", double(t.value[Instructions]) / t.value[Cycles]);
+            else
+                printf(" %6s", "-");
+            column(L1DMisses, t.value[L1DMisses], 12);
+            column(LLCMisses, t.value[LLCMisses], 12);
+            column(BranchMisses, t.value[BranchMisses], 12);
+            if (t.calls > 1)
+                printf("  (%d times)", t.calls);
+            printf("\n");
+
+            if (t.units > 0)
+            {
+                printf("  %-22s per %s: %.1f ns", "", t.unit.c_str(), t.seconds * 1e9 / t.units);
+                for (int i : {Instructions, L1DMisses, LLCMisses, BranchMisses})
+                    if (fds[i] >= 0)
+                        printf(", %.3f %s", double(t.value[i]) / t.units, counterNames[i]);
+                printf("\n");
+            }
+        }
+
+        for (int &fd : fds)
+        {
+#ifdef __linux__
+            if (fd >= 0)
+                close(fd);
+#endif
+            fd = -1;
+        }
+    }
+}
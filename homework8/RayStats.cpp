@@ -0,0 +1,39 @@
+#include <cstdio>
+#include <vector>
+#include "ImageWriter.hpp"
+#include "RayStats.hpp"
+
+void RayStats::print(double seconds) const
+{
+    double total = double(rays());
+    double perRay = total > 0 ? 1.0 / total : 0.0;
+    printf("Ray stats: %.3f M rays (camera %llu, bounce %llu, shadow %llu) in %.2f s = %.3f Mrays/s\n",
+           total * 1e-6, (unsigned long long)cameraRays, (unsigned long long)bounceRays,
+           (unsigned long long)shadowRays, seconds, seconds > 0 ? total * 1e-6 / seconds : 0.0);
+    printf("  per ray: %.2f BVH nodes, %.2f box tests, %.2f triangle tests\n",
+           nodesVisited * perRay, boxTests * perRay, triangleTests * perRay);
+    printf("  paths  : %.2f vertices on average, longest %llu, %llu ended by Russian roulette\n",
+           cameraRays ? double(cameraRays + bounceRays) / cameraRays : 0.0,
+           (unsigned long long)maxPathLength, (unsigned long long)rrTerminations);
+}
+
+bool writeHeatmap(const std::string &filename, const float *cost, int width, int height)
+{
+    size_t count = size_t(width) * height;
+    if (count == 0)
+        return false;
+    std::vector<float> sorted(cost, cost + count);
+    size_t k = std::min(count - 1, count * 99 / 100);
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    float scale = sorted[k] > 0 ? 1.0f / sorted[k] : 0.0f;
+    printf("Traversal cost: 99th percentile %.1f tests per sample\n", sorted[k]);
+
+    std::vector<Vector3f> image(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        // 0 -> 蓝，0.5 -> 绿，1 -> 红
+        float t = std::min(1.0f, cost[i] * scale);
+        image[i] = t < 0.5f ? Vector3f(0, 2 * t, 1 - 2 * t) : Vector3f(2 * t - 1, 2 - 2 * t, 0);
+    }
+    return writeImage(filename, image, width, height);
+}
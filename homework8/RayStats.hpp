@@ -0,0 +1,70 @@
+//
+// Per-ray instrumentation for the path tracer.
+//
+// Counters are only compiled in when RT_RAY_STATS is defined (cmake
+// -DRT_RAY_STATS=ON); otherwise RT_STAT() expands to nothing and the hot paths
+// are unchanged. Every thread counts into its own thread_local RayStats, so no
+// atomics are involved: the renderer resets the counters at the start of a
+// tile, copies them out at the end, and merges the per-tile results once the
+// frame is done (this also works across the worker processes of the farm).
+//
+
+#ifndef RAYTRACING_RAYSTATS_H
+#define RAYTRACING_RAYSTATS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+struct RayStats
+{
+    uint64_t cameraRays = 0;
+    uint64_t bounceRays = 0;     // 路径延伸的间接光线
+    uint64_t shadowRays = 0;     // 采样光源的可见性光线
+    uint64_t nodesVisited = 0;   // 遍历时访问的 BVH 节点
+    uint64_t boxTests = 0;       // 光线与包围盒求交次数
+    uint64_t triangleTests = 0;  // 光线与三角形求交次数
+    uint64_t rrTerminations = 0; // 被俄罗斯轮盘赌终止的路径
+    uint64_t maxPathLength = 0;  // 最长路径的顶点数
+
+    uint64_t rays() const { return cameraRays + bounceRays + shadowRays; }
+
+    RayStats &operator+=(const RayStats &o)
+    {
+        cameraRays += o.cameraRays;
+        bounceRays += o.bounceRays;
+        shadowRays += o.shadowRays;
+        nodesVisited += o.nodesVisited;
+        boxTests += o.boxTests;
+        triangleTests += o.triangleTests;
+        rrTerminations += o.rrTerminations;
+        maxPathLength = std::max(maxPathLength, o.maxPathLength);
+        return *this;
+    }
+
+    // 打印统计结果，seconds 为渲染所用时间
+    void print(double seconds) const;
+};
+
+#ifdef RT_RAY_STATS
+constexpr bool rayStatsEnabled = true;
+#define RT_STAT(counter) (++rayStats().counter)
+#define RT_STAT_MAX(counter, value) (rayStats().counter = std::max<uint64_t>(rayStats().counter, (value)))
+#else
+constexpr bool rayStatsEnabled = false;
+#define RT_STAT(counter) ((void)0)
+#define RT_STAT_MAX(counter, value) ((void)0)
+#endif
+
+// 当前线程的计数器
+inline RayStats &rayStats()
+{
+    thread_local RayStats stats;
+    return stats;
+}
+
+// 把每个像素的遍历代价（包围盒 + 三角形求交次数 / spp）映射成蓝-绿-红的伪彩色写出，
+// 以 99% 分位数作为红色的上限，避免少数极端像素把其余部分压成一片蓝
+bool writeHeatmap(const std::string &filename, const float *cost, int width, int height);
+
+#endif //RAYTRACING_RAYSTATS_H
@@ -0,0 +1,194 @@
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "RenderFarm.hpp"
+
+namespace
+{
+    bool sendInt(int fd, int32_t value)
+    {
+        return send(fd, &value, sizeof(value), MSG_NOSIGNAL) == sizeof(value);
+    }
+
+    bool receiveInt(int fd, int32_t &value)
+    {
+        char *p = reinterpret_cast<char *>(&value);
+        size_t got = 0;
+        while (got < sizeof(value))
+        {
+            ssize_t n = read(fd, p + got, sizeof(value) - got);
+            if (n <= 0)
+                return false;
+            got += n;
+        }
+        return true;
+    }
+
+    // 子进程：收到分块编号就渲染，收到 -1 或者连接断开就退出
+    void workerLoop(int fd, const std::function<void(int)> &renderTile)
+    {
+        int32_t tile;
+        while (receiveInt(fd, tile) && tile >= 0)
+        {
+            renderTile(tile);
+            if (!sendInt(fd, tile))
+                break;
+        }
+    }
+
+    struct Worker
+    {
+        pid_t pid;
+        int fd;
+        int tile; // 正在渲染的分块，-1 表示空闲
+    };
+}
+
+SharedMemory::SharedMemory(size_t bytes) : size(bytes)
+{
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED)
+    {
+        mapping = p;
+        mapped.reset(mem::Framebuffer, size);
+    }
+}
+
+SharedMemory::~SharedMemory()
+{
+    if (mapping)
+        munmap(mapping, size);
+}
+
+bool runRenderFarm(int workers, int tileCount,
+                   const std::function<void(int)> &renderTile,
+                   const std::function<void(int)> &tileDone)
+{
+    // fork 之前把缓冲区里的输出写出去，否则子进程会再输出一遍
+    std::cout.flush();
+    fflush(stdout);
+
+    std::vector<Worker> pool;
+    for (int i = 0; i < workers; ++i)
+    {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+        {
+            perror("socketpair");
+            break;
+        }
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            close(sv[0]);
+            close(sv[1]);
+            break;
+        }
+        if (pid == 0)
+        {
+            // 关掉其他 worker 的连接，这样协调进程才能发现某个 worker 退出了
+            for (auto &w : pool)
+                close(w.fd);
+            close(sv[0]);
+            workerLoop(sv[1], renderTile);
+            _exit(0);
+        }
+        close(sv[1]);
+        pool.push_back({pid, sv[0], -1});
+    }
+    if (pool.empty())
+        return false;
+    printf("Render farm: %zu worker processes, %d tiles\n", pool.size(), tileCount);
+
+    int next = 0, done = 0;
+    std::deque<int> retry; // 退出的 worker 没有完成的分块
+
+    auto kill = [&](Worker &w)
+    {
+        if (w.tile >= 0)
+            retry.push_back(w.tile);
+        close(w.fd);
+        w.fd = -1;
+        w.tile = -1;
+    };
+    auto assign = [&](Worker &w)
+    {
+        int tile = -1;
+        if (!retry.empty())
+        {
+            tile = retry.front();
+            retry.pop_front();
+        }
+        else if (next < tileCount)
+            tile = next++;
+        if (tile < 0)
+            return;
+        w.tile = tile;
+        if (!sendInt(w.fd, tile))
+            kill(w);
+    };
+
+    for (auto &w : pool)
+        assign(w);
+
+    while (done < tileCount)
+    {
+        std::vector<pollfd> fds;
+        std::vector<Worker *> owners;
+        for (auto &w : pool)
+        {
+            if (w.fd >= 0 && w.tile < 0)
+                assign(w);
+            if (w.fd >= 0 && w.tile >= 0)
+            {
+                fds.push_back({w.fd, POLLIN, 0});
+                owners.push_back(&w);
+            }
+        }
+        if (fds.empty())
+        {
+            fprintf(stderr, "Render farm: all workers exited, %d of %d tiles done\n", done, tileCount);
+            break;
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0)
+            continue;
+
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            if (!fds[i].revents)
+                continue;
+            Worker &w = *owners[i];
+            int32_t tile;
+            if (!receiveInt(w.fd, tile) || tile != w.tile)
+            {
+                fprintf(stderr, "Render farm: worker %d exited, reassigning tile %d\n", int(w.pid), w.tile);
+                kill(w);
+                continue;
+            }
+            tileDone(tile);
+            ++done;
+            w.tile = -1;
+            assign(w);
+        }
+    }
+
+    for (auto &w : pool)
+    {
+        if (w.fd >= 0)
+        {
+            sendInt(w.fd, -1);
+            close(w.fd);
+        }
+        int status;
+        waitpid(w.pid, &status, 0);
+    }
+    return done == tileCount;
+}
@@ -0,0 +1,48 @@
+//
+// Multi-process tile rendering on one host.
+//
+// The coordinator (the process that loaded the scene) forks the workers, so
+// they start with the scene and BVHs already built (copy-on-write). Each worker
+// is connected to the coordinator by a Unix socket pair; the coordinator sends
+// tile indices one at a time, the worker renders the tile into memory shared
+// with the coordinator and answers with the same index. Tiles of a worker that
+// dies are handed to the remaining workers.
+//
+// Because every tile reseeds the random generator from (seed, tile index), the
+// result does not depend on how tiles are spread over workers and is
+// bit-identical to a single-process render with the same seed.
+//
+
+#ifndef RAYTRACING_RENDERFARM_H
+#define RAYTRACING_RENDERFARM_H
+
+#include <cstddef>
+#include <functional>
+#include "MemoryStats.hpp"
+
+// 多个进程共享的匿名内存：fork 之前创建，子进程写入的内容父进程可见
+class SharedMemory
+{
+public:
+    explicit SharedMemory(size_t bytes);
+    ~SharedMemory();
+    SharedMemory(const SharedMemory &) = delete;
+    SharedMemory &operator=(const SharedMemory &) = delete;
+
+    bool valid() const { return mapping != nullptr; }
+    void *data() const { return mapping; }
+
+private:
+    void *mapping = nullptr;
+    size_t size;
+    mem::External mapped;
+};
+
+// fork 出 workers 个子进程，把 [0, tileCount) 的分块逐个分发下去。
+// renderTile 在子进程中执行；tileDone 在协调进程中、每个分块完成时调用。
+// 所有分块都完成时返回 true
+bool runRenderFarm(int workers, int tileCount,
+                   const std::function<void(int)> &renderTile,
+                   const std::function<void(int)> &tileDone);
+
+#endif //RAYTRACING_RENDERFARM_H
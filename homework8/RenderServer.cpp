@@ -0,0 +1,432 @@
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "RenderServer.hpp"
+
+namespace
+{
+    // 不读回复的客户端最多让写操作阻塞这么久，超时后断开这个连接
+    constexpr int kSendTimeoutMs = 2000;
+
+    // 一个客户端连接。任务线程也会往连接上写进度，所以写操作要加锁；
+    // 连接关闭之后 fd 可能被复用，关闭后不再写
+    struct Client
+    {
+        explicit Client(int f) : fd(f)
+        {
+            timeval tv{kSendTimeoutMs / 1000, (kSendTimeoutMs % 1000) * 1000};
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        }
+
+        void send(const std::string &line) { write(line, false); }
+        // 进度这类可以丢的消息：发送缓冲区满时直接丢掉，不阻塞渲染
+        void trySend(const std::string &line) { write(line, true); }
+        // 让阻塞在 read 上的连接线程返回
+        void shutdown()
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (fd >= 0)
+                ::shutdown(fd, SHUT_RDWR);
+        }
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+        }
+
+        int fd;
+        bool broken = false; // 写超时或出错，之后的消息都丢掉
+        std::mutex mtx;
+        std::atomic<bool> finished{false}; // 连接线程已经退出，可以 join
+
+    private:
+        void write(const std::string &line, bool droppable)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (fd < 0 || broken)
+                return;
+            std::string msg = line + "\n";
+            size_t sent = 0;
+            while (sent < msg.size())
+            {
+                // 一行只要写出了一部分就必须写完，否则后面的消息会接在半行后面
+                int flags = MSG_NOSIGNAL | (droppable && sent == 0 ? MSG_DONTWAIT : 0);
+                ssize_t n = ::send(fd, msg.data() + sent, msg.size() - sent, flags);
+                if (n > 0)
+                    sent += n;
+                else if (n < 0 && errno == EINTR)
+                    continue;
+                else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && droppable && sent == 0)
+                    return;
+                else
+                {
+                    // 超时或连接已断开：关闭读端让连接线程退出
+                    broken = true;
+                    ::shutdown(fd, SHUT_RDWR);
+                    return;
+                }
+            }
+        }
+    };
+
+    struct Job
+    {
+        int id = 0;
+        std::string output;
+        int width = 0, height = 0, spp = 1;
+        double fov = 40;
+        Vector3f eye, target;
+        uint32_t seed = 0;
+        std::atomic<bool> cancel{false};
+        std::atomic<int> percent{0};
+        bool running = false;
+        std::shared_ptr<Client> client;
+    };
+
+    class Server
+    {
+    public:
+        Server(Scene &s, const Renderer &r) : scene(s), defaults(r),
+            defaultWidth(s.width), defaultHeight(s.height), defaultFov(s.fov) {}
+
+        bool run(const std::string &path);
+
+    private:
+        Scene &scene;
+        const Renderer &defaults;
+        int defaultWidth, defaultHeight;
+        double defaultFov;
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<std::shared_ptr<Job> > queue;
+        std::map<int, std::shared_ptr<Job> > jobs; // 排队中和正在渲染的任务
+        int nextId = 1;
+        std::atomic<bool> stopping{false};
+
+        void serveClient(std::shared_ptr<Client> client);
+        void handle(const std::string &line, const std::shared_ptr<Client> &client);
+        bool parseRender(std::istringstream &args, Job &job, std::string &error) const;
+        void runJobs();
+        void stop();
+    };
+
+    bool Server::parseRender(std::istringstream &args, Job &job, std::string &error) const
+    {
+        job.width = defaultWidth;
+        job.height = defaultHeight;
+        job.fov = defaultFov;
+        job.spp = defaults.spp;
+        job.eye = defaults.eye;
+        job.target = defaults.target;
+        job.seed = defaults.seed;
+
+        std::string token;
+        while (args >> token)
+        {
+            size_t eq = token.find('=');
+            if (eq == std::string::npos)
+            {
+                error = "expected key=value, got " + token;
+                return false;
+            }
+            std::string key = token.substr(0, eq), value = token.substr(eq + 1);
+            bool ok = true;
+            if (key == "out")
+                job.output = value;
+            else if (key == "size")
+                ok = sscanf(value.c_str(), "%dx%d", &job.width, &job.height) == 2 && job.width > 0 && job.height > 0;
+            else if (key == "spp")
+                ok = sscanf(value.c_str(), "%d", &job.spp) == 1 && job.spp > 0;
+            else if (key == "fov")
+                ok = sscanf(value.c_str(), "%lf", &job.fov) == 1 && job.fov > 0 && job.fov < 180;
+            else if (key == "eye")
+                ok = sscanf(value.c_str(), "%f,%f,%f", &job.eye.x, &job.eye.y, &job.eye.z) == 3;
+            else if (key == "at")
+                ok = sscanf(value.c_str(), "%f,%f,%f", &job.target.x, &job.target.y, &job.target.z) == 3;
+            else if (key == "seed")
+                ok = sscanf(value.c_str(), "%u", &job.seed) == 1;
+            else
+            {
+                error = "unknown option " + key;
+                return false;
+            }
+            if (!ok)
+            {
+                error = "bad value for " + key;
+                return false;
+            }
+        }
+        if (job.output.empty())
+        {
+            error = "missing out=FILE";
+            return false;
+        }
+        return true;
+    }
+
+    void Server::handle(const std::string &line, const std::shared_ptr<Client> &client)
+    {
+        std::istringstream args(line);
+        std::string command;
+        if (!(args >> command))
+            return;
+
+        if (command == "render")
+        {
+            auto job = std::make_shared<Job>();
+            std::string error;
+            if (!parseRender(args, *job, error))
+            {
+                client->send("error " + error);
+                return;
+            }
+            job->client = client;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!stopping)
+                {
+                    job->id = nextId++;
+                    jobs[job->id] = job;
+                    queue.push_back(job);
+                }
+            }
+            if (job->id == 0)
+            {
+                client->send("error server is shutting down");
+                return;
+            }
+            client->send("queued " + std::to_string(job->id));
+            cv.notify_one();
+        }
+        else if (command == "cancel")
+        {
+            int id = 0;
+            args >> id;
+            // 回复在释放 mtx 之后再发，慢的客户端不会挡住其他连接和任务线程
+            bool found;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                auto it = jobs.find(id);
+                found = it != jobs.end();
+                if (found)
+                    it->second->cancel = true;
+            }
+            client->send(found ? "ok" : "error no pending job " + std::to_string(id));
+        }
+        else if (command == "status")
+        {
+            std::vector<std::string> lines;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                for (auto &item : jobs)
+                {
+                    const Job &job = *item.second;
+                    lines.push_back("job " + std::to_string(job.id) + (job.running ? " running " : " queued ") +
+                                    std::to_string(job.percent) + " " + job.output);
+                }
+            }
+            for (auto &l : lines)
+                client->send(l);
+            client->send("end");
+        }
+        else if (command == "shutdown")
+        {
+            client->send("ok");
+            stop();
+        }
+        else
+            client->send("error unknown command " + command);
+    }
+
+    void Server::serveClient(std::shared_ptr<Client> client)
+    {
+        std::string buffer;
+        char chunk[4096];
+        while (!stopping)
+        {
+            ssize_t n = read(client->fd, chunk, sizeof(chunk));
+            if (n <= 0)
+                break;
+            buffer.append(chunk, n);
+            size_t start = 0, end;
+            while ((end = buffer.find('\n', start)) != std::string::npos)
+            {
+                std::string line = buffer.substr(start, end - start);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                handle(line, client);
+                start = end + 1;
+            }
+            buffer.erase(0, start);
+        }
+        client->close();
+        client->finished = true;
+    }
+
+    void Server::runJobs()
+    {
+        while (true)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&] { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                job = queue.front();
+                queue.pop_front();
+                job->running = true;
+            }
+
+            std::string id = std::to_string(job->id);
+            bool ok = false;
+            auto start = std::chrono::steady_clock::now();
+            if (!job->cancel)
+            {
+                // 任务之间只改分辨率和视场角，模型和 BVH 一直保留
+                scene.width = job->width;
+                scene.height = job->height;
+                scene.fov = job->fov;
+
+                Renderer r = defaults;
+                r.workers = 0; // 不在多线程的服务进程中 fork
+                r.spp = job->spp;
+                r.seed = job->seed;
+                r.eye = job->eye;
+                r.target = job->target;
+                r.cancel = &job->cancel;
+                r.progress = [&](float p)
+                {
+                    int percent = int(p * 100);
+                    if (percent != job->percent)
+                    {
+                        job->percent = percent;
+                        job->client->trySend("progress " + id + " " + std::to_string(percent));
+                    }
+                };
+                printf("Job %s: %dx%d, %d spp -> %s\n", id.c_str(), job->width, job->height, job->spp,
+                       job->output.c_str());
+                ok = r.Render(scene, job->output);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                jobs.erase(job->id);
+            }
+            if (job->cancel)
+                job->client->send("cancelled " + id);
+            else if (ok)
+            {
+                char msg[64];
+                snprintf(msg, sizeof(msg), "done %s %.1f", id.c_str(), ms);
+                job->client->send(msg);
+            }
+            else
+                job->client->send("failed " + id);
+        }
+    }
+
+    void Server::stop()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+        for (auto &item : jobs)
+            item.second->cancel = true;
+        cv.notify_all();
+    }
+
+    bool Server::run(const std::string &path)
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "Socket path too long: %s\n", path.c_str());
+            return false;
+        }
+        path.copy(addr.sun_path, path.size());
+
+        int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0)
+        {
+            perror("socket");
+            return false;
+        }
+        // 上次没有正常退出时留下的 socket 文件；同名的普通文件不删，交给下面的 bind 报错
+        struct stat st;
+        if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            unlink(path.c_str());
+        if (bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listenFd, 16) != 0)
+        {
+            perror(path.c_str());
+            close(listenFd);
+            return false;
+        }
+        printf("Render server listening on %s\n", path.c_str());
+        fflush(stdout);
+
+        std::thread worker(&Server::runJobs, this);
+        std::vector<std::shared_ptr<Client> > clients;
+        std::vector<std::thread> clientThreads;
+
+        // 定时醒来检查是否收到了 shutdown
+        while (!stopping)
+        {
+            pollfd pfd{listenFd, POLLIN, 0};
+            // 回收已经断开的连接（预览工具往往每个任务连一次）
+            for (size_t i = 0; i < clients.size();)
+            {
+                if (clients[i]->finished)
+                {
+                    clientThreads[i].join();
+                    clients.erase(clients.begin() + i);
+                    clientThreads.erase(clientThreads.begin() + i);
+                }
+                else
+                    ++i;
+            }
+            if (poll(&pfd, 1, 200) <= 0)
+                continue;
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0)
+                continue;
+            auto client = std::make_shared<Client>(fd);
+            clients.push_back(client);
+            clientThreads.emplace_back(&Server::serveClient, this, client);
+        }
+
+        close(listenFd);
+        unlink(path.c_str());
+        worker.join();
+        for (auto &client : clients)
+            client->shutdown();
+        for (auto &t : clientThreads)
+            t.join();
+        printf("Render server stopped\n");
+        return true;
+    }
+}
+
+bool runRenderServer(Scene &scene, const Renderer &defaults, const std::string &socketPath)
+{
+    Server server(scene, defaults);
+    return server.run(socketPath);
+}
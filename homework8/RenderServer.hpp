@@ -0,0 +1,33 @@
+//
+// Long-running render server.
+//
+// The scene (meshes, BVHs, materials) is loaded once by main and then kept
+// resident while render jobs arrive on a Unix domain socket. The protocol is
+// line based, so `socat - UNIX-CONNECT:<path>` is enough to drive it by hand:
+//
+//   render out=FILE [size=WxH] [spp=N] [fov=DEG] [eye=x,y,z] [at=x,y,z] [seed=S]
+//       -> "queued ID", later "progress ID PERCENT" lines and finally
+//          "done ID MILLISECONDS", "cancelled ID" or "failed ID"
+//   cancel ID      -> "ok" / "error ..."   (queued or running job)
+//   status         -> "job ID STATE PERCENT FILE" per pending job, then "end"
+//   shutdown       -> "ok"; queued jobs are cancelled, the running one stops
+//
+// Jobs run one at a time in submission order, each using all render threads.
+// Options that are not given fall back to the command line settings of the
+// server. Relative output paths are relative to the server's working directory.
+// Progress lines are dropped while a client's socket buffer is full, and a
+// client that stops reading for two seconds is disconnected.
+//
+
+#ifndef RAYTRACING_RENDERSERVER_H
+#define RAYTRACING_RENDERSERVER_H
+
+#include <string>
+#include "Renderer.hpp"
+#include "Scene.hpp"
+
+// 监听 socketPath 处理渲染任务，直到收到 shutdown；defaults 提供任务的默认参数。
+// 监听失败时返回 false
+bool runRenderServer(Scene &scene, const Renderer &defaults, const std::string &socketPath);
+
+#endif //RAYTRACING_RENDERSERVER_H
@@ -5,6 +5,16 @@
 #include <fstream>
 #include "Scene.hpp"
 #include "Renderer.hpp"
+#include "ImageWriter.hpp"
+#include "MemoryStats.hpp"
+#include "PerfCounters.hpp"
+#include "RayStats.hpp"
+#include "RenderFarm.hpp"
+#include "TiledFramebuffer.hpp"
+#include "Trace.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <thread>
 #include <vector>
 #include <mutex>
@@ -16,61 +26,209 @@ const float EPSILON = 0.00001;
 // The main render function. This where we iterate over all pixels in the image,
 // generate primary rays and cast these rays into the scene. The content of the
 // framebuffer is saved to a file.
-void Renderer::Render(const Scene &scene)
+bool Renderer::Render(const Scene &scene, const std::string &filename)
 {
-    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+    return render(scene, filename, nullptr);
+}
 
+bool Renderer::RenderToBuffer(const Scene &scene, std::vector<Vector3f> &framebuffer)
+{
+    return render(scene, "", &framebuffer);
+}
+
+bool Renderer::render(const Scene &scene, const std::string &filename, std::vector<Vector3f> *result)
+{
     float scale = tan(deg2rad(scene.fov * 0.5));
     float imageAspectRatio = scene.width / (float)scene.height;
-    Vector3f eye_pos(278, 273, -800);
-    //int m = 0;
+    Vector3f eye_pos = eye;
+    // 相机坐标系：默认相机看向 +z，屏幕向右对应世界坐标的 -x
+    Vector3f forward = normalize(target - eye);
+    Vector3f right = normalize(crossProduct(forward, Vector3f(0, 1, 0)));
+    Vector3f up = crossProduct(right, forward);
 
-    // change the spp value to change sample ammount
-    int spp = 256;
-    std::cout << "SPP: " << spp << "\n";
+    if (!result)
+        std::cout << "SPP: " << spp << "\n";
+    TRACE_ZONE("Render frame");
+    // framebuffer、光线统计和输出时的缓冲区
+    mem::Scope memoryScope(mem::Framebuffer);
 
-    // 784 * 784
-    uint32_t threadNum = 16;
-    std::vector<std::thread> renderTask;
+    // 整幅图放在内存中，或者（tileFile 非空时）放在映射到文件的分块 framebuffer 中；
+    // 多进程渲染时内存中的 framebuffer 要放在与子进程共享的内存里
+    std::vector<Vector3f> framebuffer;
+    std::unique_ptr<SharedMemory> shared;
+    std::unique_ptr<TiledFramebuffer> tiled;
+    Vector3f *pixels = nullptr;
+    if (!tileFile.empty() && !result)
+    {
+        tiled = std::make_unique<TiledFramebuffer>(tileFile, scene.width, scene.height, tileSize);
+        if (!tiled->valid())
+            return false;
+    }
+    else if (workers > 0)
+    {
+        shared = std::make_unique<SharedMemory>(size_t(scene.width) * scene.height * sizeof(Vector3f));
+        if (!shared->valid())
+            return false;
+        pixels = static_cast<Vector3f *>(shared->data());
+    }
+    else
+    {
+        framebuffer.resize(size_t(scene.width) * scene.height);
+        pixels = framebuffer.data();
+    }
 
-    std::mutex mtx;
-    float process = 0; 
-    for (uint32_t i = 0; i < threadNum; ++i)
+    int ts = tiled ? tiled->tileSize() : std::max(1, tileSize);
+    int tilesX = (scene.width + ts - 1) / ts;
+    int tilesY = (scene.height + ts - 1) / ts;
+    int tileCount = tilesX * tilesY;
+
+    // 光线统计（编译时打开 RT_RAY_STATS）：每个分块一份计数，渲染完再合并；
+    // 热力图记录每个像素的遍历代价。多进程渲染时这些也要放在共享内存里
+    std::vector<RayStats> localStats;
+    std::vector<float> localHeat;
+    std::unique_ptr<SharedMemory> sharedStats;
+    RayStats *tileStats = nullptr;
+    float *heat = nullptr;
+    if (rayStatsEnabled)
     {
-        renderTask.emplace_back([&, i]
-                                {
-                                    uint32_t heightPerThread = scene.height / threadNum; // 98
-                                    uint32_t offset = i * heightPerThread;
-                                    uint32_t m = offset * scene.width;
-                                    for (uint32_t j = 0; j < heightPerThread && (offset + j) < scene.height; ++j)
-                                    {
-                                        for (uint32_t k = 0; k < scene.width; ++k)
-                                        {
-                                            float x = (2 * (k + 0.5) / (float)scene.width - 1) * imageAspectRatio * scale;
-                                            float y = (1 - 2 * (offset + j + 0.5) / (float)scene.height) * scale;
+        size_t heatCount = heatmapFile.empty() ? 0 : size_t(scene.width) * scene.height;
+        if (workers > 0)
+        {
+            sharedStats = std::make_unique<SharedMemory>(tileCount * sizeof(RayStats) + heatCount * sizeof(float));
+            if (!sharedStats->valid())
+                return false;
+            tileStats = static_cast<RayStats *>(sharedStats->data());
+            heat = heatCount ? reinterpret_cast<float *>(tileStats + tileCount) : nullptr;
+        }
+        else
+        {
+            localStats.resize(tileCount);
+            localHeat.resize(heatCount);
+            tileStats = localStats.data();
+            heat = heatCount ? localHeat.data() : nullptr;
+        }
+    }
+    auto renderStart = std::chrono::steady_clock::now();
+
+    // 渲染一个分块。随机数种子只由 seed 和分块编号决定，
+    // 所以不管分块由哪个线程、哪个进程渲染，结果都完全相同
+    auto renderTile = [&](int t)
+    {
+        if (cancel && *cancel)
+            return;
+        TRACE_ZONE("Tile", t);
+        seed_random(uint64_t(seed) * 0x100000001b3ull + t);
+        int x0 = (t % tilesX) * ts, y0 = (t / tilesX) * ts;
+        int x1 = std::min(x0 + ts, scene.width), y1 = std::min(y0 + ts, scene.height);
+        Vector3f *tile = tiled ? tiled->tile(t) : nullptr;
+        if (tileStats)
+            rayStats() = RayStats();
 
-                                            // 为什么相机的位置变了，direction还可以用这个表述方式
-                                            Vector3f dir = normalize(Vector3f(-x, y, 1));
+        for (int j = y0; j < y1; ++j)
+        {
+            for (int k = x0; k < x1; ++k)
+            {
+                float x = (2 * (k + 0.5) / (float)scene.width - 1) * imageAspectRatio * scale;
+                float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
 
-                                            for (int t = 0; t < spp; t++)
+                // 为什么相机的位置变了，direction还可以用这个表述方式
+                Vector3f dir = normalize(x * right + y * up + forward);
+
+                uint64_t cost = heat ? rayStats().boxTests + rayStats().triangleTests : 0;
+                Vector3f color;
+                for (int s = 0; s < spp; s++)
+                {
+                    RT_STAT(cameraRays);
+                    color += scene.castRay(Ray(eye_pos, dir), 0) / spp;
+                }
+                if (heat)
+                    heat[size_t(j) * scene.width + k] = float(rayStats().boxTests + rayStats().triangleTests - cost) / spp;
+                if (tile)
+                    tile[(j - y0) * ts + (k - x0)] = color;
+                else
+                    pixels[size_t(j) * scene.width + k] = color;
+            }
+        }
+        if (tiled)
+            tiled->finishTile(t);
+        if (tileStats)
+            tileStats[t] = rayStats();
+    };
+
+    std::mutex mtx;
+    int finishedTiles = 0;
+    auto tileDone = [&](int)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        float done = ++finishedTiles / (float)tileCount;
+        if (progress)
+            progress(done);
+        else
+            UpdateProgress(done);
+    };
+
+    {
+        // 相机光线的数目（每个像素 spp 条），用来算每条光线的指令数和缓存缺失
+        perf::Phase phase("Render tiles");
+        phase.setUnits(uint64_t(scene.width) * scene.height * spp, "camera sample");
+        if (workers > 0)
+        {
+            if (!runRenderFarm(workers, tileCount, renderTile, tileDone))
+                return false;
+        }
+        else
+        {
+            uint32_t threadNum = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+            std::vector<std::thread> renderTask;
+            std::atomic<int> nextTile{0};
+            for (uint32_t i = 0; i < threadNum; ++i)
+            {
+                renderTask.emplace_back([&, i]
+                                        {
+                                            trace::setThreadName("Render " + std::to_string(i));
+                                            // 每个线程不断领取下一个分块，直到所有分块都渲染完
+                                            for (int t = nextTile++; t < tileCount; t = nextTile++)
                                             {
-                                                framebuffer[m] += scene.castRay(Ray(eye_pos, dir), 0) / spp;
+                                                renderTile(t);
+                                                tileDone(t);
                                             }
-                                            ++m;
-                                            ++process;
-                                        }
-
-                                        mtx.try_lock();
-                                        UpdateProgress(process / scene.width / scene.height);
-                                        mtx.unlock();
-                                    }
-                                }); 
+                                        });
+            }
+
+            for (auto &item : renderTask)
+            {
+                item.join();
+            }
+        }
     }
-    UpdateProgress(1.0f);
+    if (cancel && *cancel)
+        return false;
 
-    for (auto &item : renderTask)
+    if (!progress)
     {
-        item.join();
+        UpdateProgress(1.0f);
+        std::cout << "\n";
+    }
+
+    if (tileStats)
+    {
+        RayStats total;
+        for (int t = 0; t < tileCount; ++t)
+            total += tileStats[t];
+        total.print(std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count());
+        if (heat)
+            writeHeatmap(heatmapFile, heat, scene.width, scene.height);
+    }
+    else if (!heatmapFile.empty())
+        fprintf(stderr, "Traversal heatmap needs a build with -DRT_RAY_STATS=ON\n");
+
+    if (result)
+    {
+        if (pixels == framebuffer.data())
+            result->swap(framebuffer);
+        else
+            result->assign(pixels, pixels + size_t(scene.width) * scene.height);
+        return true;
     }
 
     // for (uint32_t j = 0; j < scene.height; ++j)
@@ -96,16 +254,12 @@ void Renderer::Render(const Scene &scene)
     // UpdateProgress(1.f);
 
     // save framebuffer to file
-    // 这里完成gama校正
-    FILE *fp = fopen("spp256.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i)
-    {
-        static unsigned char color[3];
-        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].x), 0.6f));
-        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].y), 0.6f));
-        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].z), 0.6f));
-        fwrite(color, 1, 3, fp);
-    }
-    fclose(fp);
+    // 这里完成gama校正：并行量化，整幅图一次写出（后缀为 .pfm 时保存未截断的浮点结果）；
+    // 分块模式下逐行从分块中拼出图像流式写出
+    TRACE_ZONE("Tone map + write", filename);
+    perf::Phase phase("Tone map + write");
+    phase.setUnits(uint64_t(scene.width) * scene.height, "pixel");
+    if (tiled)
+        return tiled->writeImage(filename, 0.6f);
+    return writeImage(filename, pixels, scene.width, scene.height, 0.6f);
 }
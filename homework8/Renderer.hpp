@@ -1,6 +1,10 @@
 //
 // Created by goksu on 2/25/20.
 //
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
 #include "Scene.hpp"
 
 #pragma once
@@ -15,7 +19,35 @@ struct hit_payload
 class Renderer
 {
 public:
-    void Render(const Scene& scene);
+    // change the spp value to change sample ammount
+    int spp = 256;
+    // 渲染线程数，0 表示使用全部硬件线程
+    int threads = 0;
+    // 图像按 tileSize x tileSize 分块，线程每次领取一块
+    int tileSize = 32;
+    // 非空时使用以该文件为后备存储的分块 framebuffer（out-of-core，用于超大分辨率）
+    std::string tileFile;
+    // 大于 0 时 fork 出这么多个子进程分块渲染（每个进程单线程），结果与单进程渲染完全相同
+    int workers = 0;
+    // 随机数种子，每个分块的种子由它和分块编号决定
+    uint32_t seed = 0;
+    // 非空时写出每个像素遍历代价的热力图（需要用 -DRT_RAY_STATS=ON 编译）
+    std::string heatmapFile;
+
+    // 相机：位置和看向的点（上方向为 +y），视场角和分辨率来自 scene
+    Vector3f eye = Vector3f(278, 273, -800);
+    Vector3f target = Vector3f(278, 273, 0);
+    // 非空时代替命令行进度条接收渲染进度（0~1）；多线程渲染时会在持锁状态下调用
+    std::function<void(float)> progress;
+    // 非空且被置位时，尚未开始的分块不再渲染，Render 返回 false 且不写文件
+    // （多进程渲染时子进程看不到这个标志，只在单进程多线程渲染中生效）
+    const std::atomic<bool>* cancel = nullptr;
+
+    // 渲染并写出图像，被取消或者失败时返回 false
+    bool Render(const Scene& scene, const std::string& filename = "spp256.ppm");
+    // 只渲染到内存中（线性的辐射度，不做 tone map，不使用 tileFile），用于渐进渲染
+    bool RenderToBuffer(const Scene& scene, std::vector<Vector3f>& framebuffer);
 
 private:
+    bool render(const Scene& scene, const std::string& filename, std::vector<Vector3f>* result);
 };
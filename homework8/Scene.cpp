@@ -2,12 +2,47 @@
 // Created by Göksu Güvendiren on 2019-05-14.
 //
 
+#include <chrono>
 #include "Scene.hpp"
+#include "MemoryStats.hpp"
+#include "RayStats.hpp"
+#include "Trace.hpp"
+
+void Scene::waitForLoads()
+{
+    if (pendingLoads.empty())
+        return;
+    TRACE_ZONE("Wait for loads");
+    auto start = std::chrono::steady_clock::now();
+    for (auto& load : pendingLoads)
+    {
+        objects[load.first] = load.second();
+        ownedObjects.emplace_back(objects[load.first]);
+    }
+    pendingLoads.clear();
+    loadPool.reset();
+    auto stop = std::chrono::steady_clock::now();
+    printf(" - Waited %.1f ms for asynchronous loads\n", std::chrono::duration<double, std::milli>(stop - start).count());
+}
 
 void Scene::buildBVH()
 {
+    waitForLoads();
+    TRACE_ZONE("Scene BVH build");
     printf(" - Generating BVH...\n\n");
+    mem::Scope scope(mem::BVH);
     this->bvh = new BVHAccel(objects, 1, BVHAccel::SplitMethod::NAIVE);
+    if (bvhTreeletSize > 0)
+        this->bvh->optimizeTreelets(bvhTreeletSize);
+    this->bvh->compress();
+}
+
+void Scene::updateBVH()
+{
+    TRACE_ZONE("Scene BVH update");
+    mem::Scope scope(mem::BVH);
+    if (this->bvh->update())
+        printf(" - Scene BVH rebuilt\n");
 }
 
 Intersection Scene::intersect(const Ray &ray) const
@@ -76,6 +111,7 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
 
     if (inter.happened)
     {
+        RT_STAT_MAX(maxPathLength, depth + 1);
         // 如果射线打到光源，直接返回
         if (inter.m->hasEmission())
         {
@@ -107,6 +143,7 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
         Vector3f direction = distance.normalized();
 
         Ray light(objectPos, direction);
+        RT_STAT(shadowRays);
         Intersection interTemp = intersect(light);
 
         // 如果采样到的光源判定为遮挡，则认为直接光照项为0
@@ -122,6 +159,7 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
             
             // 随机产生一条光线
             Ray nextRay(objectPos, nextDir);
+            RT_STAT(bounceRays);
             // 计算机交点
             Intersection nextInter = intersect(nextRay);
 
@@ -133,6 +171,8 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
                 L_indir = castRay(nextRay, depth + 1) * fr * dotProduct(nextDir, objectNormal) / pdf / RussianRoulette;
             }
         }
+        else
+            RT_STAT(rrTerminations);
 
         return L_indir + L_dir;
     }
@@ -4,6 +4,10 @@
 
 #pragma once
 
+#include <functional>
+#include <future>
+#include <memory>
+#include <tuple>
 #include <vector>
 #include "Vector.hpp"
 #include "Object.hpp"
@@ -11,6 +15,7 @@
 #include "AreaLight.hpp"
 #include "BVH.hpp"
 #include "Ray.hpp"
+#include "TaskPool.hpp"
 
 
 class Scene
@@ -30,6 +35,25 @@ public:
     void Add(Object *object) { objects.push_back(object); }
     void Add(std::unique_ptr<Light> light) { lights.push_back(std::move(light)); }
 
+    // 异步添加物体：在任务池中构造 T（读入模型并建好它自己的 BVH），场景持有构造出的对象。
+    // 物体在场景中的顺序与调用顺序一致，buildBVH 之前会等待全部载入完成
+    template <typename T, typename... Args>
+    std::shared_future<T*> AddAsync(Args&&... args)
+    {
+        if (!loadPool)
+            loadPool = std::make_unique<TaskPool>();
+
+        size_t slot = objects.size();
+        objects.push_back(nullptr);
+        auto result = loadPool->submit([params = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+            return std::apply([](auto&&... a) { return new T(std::move(a)...); }, std::move(params));
+        }).share();
+        pendingLoads.emplace_back(slot, [result] { return static_cast<Object*>(result.get()); });
+        return result;
+    }
+    // 等待所有 AddAsync 完成（载入时的异常在这里重新抛出）
+    void waitForLoads();
+
     const std::vector<Object*>& get_objects() const { return objects; }
     const std::vector<std::unique_ptr<Light> >&  get_lights() const { return lights; }
     Intersection intersect(const Ray& ray) const;
@@ -37,6 +61,8 @@ public:
     // BVH加速结构
     BVHAccel *bvh;
     void buildBVH();
+    // 动画序列每帧调用：模型移动之后 refit 场景 BVH，质量下降太多时重建
+    void updateBVH();
 
     Vector3f castRay(const Ray &ray, int depth) const;
     void sampleLight(Intersection &pos, float &pdf) const;
@@ -49,6 +75,10 @@ public:
     // creating the scene (adding objects and lights)
     std::vector<Object* > objects;
     std::vector<std::unique_ptr<Light> > lights;
+    // AddAsync 构造的物体由场景释放
+    std::vector<std::unique_ptr<Object> > ownedObjects;
+    std::unique_ptr<TaskPool> loadPool;
+    std::vector<std::pair<size_t, std::function<Object*()> > > pendingLoads;
 
     // Compute reflection direction
     Vector3f reflect(const Vector3f &I, const Vector3f &N) const
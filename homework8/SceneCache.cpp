@@ -0,0 +1,294 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "SceneCache.hpp"
+
+namespace
+{
+    const char kMagic[8] = "RTCACHE";
+    const char *kCacheDir = "scene_cache";
+
+    inline uint64_t alignUp(uint64_t x) { return (x + 63) & ~uint64_t(63); }
+
+    inline uint64_t fnv1a(const void *data, size_t n, uint64_t h = 1469598103934665603ull)
+    {
+        auto *p = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < n; ++i)
+        {
+            h ^= p[i];
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    // 深度优先展开二叉树，返回结点下标
+    int32_t flatten(const BVHBuildNode *node, std::vector<CachedBuildNode> &out,
+                    const std::function<uint32_t(const Object *)> &primIndex)
+    {
+        int32_t index = out.size();
+        out.emplace_back();
+        {
+            CachedBuildNode &c = out[index];
+            for (int a = 0; a < 3; ++a)
+            {
+                c.pMin[a] = node->bounds.pMin[a];
+                c.pMax[a] = node->bounds.pMax[a];
+            }
+            c.area = node->area;
+            c.right = -1;
+            c.prim = node->object ? primIndex(node->object) : 0;
+        }
+        if (node->left && node->right)
+        {
+            flatten(node->left, out, primIndex);
+            int32_t right = flatten(node->right, out, primIndex);
+            out[index].right = right;
+        }
+        return index;
+    }
+
+    BVHBuildNode *unflatten(const CachedBuildNode *nodes, int32_t &index, const std::vector<Object *> &primitives)
+    {
+        const CachedBuildNode &c = nodes[index++];
+        BVHBuildNode *node = new BVHBuildNode();
+        node->bounds = Bounds3(Vector3f(c.pMin[0], c.pMin[1], c.pMin[2]), Vector3f(c.pMax[0], c.pMax[1], c.pMax[2]));
+        node->area = c.area;
+        if (c.right < 0)
+        {
+            node->object = primitives[c.prim];
+            return node;
+        }
+        node->left = unflatten(nodes, index, primitives);
+        node->right = unflatten(nodes, index, primitives);
+        return node;
+    }
+
+    // stat 失败时返回 false
+    bool statSource(const std::string &path, uint64_t &size, uint64_t &mtimeNs, uint64_t &inode)
+    {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0)
+            return false;
+        size = st.st_size;
+        mtimeNs = uint64_t(st.st_mtim.tv_sec) * 1000000000ull + st.st_mtim.tv_nsec;
+        inode = st.st_ino;
+        return true;
+    }
+
+    bool writeAt(FILE *f, uint64_t offset, const void *data, size_t n)
+    {
+        return std::fseek(f, long(offset), SEEK_SET) == 0 && std::fwrite(data, 1, n, f) == n;
+    }
+}
+
+MeshCache::~MeshCache()
+{
+    if (mapping)
+        munmap(mapping, mappingSize);
+}
+
+std::string MeshCache::cachePath(const std::string &objPath)
+{
+    // "../models/bunny/bunny.obj" -> "scene_cache/models_bunny_bunny.obj.<hash>.rtcache"
+    // 展开后的名字只是为了好认，a/b_c.obj 和 a_b/c.obj 会得到同一个名字，所以再加上绝对路径的 hash
+    std::string name;
+    for (char c : objPath)
+    {
+        if (c == '/' || c == '\\')
+        {
+            if (!name.empty() && name.back() != '_')
+                name += '_';
+        }
+        else if (c != '.' || !name.empty())
+            name += c;
+    }
+    while (!name.empty() && name[0] == '_')
+        name.erase(0, 1);
+
+    char *real = realpath(objPath.c_str(), nullptr);
+    std::string canonical = real ? real : objPath;
+    std::free(real);
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)fnv1a(canonical.data(), canonical.size()));
+    return std::string(kCacheDir) + "/" + name + "." + hash + ".rtcache";
+}
+
+uint64_t MeshCache::hashFile(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    uint64_t h = 0;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            h = fnv1a(p, st.st_size);
+            munmap(p, st.st_size);
+        }
+    }
+    ::close(fd);
+    return h;
+}
+
+uint64_t MeshCache::hashParams(std::initializer_list<uint64_t> params)
+{
+    uint64_t h = fnv1a(&kVersion, sizeof(kVersion));
+    uint64_t layout[] = {sizeof(CompressedBVHNode), sizeof(CachedBuildNode), sizeof(MeshCacheHeader)};
+    h = fnv1a(layout, sizeof(layout), h);
+    for (uint64_t p : params)
+        h = fnv1a(&p, sizeof(p), h);
+    return h;
+}
+
+bool MeshCache::open(const std::string &objPath, uint64_t paramsHash)
+{
+    std::string path = cachePath(objPath);
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(MeshCacheHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+
+    auto *h = static_cast<const MeshCacheHeader *>(p);
+    uint64_t size = st.st_size;
+    bool valid = std::memcmp(h->magic, kMagic, sizeof(kMagic)) == 0 && h->version == kVersion &&
+                 h->paramsHash == paramsHash &&
+                 h->trianglesOffset + h->triangleCount * 9 * sizeof(float) <= size &&
+                 h->nodesOffset + h->nodeCount * sizeof(CompressedBVHNode) <= size &&
+                 // 没有保存二叉树时 buildNodesOffset 可能在文件末尾之外
+                 (h->buildNodeCount == 0 || h->buildNodesOffset + h->buildNodeCount * sizeof(CachedBuildNode) <= size);
+    uint64_t srcSize, srcMtime, srcInode;
+    if (valid && !statSource(objPath, srcSize, srcMtime, srcInode))
+        valid = false;
+    else if (valid && (h->sourceSize != srcSize || h->sourceMtimeNs != srcMtime || h->sourceInode != srcInode))
+    {
+        // 文件被 touch 或复制过时才读整个 OBJ 比较内容；内容没变就把新的 stat 信息写回头部
+        valid = h->sourceHash == hashFile(objPath);
+        if (valid)
+        {
+            uint64_t stamp[3] = {srcSize, srcMtime, srcInode};
+            int wfd = ::open(path.c_str(), O_WRONLY);
+            if (wfd >= 0)
+            {
+                if (pwrite(wfd, stamp, sizeof(stamp), offsetof(MeshCacheHeader, sourceSize)) != ssize_t(sizeof(stamp)))
+                    std::printf("Scene cache [%s]: failed to refresh %s\n", objPath.c_str(), path.c_str());
+                ::close(wfd);
+            }
+        }
+    }
+    if (!valid)
+    {
+        munmap(p, st.st_size);
+        return false;
+    }
+
+    mapping = p;
+    mappingSize = st.st_size;
+    header = h;
+    // 顶点只在重建三角形时读一次，其余（BVH 结点）在渲染时直接使用
+    size_t vertexBytes = h->triangleCount * 9 * sizeof(float);
+    mappedVertices.reset(mem::Geometry, vertexBytes);
+    mappedNodes.reset(mem::BVH, mappingSize - vertexBytes);
+    return true;
+}
+
+const float *MeshCache::vertices() const
+{
+    return reinterpret_cast<const float *>(static_cast<const char *>(mapping) + header->trianglesOffset);
+}
+
+const CompressedBVHNode *MeshCache::nodes() const
+{
+    return reinterpret_cast<const CompressedBVHNode *>(static_cast<const char *>(mapping) + header->nodesOffset);
+}
+
+Bounds3 MeshCache::bounds() const
+{
+    return Bounds3(Vector3f(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]),
+                   Vector3f(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]));
+}
+
+BVHBuildNode *MeshCache::buildTree(const std::vector<Object *> &primitives) const
+{
+    if (header->buildNodeCount == 0)
+        return nullptr;
+    auto *nodes = reinterpret_cast<const CachedBuildNode *>(static_cast<const char *>(mapping) + header->buildNodesOffset);
+    int32_t index = 0;
+    return unflatten(nodes, index, primitives);
+}
+
+bool MeshCache::save(const std::string &objPath, uint64_t paramsHash,
+                     const std::vector<Vector3f> &vertices, const Bounds3 &bounds, const BVHAccel &bvh,
+                     const std::function<uint32_t(const Object *)> &primIndex)
+{
+    if (!bvh.compressed)
+        return false;
+
+    std::vector<CachedBuildNode> buildNodes;
+    if (bvh.root)
+        flatten(bvh.root, buildNodes, primIndex);
+
+    std::vector<float> flat;
+    flat.reserve(vertices.size() * 3);
+    for (auto &v : vertices)
+    {
+        flat.push_back(v.x);
+        flat.push_back(v.y);
+        flat.push_back(v.z);
+    }
+
+    MeshCacheHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.sourceHash = hashFile(objPath);
+    statSource(objPath, h.sourceSize, h.sourceMtimeNs, h.sourceInode);
+    h.paramsHash = paramsHash;
+    h.triangleCount = vertices.size() / 3;
+    h.nodeCount = bvh.compressed->nodeCount();
+    h.buildNodeCount = buildNodes.size();
+    h.trianglesOffset = alignUp(sizeof(MeshCacheHeader));
+    h.nodesOffset = alignUp(h.trianglesOffset + flat.size() * sizeof(float));
+    h.buildNodesOffset = alignUp(h.nodesOffset + h.nodeCount * sizeof(CompressedBVHNode));
+    for (int a = 0; a < 3; ++a)
+    {
+        h.boundsMin[a] = bounds.pMin[a];
+        h.boundsMax[a] = bounds.pMax[a];
+    }
+
+    mkdir(kCacheDir, 0755);
+    std::string path = cachePath(objPath);
+    // 先写临时文件再 rename，中途退出也不会留下写了一半的缓存；临时文件名带上进程号，同时运行的几个进程不会写同一个文件
+    std::string tmp = path + "." + std::to_string(getpid()) + ".tmp";
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = writeAt(f, 0, &h, sizeof(h)) &&
+              writeAt(f, h.trianglesOffset, flat.data(), flat.size() * sizeof(float)) &&
+              writeAt(f, h.nodesOffset, bvh.compressed->data(), h.nodeCount * sizeof(CompressedBVHNode)) &&
+              writeAt(f, h.buildNodesOffset, buildNodes.data(), buildNodes.size() * sizeof(CachedBuildNode));
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,98 @@
+//
+// Binary cache of processed meshes.
+//
+// For every OBJ file we store the triangle vertices, the compressed 4-wide
+// BVH and (for emissive / animated meshes) the flattened binary BVH in one
+// file under scene_cache/. The file is memory-mapped read-only on the next run:
+// the compressed nodes are traversed directly from the mapping, so startup no
+// longer parses the OBJ text or sorts primitives.
+//
+// A cache file is only used when both the hash of the OBJ file and the hash of
+// the build parameters match its header; otherwise it is rebuilt. The OBJ is
+// only read and hashed again when its size, mtime or inode differ from the
+// ones recorded in the header.
+//
+
+#ifndef RAYTRACING_SCENECACHE_H
+#define RAYTRACING_SCENECACHE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "BVH.hpp"
+#include "CompressedBVH.hpp"
+#include "MemoryStats.hpp"
+
+// 关闭后每次都重新解析 OBJ 并建 BVH（main 的 --no-cache）
+inline bool sceneCacheEnabled = true;
+
+struct MeshCacheHeader
+{
+    char magic[8]; // "RTCACHE"
+    uint32_t version;
+    uint32_t flags;
+    uint64_t sourceHash;
+    // 生成缓存时 OBJ 文件的 stat 信息，都没变时不再读文件算 hash
+    uint64_t sourceSize;
+    uint64_t sourceMtimeNs;
+    uint64_t sourceInode;
+    uint64_t paramsHash;
+    uint64_t triangleCount;
+    uint64_t nodeCount;
+    uint64_t buildNodeCount;
+    uint64_t trianglesOffset;
+    uint64_t nodesOffset;
+    uint64_t buildNodesOffset;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+// 二叉 BVH 按深度优先顺序展开，左子节点总是紧跟在父结点之后
+struct CachedBuildNode
+{
+    float pMin[3], pMax[3];
+    float area;
+    int32_t right; // 右子节点下标，叶子为 -1
+    uint32_t prim; // 叶子引用的图元下标
+};
+
+class MeshCache
+{
+public:
+    static constexpr uint32_t kVersion = 2;
+
+    MeshCache() = default;
+    ~MeshCache();
+    MeshCache(const MeshCache &) = delete;
+    MeshCache &operator=(const MeshCache &) = delete;
+
+    // objPath 对应的缓存存在且 hash 都匹配时返回 true
+    bool open(const std::string &objPath, uint64_t paramsHash);
+
+    size_t triangleCount() const { return header->triangleCount; }
+    // 每个三角形 9 个 float（v0, v1, v2）
+    const float *vertices() const;
+    const CompressedBVHNode *nodes() const;
+    size_t nodeCount() const { return header->nodeCount; }
+    Bounds3 bounds() const;
+    // 缓存中没有二叉树时返回 nullptr
+    BVHBuildNode *buildTree(const std::vector<Object *> &primitives) const;
+
+    static std::string cachePath(const std::string &objPath);
+    static uint64_t hashFile(const std::string &path);
+    static uint64_t hashParams(std::initializer_list<uint64_t> params);
+
+    // vertices 为每个三角形 3 个顶点；primIndex 把叶子中的图元映射回下标
+    static bool save(const std::string &objPath, uint64_t paramsHash,
+                     const std::vector<Vector3f> &vertices, const Bounds3 &bounds, const BVHAccel &bvh,
+                     const std::function<uint32_t(const Object *)> &primIndex);
+
+private:
+    const MeshCacheHeader *header = nullptr;
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+    mem::External mappedVertices, mappedNodes;
+};
+
+#endif //RAYTRACING_SCENECACHE_H
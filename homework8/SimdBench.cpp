@@ -0,0 +1,163 @@
+//
+// Microbenchmarks comparing the scalar Vector3f kernels with the SimdVector3f
+// versions on the two hottest tests of the tracer: the ray/box slab test of
+// Bounds3 and the Moller-Trumbore ray/triangle test of Triangle.
+//
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdio>
+#include "Bounds3.hpp"
+#include "SimdVector.hpp"
+#include "Triangle.hpp"
+
+const float EPSILON = 0.00001;
+
+namespace
+{
+    // 固定种子，保证每次运行的输入相同
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+    Vector3f randomVector() { return Vector3f(dist(rng), dist(rng), dist(rng)); }
+
+    struct BoxRay
+    {
+        Bounds3 box;
+        Ray ray;
+    };
+
+    struct TriRay
+    {
+        Vector3f v0, v1, v2;
+        Ray ray;
+    };
+
+    // SIMD 版本的 slab 测试：一次算出三个轴的进入/离开时间
+    inline bool intersectPSimd(const SimdVector3f &pMin, const SimdVector3f &pMax,
+                               const SimdVector3f &orig, const SimdVector3f &invDir)
+    {
+        SimdVector3f t1 = (pMin - orig) * invDir;
+        SimdVector3f t2 = (pMax - orig) * invDir;
+        float t_enter = SimdVector3f::Min(t1, t2).maxComponent();
+        float t_exit = SimdVector3f::Max(t1, t2).minComponent();
+        return t_enter <= t_exit && t_exit > 0;
+    }
+
+    inline bool rayTriangleIntersectSimd(const SimdVector3f &v0, const SimdVector3f &v1,
+                                         const SimdVector3f &v2, const SimdVector3f &orig,
+                                         const SimdVector3f &dir, float &tnear)
+    {
+        SimdVector3f edge1 = v1 - v0;
+        SimdVector3f edge2 = v2 - v0;
+        SimdVector3f pvec = crossProduct(dir, edge2);
+        float det = dotProduct(edge1, pvec);
+        if (det <= 0)
+            return false;
+
+        SimdVector3f tvec = orig - v0;
+        float u = dotProduct(tvec, pvec);
+        if (u < 0 || u > det)
+            return false;
+
+        SimdVector3f qvec = crossProduct(tvec, edge1);
+        float v = dotProduct(dir, qvec);
+        if (v < 0 || u + v > det)
+            return false;
+
+        tnear = dotProduct(edge2, qvec) / det;
+        return true;
+    }
+
+    template <typename F>
+    double timeNs(int reps, size_t n, F &&f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < reps; ++r)
+            f();
+        auto stop = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(stop - start).count() / (double(reps) * n);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const size_t n = 1 << 16;
+    const int reps = argc > 1 ? std::atoi(argv[1]) : 50;
+
+    std::vector<BoxRay> boxRays;
+    std::vector<TriRay> triRays;
+    boxRays.reserve(n);
+    triRays.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        // 光线瞄准盒子中心再加上抖动，大约一半命中，两条分支都计时（完全随机的方向几乎都提前返回）
+        Vector3f c = randomVector() * 4.0f;
+        Bounds3 box(c - Vector3f(0.5f), c + Vector3f(0.5f));
+        Vector3f boxOrig = randomVector() * 8.0f;
+        boxRays.push_back({box, Ray(boxOrig, normalize(c + randomVector() * 0.8f - boxOrig))});
+
+        Vector3f orig = randomVector() * 4.0f;
+        Vector3f v0 = randomVector(), v1 = randomVector(), v2 = randomVector();
+        triRays.push_back({v0, v1, v2, Ray(orig, normalize((v0 + v1 + v2) / 3 + randomVector() * 0.3f - orig))});
+    }
+
+    std::vector<SimdVector3f> sBox, sTri;
+    sBox.reserve(4 * n);
+    sTri.reserve(5 * n);
+    for (auto &b : boxRays)
+    {
+        sBox.emplace_back(b.box.pMin);
+        sBox.emplace_back(b.box.pMax);
+        sBox.emplace_back(b.ray.origin);
+        sBox.emplace_back(b.ray.direction_inv);
+    }
+    for (auto &t : triRays)
+    {
+        sTri.emplace_back(t.v0);
+        sTri.emplace_back(t.v1);
+        sTri.emplace_back(t.v2);
+        sTri.emplace_back(t.ray.origin);
+        sTri.emplace_back(t.ray.direction);
+    }
+
+    size_t hitsScalar = 0, hitsSimd = 0;
+    double boxScalar = timeNs(reps, n, [&]
+    {
+        for (auto &b : boxRays)
+        {
+            std::array<int, 3> dirIsNeg = {b.ray.direction.x > 0, b.ray.direction.y > 0, b.ray.direction.z > 0};
+            hitsScalar += b.box.IntersectP(b.ray, b.ray.direction_inv, dirIsNeg);
+        }
+    });
+    double boxSimd = timeNs(reps, n, [&]
+    {
+        for (size_t i = 0; i < n; ++i)
+            hitsSimd += intersectPSimd(sBox[4 * i], sBox[4 * i + 1], sBox[4 * i + 2], sBox[4 * i + 3]);
+    });
+    printf("Bounds3::IntersectP   scalar %7.2f ns  simd %7.2f ns  speedup %.2fx  (hits %zu / %zu)\n",
+           boxScalar, boxSimd, boxScalar / boxSimd, hitsScalar / reps, hitsSimd / reps);
+
+    hitsScalar = hitsSimd = 0;
+    double triScalar = timeNs(reps, n, [&]
+    {
+        for (auto &t : triRays)
+        {
+            float tnear, u, v;
+            hitsScalar += rayTriangleIntersect(t.v0, t.v1, t.v2, t.ray.origin, t.ray.direction, tnear, u, v);
+        }
+    });
+    double triSimd = timeNs(reps, n, [&]
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            float tnear;
+            hitsSimd += rayTriangleIntersectSimd(sTri[5 * i], sTri[5 * i + 1], sTri[5 * i + 2],
+                                                 sTri[5 * i + 3], sTri[5 * i + 4], tnear);
+        }
+    });
+    printf("rayTriangleIntersect  scalar %7.2f ns  simd %7.2f ns  speedup %.2fx  (hits %zu / %zu)\n",
+           triScalar, triSimd, triScalar / triSimd, hitsScalar / reps, hitsSimd / reps);
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+//
+// 4-lane (x, y, z, 0) vector used as the SIMD backend of the ray tracers.
+//
+// The backend is picked at compile time:
+//   - SSE  when __SSE__ / x86-64 is available
+//   - NEON when __ARM_NEON is available
+//   - a plain scalar fallback otherwise, or when RT_SIMD_SCALAR is defined
+//
+// The interface mirrors Vector3f (dot, cross, Min/Max, normalize, lerp ...),
+// so kernels can be switched over one at a time.
+//
+#pragma once
+#ifndef RAYTRACING_SIMDVECTOR_H
+#define RAYTRACING_SIMDVECTOR_H
+
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+#include "Vector.hpp"
+
+#if !defined(RT_SIMD_SCALAR) && (defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64))
+#define RT_SIMD_SSE 1
+#include <xmmintrin.h>
+#elif !defined(RT_SIMD_SCALAR) && defined(__ARM_NEON)
+#define RT_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define RT_SIMD_SCALAR_BACKEND 1
+#endif
+
+class alignas(16) SimdVector3f
+{
+public:
+#if defined(RT_SIMD_SSE)
+    using native_type = __m128;
+#elif defined(RT_SIMD_NEON)
+    using native_type = float32x4_t;
+#else
+    struct native_type { float v[4]; };
+#endif
+
+    native_type v;
+
+    SimdVector3f() : SimdVector3f(0.0f) {}
+    SimdVector3f(float xx) : SimdVector3f(xx, xx, xx) {}
+    SimdVector3f(float xx, float yy, float zz)
+    {
+#if defined(RT_SIMD_SSE)
+        v = _mm_set_ps(0.0f, zz, yy, xx);
+#elif defined(RT_SIMD_NEON)
+        float tmp[4] = {xx, yy, zz, 0.0f};
+        v = vld1q_f32(tmp);
+#else
+        v = {{xx, yy, zz, 0.0f}};
+#endif
+    }
+    explicit SimdVector3f(const Vector3f &p) : SimdVector3f(p.x, p.y, p.z) {}
+    explicit SimdVector3f(native_type n) : v(n) {}
+
+    Vector3f toVector3f() const
+    {
+        alignas(16) float f[4];
+        store(f);
+        return Vector3f(f[0], f[1], f[2]);
+    }
+
+    void store(float *f) const
+    {
+#if defined(RT_SIMD_SSE)
+        _mm_storeu_ps(f, v);
+#elif defined(RT_SIMD_NEON)
+        vst1q_f32(f, v);
+#else
+        f[0] = v.v[0], f[1] = v.v[1], f[2] = v.v[2], f[3] = v.v[3];
+#endif
+    }
+
+    float x() const { return (*this)[0]; }
+    float y() const { return (*this)[1]; }
+    float z() const { return (*this)[2]; }
+
+    float operator[](int index) const
+    {
+        alignas(16) float f[4];
+        store(f);
+        return f[index];
+    }
+
+    SimdVector3f operator+(const SimdVector3f &o) const
+    {
+#if defined(RT_SIMD_SSE)
+        return SimdVector3f(_mm_add_ps(v, o.v));
+#elif defined(RT_SIMD_NEON)
+        return SimdVector3f(vaddq_f32(v, o.v));
+#else
+        return SimdVector3f(v.v[0] + o.v.v[0], v.v[1] + o.v.v[1], v.v[2] + o.v.v[2]);
+#endif
+    }
+    SimdVector3f operator-(const SimdVector3f &o) const
+    {
+#if defined(RT_SIMD_SSE)
+        return SimdVector3f(_mm_sub_ps(v, o.v));
+#elif defined(RT_SIMD_NEON)
+        return SimdVector3f(vsubq_f32(v, o.v));
+#else
+        return SimdVector3f(v.v[0] - o.v.v[0], v.v[1] - o.v.v[1], v.v[2] - o.v.v[2]);
+#endif
+    }
+    SimdVector3f operator*(const SimdVector3f &o) const
+    {
+#if defined(RT_SIMD_SSE)
+        return SimdVector3f(_mm_mul_ps(v, o.v));
+#elif defined(RT_SIMD_NEON)
+        return SimdVector3f(vmulq_f32(v, o.v));
+#else
+        return SimdVector3f(v.v[0] * o.v.v[0], v.v[1] * o.v.v[1], v.v[2] * o.v.v[2]);
+#endif
+    }
+    SimdVector3f operator*(const float &r) const { return *this * SimdVector3f(r); }
+    SimdVector3f operator/(const float &r) const { return *this * SimdVector3f(1.0f / r); }
+    SimdVector3f operator-() const { return SimdVector3f(0.0f) - *this; }
+    SimdVector3f &operator+=(const SimdVector3f &o) { return *this = *this + o; }
+
+    friend SimdVector3f operator*(const float &r, const SimdVector3f &o) { return o * r; }
+    friend std::ostream &operator<<(std::ostream &os, const SimdVector3f &o)
+    { return os << o.x() << ", " << o.y() << ", " << o.z(); }
+
+    float squareNorm() const;
+    float norm() const { return std::sqrt(squareNorm()); }
+    SimdVector3f normalized() const { return *this / norm(); }
+
+    static SimdVector3f Min(const SimdVector3f &p1, const SimdVector3f &p2)
+    {
+#if defined(RT_SIMD_SSE)
+        return SimdVector3f(_mm_min_ps(p1.v, p2.v));
+#elif defined(RT_SIMD_NEON)
+        return SimdVector3f(vminq_f32(p1.v, p2.v));
+#else
+        return SimdVector3f(std::min(p1.v.v[0], p2.v.v[0]), std::min(p1.v.v[1], p2.v.v[1]),
+                            std::min(p1.v.v[2], p2.v.v[2]));
+#endif
+    }
+
+    static SimdVector3f Max(const SimdVector3f &p1, const SimdVector3f &p2)
+    {
+#if defined(RT_SIMD_SSE)
+        return SimdVector3f(_mm_max_ps(p1.v, p2.v));
+#elif defined(RT_SIMD_NEON)
+        return SimdVector3f(vmaxq_f32(p1.v, p2.v));
+#else
+        return SimdVector3f(std::max(p1.v.v[0], p2.v.v[0]), std::max(p1.v.v[1], p2.v.v[1]),
+                            std::max(p1.v.v[2], p2.v.v[2]));
+#endif
+    }
+
+    // x, y, z 三个分量中的最大/最小值（w 分量不参与）
+    float maxComponent() const { return std::max(x(), std::max(y(), z())); }
+    float minComponent() const { return std::min(x(), std::min(y(), z())); }
+};
+
+inline float dotProduct(const SimdVector3f &a, const SimdVector3f &b)
+{
+#if defined(RT_SIMD_SSE)
+    // w 分量恒为 0，所以直接做 4 个分量的水平相加
+    __m128 m = _mm_mul_ps(a.v, b.v);
+    __m128 s = _mm_add_ps(m, _mm_movehl_ps(m, m));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(s);
+#elif defined(RT_SIMD_NEON)
+    float32x4_t m = vmulq_f32(a.v, b.v);
+    float32x2_t s = vadd_f32(vget_low_f32(m), vget_high_f32(m));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+#else
+    return a.v.v[0] * b.v.v[0] + a.v.v[1] * b.v.v[1] + a.v.v[2] * b.v.v[2];
+#endif
+}
+
+inline float SimdVector3f::squareNorm() const { return dotProduct(*this, *this); }
+
+inline SimdVector3f crossProduct(const SimdVector3f &a, const SimdVector3f &b)
+{
+#if defined(RT_SIMD_SSE)
+    // (a.yzx * b.zxy - a.zxy * b.yzx)，w 分量保持为 0
+    __m128 a_yzx = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_yzx = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a.v, b_yzx), _mm_mul_ps(a_yzx, b.v));
+    return SimdVector3f(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+#else
+    float ax = a.x(), ay = a.y(), az = a.z();
+    float bx = b.x(), by = b.y(), bz = b.z();
+    return SimdVector3f(ay * bz - az * by, az * bx - ax * bz, ax * by - ay * bx);
+#endif
+}
+
+inline SimdVector3f normalize(const SimdVector3f &v)
+{
+    float mag2 = dotProduct(v, v);
+    if (mag2 > 0)
+        return v * (1 / sqrtf(mag2));
+
+    return v;
+}
+
+inline SimdVector3f lerp(const SimdVector3f &a, const SimdVector3f &b, const float &t)
+{ return a * (1 - t) + b * t; }
+
+#endif //RAYTRACING_SIMDVECTOR_H
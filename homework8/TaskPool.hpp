@@ -0,0 +1,104 @@
+//
+// Small fixed-size thread pool used for scene setup (loading meshes and
+// building their BVHs concurrently). submit() returns a std::future of the
+// task's result; wait() blocks until every submitted task has finished.
+//
+
+#ifndef RAYTRACING_TASKPOOL_H
+#define RAYTRACING_TASKPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Trace.hpp"
+
+class TaskPool
+{
+public:
+    // threads = 0 使用全部硬件线程
+    explicit TaskPool(unsigned int threads = 0)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 0; i < threads; ++i)
+            workers.emplace_back([this] { run(); });
+    }
+
+    ~TaskPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &w : workers)
+            w.join();
+    }
+
+    TaskPool(const TaskPool &) = delete;
+    TaskPool &operator=(const TaskPool &) = delete;
+
+    // 任务抛出的异常会在 future.get() 时重新抛出
+    template <typename F>
+    auto submit(F &&f) -> std::future<decltype(f())>
+    {
+        using R = decltype(f());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.emplace_back([task] { (*task)(); });
+            ++unfinished;
+        }
+        wake.notify_one();
+        return result;
+    }
+
+    // 等待所有已提交的任务完成
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return unfinished == 0; });
+    }
+
+    size_t size() const { return workers.size(); }
+
+private:
+    void run()
+    {
+        trace::setThreadName("Task pool");
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            job();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--unfinished == 0)
+                    idle.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> queue;
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    size_t unfinished = 0;
+    bool stopping = false;
+};
+
+#endif //RAYTRACING_TASKPOOL_H
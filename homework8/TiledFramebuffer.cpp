@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+#include "ImageWriter.hpp"
+#include "TiledFramebuffer.hpp"
+
+TiledFramebuffer::TiledFramebuffer(const std::string &p, int width, int height, int tileSize)
+    : w(width), h(height), ts(std::max(1, tileSize)), path(p)
+{
+    tx = (w + ts - 1) / ts;
+    ty = (h + ts - 1) / ts;
+    size_t page = sysconf(_SC_PAGESIZE);
+    tileBytes = (size_t(ts) * ts * sizeof(Vector3f) + page - 1) / page * page;
+    mappingSize = tileBytes * tx * ty;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Cannot create tile file %s\n", path.c_str());
+        return;
+    }
+    // 文件是稀疏的，没有渲染到的分块不占磁盘（读出来是 0，正好是黑色）
+    if (ftruncate(fd, mappingSize) != 0)
+    {
+        fprintf(stderr, "Cannot resize tile file %s to %zu bytes\n", path.c_str(), mappingSize);
+        ::close(fd);
+        return;
+    }
+    void *m = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED)
+    {
+        fprintf(stderr, "Cannot map tile file %s\n", path.c_str());
+        return;
+    }
+    mapping = m;
+    mapped.reset(mem::Framebuffer, mappingSize);
+    printf("Tiled framebuffer: %dx%d in %d tiles of %dx%d, backed by %s (%.1f MB)\n",
+           w, h, tx * ty, ts, ts, path.c_str(), mappingSize / 1048576.0);
+}
+
+TiledFramebuffer::~TiledFramebuffer()
+{
+    if (mapping)
+    {
+        munmap(mapping, mappingSize);
+        unlink(path.c_str());
+    }
+}
+
+Vector3f *TiledFramebuffer::tile(int index)
+{
+    return reinterpret_cast<Vector3f *>(static_cast<char *>(mapping) + tileBytes * index);
+}
+
+void TiledFramebuffer::evict(size_t offset, size_t bytes) const
+{
+    // 共享文件映射上 MADV_DONTNEED 只是解除映射，脏页仍在页缓存中并会写回文件
+    char *start = static_cast<char *>(mapping) + offset;
+    msync(start, bytes, MS_ASYNC);
+    madvise(start, bytes, MADV_DONTNEED);
+}
+
+void TiledFramebuffer::finishTile(int index)
+{
+    evict(tileBytes * index, tileBytes);
+}
+
+bool TiledFramebuffer::writeImage(const std::string &filename, float gamma) const
+{
+    ImageStreamWriter writer(filename, w, h, gamma);
+    if (!writer.ok())
+        return false;
+
+    // 每次只读一行分块，拼出图像的一行写出去，这一行分块写完就释放
+    std::vector<Vector3f> row(w);
+    for (int j = 0; j < ty; ++j)
+    {
+        int rows = std::min(ts, h - j * ts);
+        for (int y = 0; y < rows; ++y)
+        {
+            for (int i = 0; i < tx; ++i)
+            {
+                const Vector3f *src = reinterpret_cast<const Vector3f *>(
+                    static_cast<const char *>(mapping) + tileBytes * (size_t(j) * tx + i));
+                int cols = std::min(ts, w - i * ts);
+                std::memcpy(&row[i * ts], src + size_t(y) * ts, cols * sizeof(Vector3f));
+            }
+            if (!writer.writeRow(j * ts + y, row.data()))
+                return false;
+        }
+        evict(tileBytes * size_t(j) * tx, tileBytes * tx);
+    }
+    return writer.close();
+}
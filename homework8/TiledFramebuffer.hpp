@@ -0,0 +1,57 @@
+//
+// Out-of-core framebuffer for very large renders.
+//
+// The image is split into square tiles and every tile is stored contiguously
+// (padded to whole pages) in a file that is memory-mapped shared. A render
+// thread writes one tile at a time; finishTile() flushes it and drops its pages
+// from the process, so only the tiles currently being rendered are resident.
+// writeImage() then streams the result row by row into a PPM/PFM file, touching
+// one row of tiles at a time, so the full frame is never held in memory.
+//
+
+#ifndef RAYTRACING_TILEDFRAMEBUFFER_H
+#define RAYTRACING_TILEDFRAMEBUFFER_H
+
+#include <string>
+#include "MemoryStats.hpp"
+#include "Vector.hpp"
+
+class TiledFramebuffer
+{
+public:
+    // path 为后备文件（创建并按图像大小分配，析构时删除），tileSize 为分块边长
+    TiledFramebuffer(const std::string &path, int width, int height, int tileSize = 64);
+    ~TiledFramebuffer();
+    TiledFramebuffer(const TiledFramebuffer &) = delete;
+    TiledFramebuffer &operator=(const TiledFramebuffer &) = delete;
+
+    bool valid() const { return mapping != nullptr; }
+
+    int width() const { return w; }
+    int height() const { return h; }
+    int tileSize() const { return ts; }
+    int tilesX() const { return tx; }
+    int tilesY() const { return ty; }
+    int tileCount() const { return tx * ty; }
+
+    // 第 tile 个分块（行优先编号）的像素，按 tileSize x tileSize 行优先存放；
+    // 图像边缘的分块只用到左上角的一部分
+    Vector3f *tile(int index);
+    // 分块渲染完成：写回文件并把它的页从进程中释放
+    void finishTile(int index);
+
+    // 以流的方式写出整幅图（.ppm / .pfm，格式由后缀决定），gamma 含义同 writeImage
+    bool writeImage(const std::string &filename, float gamma) const;
+
+private:
+    int w, h, ts, tx, ty;
+    size_t tileBytes; // 每个分块占用的字节数（按页对齐）
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+    mem::External mapped;
+    std::string path;
+
+    void evict(size_t offset, size_t bytes) const;
+};
+
+#endif //RAYTRACING_TILEDFRAMEBUFFER_H
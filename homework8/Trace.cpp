@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Trace.hpp"
+
+namespace trace
+{
+    namespace
+    {
+        struct Event
+        {
+            const char *name;
+            uint64_t begin, end;
+            char detail[48];
+        };
+
+        // 每个线程一个环形缓冲区，只有所属线程写入。从 initialCapacity 开始按需翻倍，
+        // 到 capacity 后回绕；线程退出后放回 freeBuffers 给下一个线程用，写出之前不释放
+        struct ThreadBuffer
+        {
+            static constexpr size_t initialCapacity = 1 << 10;
+            static constexpr size_t capacity = 1 << 15;
+            std::vector<Event> events;
+            uint64_t count = 0;
+            int id = 0;
+            std::string name;
+        };
+
+        std::mutex registryMutex;
+        std::vector<std::unique_ptr<ThreadBuffer> > registry;
+        std::vector<ThreadBuffer *> freeBuffers;
+        std::string outputFile;
+        std::chrono::steady_clock::time_point origin;
+
+        // 线程退出时把缓冲区放回 freeBuffers
+        struct BufferLease
+        {
+            ThreadBuffer *buffer = nullptr;
+            ~BufferLease()
+            {
+                if (!buffer)
+                    return;
+                std::lock_guard<std::mutex> lock(registryMutex);
+                freeBuffers.push_back(buffer);
+            }
+        };
+
+        ThreadBuffer &threadBuffer()
+        {
+            thread_local BufferLease lease;
+            if (!lease.buffer)
+            {
+                std::lock_guard<std::mutex> lock(registryMutex);
+                if (!freeBuffers.empty())
+                {
+                    // 前一个线程已经退出，它的事件和这个线程的在时间上不重叠，可以放在同一个 track 上
+                    lease.buffer = freeBuffers.back();
+                    freeBuffers.pop_back();
+                }
+                else
+                {
+                    registry.push_back(std::make_unique<ThreadBuffer>());
+                    lease.buffer = registry.back().get();
+                    lease.buffer->id = int(registry.size());
+                    lease.buffer->events.resize(ThreadBuffer::initialCapacity);
+                }
+                // 复用的缓冲区还带着前一个线程的名字，这个线程没调用 setThreadName 时不能沿用
+                lease.buffer->name = "Thread " + std::to_string(lease.buffer->id);
+            }
+            return *lease.buffer;
+        }
+
+        void writeString(FILE *f, const std::string &s)
+        {
+            fputc('"', f);
+            for (char c : s)
+            {
+                if (c == '"' || c == '\\')
+                    fputc('\\', f);
+                if (static_cast<unsigned char>(c) >= 0x20)
+                    fputc(c, f);
+            }
+            fputc('"', f);
+        }
+    }
+
+    uint64_t now()
+    {
+        // 加 1 保证有效的时间戳不为 0（Zone 用 0 表示没有在记录）
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count() + 1;
+    }
+
+    void record(const char *name, uint64_t begin, uint64_t end, const char *detail)
+    {
+        ThreadBuffer &buffer = threadBuffer();
+        if (buffer.count == buffer.events.size() && buffer.count < ThreadBuffer::capacity)
+            buffer.events.resize(std::min(2 * buffer.events.size(), ThreadBuffer::capacity));
+        Event &e = buffer.events[buffer.count++ % ThreadBuffer::capacity];
+        e.name = name;
+        e.begin = begin;
+        e.end = end;
+        std::copy(detail, detail + sizeof(e.detail), e.detail);
+    }
+
+    void setThreadName(const std::string &name)
+    {
+        if (active.load(std::memory_order_relaxed))
+            threadBuffer().name = name;
+    }
+
+    void start(const std::string &filename)
+    {
+        outputFile = filename;
+        origin = std::chrono::steady_clock::now();
+        active = true;
+        setThreadName("Main");
+    }
+
+    bool stop()
+    {
+        if (!active.exchange(false))
+            return false;
+
+        FILE *f = fopen(outputFile.c_str(), "w");
+        if (!f)
+        {
+            fprintf(stderr, "Cannot write trace %s\n", outputFile.c_str());
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(registryMutex);
+        fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool first = true;
+        size_t total = 0, dropped = 0;
+        for (auto &buffer : registry)
+        {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                    first ? "" : ",\n", buffer->id);
+            writeString(f, buffer->name);
+            fprintf(f, "}}");
+            first = false;
+
+            // 缓冲区写满之后从最旧的事件开始输出
+            uint64_t kept = std::min<uint64_t>(buffer->count, ThreadBuffer::capacity);
+            dropped += buffer->count - kept;
+            for (uint64_t i = buffer->count - kept; i < buffer->count; ++i)
+            {
+                const Event &e = buffer->events[i % ThreadBuffer::capacity];
+                fprintf(f, ",\n{\"name\":");
+                writeString(f, e.name);
+                fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", buffer->id,
+                        e.begin * 1e-3, (e.end - e.begin) * 1e-3);
+                if (e.detail[0])
+                {
+                    fprintf(f, ",\"args\":{\"detail\":");
+                    writeString(f, e.detail);
+                    fprintf(f, "}");
+                }
+                fprintf(f, "}");
+                ++total;
+            }
+        }
+        fprintf(f, "\n]}\n");
+        fclose(f);
+        printf("Trace: %zu events from %zu threads written to %s", total, registry.size(), outputFile.c_str());
+        if (dropped)
+            printf(" (%zu oldest events overwritten)", dropped);
+        printf("\n");
+        return true;
+    }
+}
@@ -3,11 +3,16 @@
 #include "BVH.hpp"
 #include "Intersection.hpp"
 #include "Material.hpp"
+#include "MemoryStats.hpp"
 #include "OBJ_Loader.hpp"
 #include "Object.hpp"
+#include "RayStats.hpp"
+#include "SceneCache.hpp"
+#include "Trace.hpp"
 #include "Triangle.hpp"
 #include <cassert>
 #include <array>
+#include <functional>
 
 bool rayTriangleIntersect(const Vector3f& v0, const Vector3f& v1,
                           const Vector3f& v2, const Vector3f& orig,
@@ -50,8 +55,17 @@ public:
     Material* m;
 
     Triangle(Vector3f _v0, Vector3f _v1, Vector3f _v2, Material* _m = nullptr)
-        : v0(_v0), v1(_v1), v2(_v2), m(_m)
+        : m(_m)
     {
+        setVertices(_v0, _v1, _v2);
+    }
+
+    // 顶点移动之后（动画）重新计算边、法向量和面积
+    void setVertices(const Vector3f& _v0, const Vector3f& _v1, const Vector3f& _v2)
+    {
+        v0 = _v0;
+        v1 = _v1;
+        v2 = _v2;
         e1 = v1 - v0;
         e2 = v2 - v0;
         // 计算该三角形的法向量
@@ -96,14 +110,40 @@ public:
 class MeshTriangle : public Object
 {
 public:
-    MeshTriangle(const std::string& filename, Material *mt = new Material())
+    // dynamic 为 true 时保留二叉 BVH，之后可以通过 setTransform 逐帧 refit
+    MeshTriangle(const std::string& filename, Material *mt = new Material(), bool dynamic = false)
     {
-        objl::Loader loader;
-        loader.LoadFile(filename);
         area = 0;
         m = mt;
+        // 发光的模型还要用二叉树按面积采样，动画模型要 refit，其余的只保留压缩的 4 叉 BVH
+        bool keepBuildTree = m->hasEmission() || dynamic;
+        uint64_t params = MeshCache::hashParams({uint64_t(bvhTreeletSize), uint64_t(keepBuildTree)});
+
+        if (sceneCacheEnabled)
+        {
+            TRACE_ZONE("Scene cache load", filename);
+            auto cached = std::make_unique<MeshCache>();
+            if (cached->open(filename, params))
+            {
+                loadFromCache(std::move(cached));
+                printf("Scene cache hit [%s]: %zu triangles\n", filename.c_str(), triangles.size());
+                return;
+            }
+        }
+
+        // 解析结果和只用于写缓存的顶点数组都是临时数据，构造函数结束时释放
+        mem::Scope loading(mem::Loader);
+        objl::Loader loader;
+        {
+            TRACE_ZONE("OBJ load", filename);
+            loader.LoadFileFast(filename);
+        }
         assert(loader.LoadedMeshes.size() == 1);
         auto mesh = loader.LoadedMeshes[0];
+        {
+            mem::Scope geometry(mem::Geometry);
+            triangles.reserve(mesh.Vertices.size() / 3);
+        }
 
         Vector3f min_vert = Vector3f{std::numeric_limits<float>::infinity(),
                                      std::numeric_limits<float>::infinity(),
@@ -112,6 +152,8 @@ public:
                                      -std::numeric_limits<float>::infinity(),
                                      -std::numeric_limits<float>::infinity()};
 
+        std::vector<Vector3f> positions;
+        positions.reserve(mesh.Vertices.size());
         for (int i = 0; i < mesh.Vertices.size(); i += 3) {
             std::array<Vector3f, 3> face_vertices;
 
@@ -120,6 +162,7 @@ public:
                                      mesh.Vertices[i + j].Position.Y,
                                      mesh.Vertices[i + j].Position.Z);
                 face_vertices[j] = vert;
+                positions.push_back(vert);
 
                 min_vert = Vector3f(std::min(min_vert.x, vert.x),
                                     std::min(min_vert.y, vert.y),
@@ -144,11 +187,89 @@ public:
         }
 
         // 为该模型创建BVH加速结构
-        bvh = new BVHAccel(ptrs);
+        {
+            TRACE_ZONE("Mesh BVH build", filename);
+            mem::Scope scope(mem::BVH);
+            bvh = new BVHAccel(ptrs);
+            if (bvhTreeletSize > 0)
+                bvh->optimizeTreelets(bvhTreeletSize);
+
+            // 求交改用压缩的 4 叉 BVH
+            bvh->compress();
+        }
+        if (bvhStats)
+            bvh->printMemoryReport(filename.c_str(), triangles.size() * sizeof(Triangle));
+        if (!keepBuildTree)
+            bvh->releaseBuildTree();
+
+        if (sceneCacheEnabled)
+        {
+            const Triangle* first = triangles.data();
+            auto primIndex = [first](const Object* o) {
+                return uint32_t(static_cast<const Triangle*>(o) - first);
+            };
+            TRACE_ZONE("Scene cache save", filename);
+            if (!MeshCache::save(filename, params, positions, bounding_box, *bvh, primIndex))
+                printf("Scene cache [%s]: failed to write %s\n", filename.c_str(),
+                       MeshCache::cachePath(filename).c_str());
+        }
+    }
+
+    // 动画：把 f 作用在静止姿态的顶点上，然后更新模型的包围盒和 BVH（refit 或 LBVH 重建）
+    // 返回 true 表示这一帧的 BVH 是重建的
+    bool setTransform(const std::function<Vector3f(const Vector3f&)>& f)
+    {
+        if (restVertices.empty())
+        {
+            mem::Scope scope(mem::Geometry);
+            restVertices.reserve(triangles.size());
+            for (auto& tri : triangles)
+                restVertices.push_back({tri.v0, tri.v1, tri.v2});
+        }
+
+        Bounds3 bounds;
+        area = 0;
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            triangles[i].setVertices(f(restVertices[i][0]), f(restVertices[i][1]), f(restVertices[i][2]));
+            bounds = Union(bounds, triangles[i].getBounds());
+            area += triangles[i].area;
+        }
+        bounding_box = bounds;
+
+        mem::Scope scope(mem::BVH);
+        return bvh->update();
     }
 
     bool intersect(const Ray& ray) { return true; }
 
+    // 从 mmap 的缓存重建模型：三角形要带虚表和材质指针，只能重新构造；
+    // 压缩的 BVH 结点则直接在映射的内存上遍历，cache 需要和模型一样长寿
+    void loadFromCache(std::unique_ptr<MeshCache> cached)
+    {
+        const float* v = cached->vertices();
+        size_t n = cached->triangleCount();
+        {
+            mem::Scope geometry(mem::Geometry);
+            triangles.reserve(n);
+        }
+        for (size_t i = 0; i < n; ++i, v += 9)
+            triangles.emplace_back(Vector3f(v[0], v[1], v[2]), Vector3f(v[3], v[4], v[5]),
+                                   Vector3f(v[6], v[7], v[8]), m);
+        bounding_box = cached->bounds();
+
+        mem::Scope scope(mem::BVH);
+
+        std::vector<Object*> ptrs;
+        for (auto& tri : triangles){
+            ptrs.push_back(&tri);
+            area += tri.area;
+        }
+        BVHBuildNode* root = cached->buildTree(ptrs);
+        bvh = new BVHAccel(ptrs, root, cached->nodes(), cached->nodeCount());
+        cache = std::move(cached);
+    }
+
     bool intersect(const Ray& ray, float& tnear, uint32_t& index) const
     {
         bool intersect = false;
@@ -227,8 +348,12 @@ public:
     std::unique_ptr<Vector2f[]> stCoordinates;
 
     std::vector<Triangle> triangles;
+    // 第一次调用 setTransform 时保存的静止姿态
+    std::vector<std::array<Vector3f, 3>> restVertices;
 
     BVHAccel* bvh;
+    // 从场景缓存载入时持有 mmap 的文件
+    std::unique_ptr<MeshCache> cache;
     float area;
 
     Material* m;
@@ -246,6 +371,7 @@ inline Bounds3 Triangle::getBounds() { return Union(Bounds3(v0, v1), v2); }
 inline Intersection Triangle::getIntersection(Ray ray)
 {
     Intersection inter;
+    RT_STAT(triangleTests);
 
     if (dotProduct(ray.direction, normal) > 0)
         return inter;
@@ -18,9 +18,9 @@ public:
     Vector3f operator * (const float &r) const { return Vector3f(x * r, y * r, z * r); }
     Vector3f operator / (const float &r) const { return Vector3f(x / r, y / r, z / r); }
     
-    float squareNorm() {return (x * x + y * y + z * z);}
-    float norm() {return std::sqrt(x * x + y * y + z * z);}
-    Vector3f normalized() {
+    float squareNorm() const {return (x * x + y * y + z * z);}
+    float norm() const {return std::sqrt(x * x + y * y + z * z);}
+    Vector3f normalized() const {
         float n = std::sqrt(x * x + y * y + z * z);
         return Vector3f(x / n, y / n, z / n);
     }
@@ -34,8 +34,8 @@ public:
     { return Vector3f(v.x * r, v.y * r, v.z * r); }
     friend std::ostream & operator << (std::ostream &os, const Vector3f &v)
     { return os << v.x << ", " << v.y << ", " << v.z; }
-    double       operator[](int index) const;
-    double&      operator[](int index);
+    float        operator[](int index) const;
+    float&       operator[](int index);
 
 
     static Vector3f Min(const Vector3f &p1, const Vector3f &p2) {
@@ -48,7 +48,10 @@ public:
                        std::max(p1.z, p2.z));
     }
 };
-inline double Vector3f::operator[](int index) const {
+inline float Vector3f::operator[](int index) const {
+    return (&x)[index];
+}
+inline float& Vector3f::operator[](int index) {
     return (&x)[index];
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 #include <iostream>
 #include <cmath>
+#include <cstdint>
 #include <random>
 
 #undef M_PI
@@ -28,14 +29,30 @@ inline  bool solveQuadratic(const float &a, const float &b, const float &c, floa
     return true;
 }
 
+// 每个线程一个随机数引擎（以前每次调用都新建 random_device，既慢又无法复现）
+inline std::mt19937& random_engine()
+{
+    thread_local std::mt19937 rng(std::random_device{}());
+    return rng;
+}
+
+// 重新设置当前线程的种子：渲染时每个分块开始前调用，结果与线程/进程的划分无关
+inline void seed_random(uint64_t seed)
+{
+    // splitmix64，把相邻的种子打散
+    seed += 0x9e3779b97f4a7c15ull;
+    seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ull;
+    seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebull;
+    seed ^= seed >> 31;
+    random_engine().seed(uint32_t(seed ^ (seed >> 32)));
+}
+
 // 产生随机数
 inline float get_random_float()
 {
-    std::random_device dev;
-    std::mt19937 rng(dev());
     std::uniform_real_distribution<float> dist(0.f, 1.f); // distribution in range [1, 6]
 
-    return dist(rng);
+    return dist(random_engine());
 }
 
 inline void UpdateProgress(float progress)
@@ -1,10 +1,17 @@
+#include "BenchReport.hpp"
+#include "Convergence.hpp"
+#include "MemoryStats.hpp"
+#include "PerfCounters.hpp"
 #include "Renderer.hpp"
+#include "RenderServer.hpp"
+#include "Trace.hpp"
 #include "Scene.hpp"
 #include "Triangle.hpp"
 #include "Sphere.hpp"
 #include "Vector.hpp"
 #include "global.hpp"
 #include <chrono>
+#include <thread>
 
 // In the main function of the program, we create the scene (create objects and
 // lights) as well as set the options for the render (image width and height,
@@ -13,50 +20,209 @@
 int main(int argc, char** argv)
 {
 
+    int frames = 1;
+    // 输出文件，格式由后缀决定（.ppm / .pfm / .png）
+    std::string output = "spp256.ppm";
+    int width = 1024, height = 1024;
+    std::string serverSocket;
+    std::string benchFile, baselineFile;
+    double threshold = 5;
+    ConvergenceOptions convergence;
+    bool sppGiven = false;
+    Renderer r;
+    for (int i = 1; i < argc; ++i)
+    {
+        // 建完 BVH 之后再做一遍 treelet 优化，启动慢一点，求交更快
+        if (std::string(argv[i]) == "--trbvh")
+            bvhTreeletSize = 7;
+        // 打印每个模型的 BVH 内存占用（二叉树和压缩后的 4 叉树，按每个图元折算）
+        else if (std::string(argv[i]) == "--bvh-stats")
+            bvhStats = true;
+        // 渲染 tallbox 绕自身中心旋转的动画序列，每帧只 refit BVH
+        else if (std::string(argv[i]) == "--frames" && i + 1 < argc)
+            frames = std::max(1, std::atoi(argv[++i]));
+        // 不读也不写 scene_cache/ 下的模型缓存
+        else if (std::string(argv[i]) == "--no-cache")
+            sceneCacheEnabled = false;
+        else if ((std::string(argv[i]) == "-o" || std::string(argv[i]) == "--output") && i + 1 < argc)
+            output = argv[++i];
+        else if (std::string(argv[i]) == "--size" && i + 1 < argc)
+        {
+            // 和渲染服务的 size= 一样要求 WxH 两个正整数
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+            {
+                fprintf(stderr, "--size expects WxH with positive width and height, got %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (std::string(argv[i]) == "--spp" && i + 1 < argc)
+        {
+            r.spp = std::max(1, std::atoi(argv[++i]));
+            sppGiven = true;
+        }
+        else if (std::string(argv[i]) == "--threads" && i + 1 < argc)
+            r.threads = std::atoi(argv[++i]);
+        else if (std::string(argv[i]) == "--tile" && i + 1 < argc)
+            r.tileSize = std::max(1, std::atoi(argv[++i]));
+        // 超大分辨率：framebuffer 放在映射到该文件的分块中，渲染完成后流式写出
+        else if (std::string(argv[i]) == "--tiled" && i + 1 < argc)
+            r.tileFile = argv[++i];
+        // 多进程渲染：fork 出 N 个 worker 进程分块渲染
+        else if (std::string(argv[i]) == "--workers" && i + 1 < argc)
+            r.workers = std::max(0, std::atoi(argv[++i]));
+        else if (std::string(argv[i]) == "--seed" && i + 1 < argc)
+            r.seed = std::strtoul(argv[++i], nullptr, 10);
+        // 把载入、建 BVH、每个分块的渲染和写图的时间线写成 Chrome trace-event JSON
+        else if (std::string(argv[i]) == "--trace" && i + 1 < argc)
+            trace::start(argv[++i]);
+        // 用硬件计数器统计载入、渲染和写图各阶段的 IPC 和缓存缺失
+        else if (std::string(argv[i]) == "--perf")
+            perf::start();
+        else if (std::string(argv[i]) == "--heatmap" && i + 1 < argc)
+            r.heatmapFile = argv[++i];
+        // 常驻渲染服务：场景只载入一次，通过 Unix socket 接收渲染任务（协议见 RenderServer.hpp）
+        else if (std::string(argv[i]) == "--server" && i + 1 < argc)
+            serverSocket = argv[++i];
+        // 把这次运行的耗时、吞吐量、内存和输出图像的 hash 写成 JSON（见 BenchReport.hpp）
+        else if (std::string(argv[i]) == "--bench" && i + 1 < argc)
+            benchFile = argv[++i];
+        // 和之前保存的结果比较，变差超过 --threshold 百分比时返回非 0
+        else if (std::string(argv[i]) == "--baseline" && i + 1 < argc)
+            baselineFile = argv[++i];
+        else if (std::string(argv[i]) == "--threshold" && i + 1 < argc)
+            threshold = std::atof(argv[++i]);
+        // 渐进渲染并在各个时间点（秒）和参考图像比较，误差随时间的变化写到 CSV（见 Convergence.hpp）
+        else if (std::string(argv[i]) == "--converge" && i + 1 < argc)
+            convergence.reference = argv[++i];
+        else if (std::string(argv[i]) == "--checkpoints" && i + 1 < argc)
+            convergence.checkpoints = parseCheckpoints(argv[++i]);
+        else if (std::string(argv[i]) == "--csv" && i + 1 < argc)
+            convergence.csv = argv[++i];
+        else if (std::string(argv[i]) == "--label" && i + 1 < argc)
+            convergence.label = argv[++i];
+    }
+
     // Change the definition here to change resolution
     // 初始化屏幕分辨率
-    Scene scene(1024, 1024);
-
-    Material* red = new Material(DIFFUSE, Vector3f(0.0f));
-    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
-    Material* green = new Material(DIFFUSE, Vector3f(0.0f));
-    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
-    Material* white = new Material(DIFFUSE, Vector3f(0.0f));
-    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
-
-    // 光照既有自发光又有自身颜色
-    Material* light = new Material(DIFFUSE, (8.0f * Vector3f(0.747f+0.058f, 0.747f+0.258f, 0.747f) + 15.6f * Vector3f(0.740f+0.287f,0.740f+0.160f,0.740f) + 18.4f *Vector3f(0.737f+0.642f,0.737f+0.159f,0.737f)));
-    light->Kd = Vector3f(0.65f);
-
-    // 读入模型和对应的材质
-    MeshTriangle floor("../models/cornellbox/floor.obj", white);
-    MeshTriangle shortbox("../models/cornellbox/shortbox.obj", white);
-    MeshTriangle tallbox("../models/cornellbox/tallbox.obj", white);
-    MeshTriangle left("../models/cornellbox/left.obj", red);
-    MeshTriangle right("../models/cornellbox/right.obj", green);
-    MeshTriangle light_("../models/cornellbox/light.obj", light);
-
-    // 向场景中添加模型（不需要指定位置，因为所有模型都已经对应好位置）
-    scene.Add(&floor);
-    scene.Add(&shortbox);
-    scene.Add(&tallbox);
-    scene.Add(&left);
-    scene.Add(&right);
-    scene.Add(&light_);
-
-    // 生成整个场景的加速结构
+    Scene scene(width, height);
+
+    // 材质计入 Geometry；之后的分配（帧缓冲、渲染线程等）不能再算到这里
+    Material *red, *green, *white, *light;
+    {
+        mem::Scope materials(mem::Geometry);
+        red = new Material(DIFFUSE, Vector3f(0.0f));
+        red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
+        green = new Material(DIFFUSE, Vector3f(0.0f));
+        green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
+        white = new Material(DIFFUSE, Vector3f(0.0f));
+        white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
+
+        // 光照既有自发光又有自身颜色
+        light = new Material(DIFFUSE, (8.0f * Vector3f(0.747f+0.058f, 0.747f+0.258f, 0.747f) + 15.6f * Vector3f(0.740f+0.287f,0.740f+0.160f,0.740f) + 18.4f *Vector3f(0.737f+0.642f,0.737f+0.159f,0.737f)));
+        light->Kd = Vector3f(0.65f);
+    }
+
+    // 读入模型和对应的材质：每个模型的解析和 BVH 构建作为一个任务并行执行
+    // （不需要指定位置，因为所有模型都已经对应好位置）
+    auto loadStart = std::chrono::steady_clock::now();
+    auto setupPhase = std::make_unique<perf::Phase>("Scene load + BVH build");
+    scene.AddAsync<MeshTriangle>(std::string("../models/cornellbox/floor.obj"), white);
+    scene.AddAsync<MeshTriangle>(std::string("../models/cornellbox/shortbox.obj"), white);
+    auto tallboxLoad = scene.AddAsync<MeshTriangle>(std::string("../models/cornellbox/tallbox.obj"), white, frames > 1);
+    scene.AddAsync<MeshTriangle>(std::string("../models/cornellbox/left.obj"), red);
+    scene.AddAsync<MeshTriangle>(std::string("../models/cornellbox/right.obj"), green);
+    scene.AddAsync<MeshTriangle>(std::string("../models/cornellbox/light.obj"), light);
+
+    // 生成整个场景的加速结构（先等待所有模型载入完成）
     scene.buildBVH();
+    MeshTriangle& tallbox = *tallboxLoad.get();
+    setupPhase.reset();
+    double setupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+    printf(" - Scene setup took %.1f ms\n", setupMs);
 
-    Renderer r;
+    if (!serverSocket.empty())
+    {
+        bool ok = runRenderServer(scene, r, serverSocket);
+        trace::stop();
+        perf::report();
+        mem::report();
+        return ok ? 0 : 1;
+    }
+
+    if (!convergence.reference.empty())
+    {
+        // 渐进渲染时 --spp 是每一遍的采样数，默认每遍 1 spp，时间点之间的粒度最细
+        if (!sppGiven)
+            r.spp = 1;
+        if (convergence.checkpoints.empty())
+            convergence.checkpoints = {1, 2, 5, 10, 30};
+        bool ok = runConvergence(scene, r, convergence);
+        trace::stop();
+        perf::report();
+        mem::report();
+        return ok ? 0 : 1;
+    }
 
     auto start = std::chrono::system_clock::now();
-    r.Render(scene);
+    auto renderStart = std::chrono::steady_clock::now();
+    std::string lastImage = output;
+    if (frames == 1)
+        r.Render(scene, output);
+    else
+    {
+        Vector3f center = tallbox.getBounds().Centroid();
+        for (int f = 0; f < frames; ++f)
+        {
+            float angle = 2 * M_PI * f / frames;
+            float c = std::cos(angle), s = std::sin(angle);
+            tallbox.setTransform([&](const Vector3f &p)
+                                 {
+                                     Vector3f d = p - center;
+                                     return center + Vector3f(c * d.x + s * d.z, d.y, -s * d.x + c * d.z);
+                                 });
+            scene.updateBVH();
+
+            char filename[64];
+            snprintf(filename, sizeof(filename), "frame_%03d", f);
+            size_t dot = output.find_last_of('.');
+            lastImage = filename + (dot == std::string::npos ? std::string(".ppm") : output.substr(dot));
+            r.Render(scene, lastImage);
+        }
+    }
     auto stop = std::chrono::system_clock::now();
+    double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+
+    trace::stop();
+    perf::report();
+    mem::report();
+
+    int status = 0;
+    if (!benchFile.empty())
+    {
+        bench::Report report;
+        report.set("scene", "cornellbox", bench::Config);
+        report.set("width", width, bench::Config);
+        report.set("height", height, bench::Config);
+        report.set("spp", r.spp, bench::Config);
+        report.set("seed", r.seed, bench::Config);
+        report.set("frames", frames, bench::Config);
+        report.set("hardware_threads", std::thread::hardware_concurrency(), bench::Config);
+        report.set("setup_ms", setupMs, bench::LowerIsBetter, 1);
+        report.set("bvh_build_ms", bvhBuildNanoseconds * 1e-6, bench::LowerIsBetter, 1);
+        report.set("render_ms", renderMs, bench::LowerIsBetter, 1);
+        // 只统计相机光线（每个像素 spp 条），反弹和阴影光线的数量和场景有关
+        report.set("mrays_per_s", double(width) * height * r.spp * frames / (renderMs * 1e3), bench::HigherIsBetter);
+        report.set("peak_rss_mb", bench::peakRssMb(), bench::LowerIsBetter, 1);
+        report.set("image_hash", bench::hashFile(lastImage), bench::Output);
+        report.write(benchFile);
+        if (!baselineFile.empty() && report.compare(baselineFile, threshold) > 0)
+            status = 1;
+    }
 
     std::cout << "Render complete: \n";
     std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::hours>(stop - start).count() << " hours\n";
     std::cout << "          : " << std::chrono::duration_cast<std::chrono::minutes>(stop - start).count() << " minutes\n";
     std::cout << "          : " << std::chrono::duration_cast<std::chrono::seconds>(stop - start).count() << " seconds\n";
 
-    return 0;
+    return status;
 }
\ No newline at end of file